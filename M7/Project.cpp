@@ -1,5 +1,12 @@
 #include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
+#include <vector>           // vector
+#include <chrono>           // steady_clock
+#include <thread>           // thread
+#include <mutex>            // mutex
+#include <condition_variable> // condition_variable
+#include <atomic>           // atomic
+#include <algorithm>        // replace
 #include <GL/glew.h>        // GLEW library
 #include <glfw3.h>          // GLFW library
 
@@ -14,6 +21,46 @@
 // Camera class
 #include <camera.h>
 
+// Hierarchical-Z occlusion culling
+#include <occlusion_culler.h>
+
+// Persistently mapped ring buffer for per-frame data
+#include <ring_buffer.h>
+
+// Swap interval, frame cap and frames-in-flight limit
+#include <frame_pacer.h>
+
+// Offscreen scene rendering at a resolution driven by the GPU frame time
+#include <dynamic_resolution.h>
+
+// GPU timer-query profiler and the text overlay it is shown with
+#include <text_overlay.h>
+#include <gpu_profiler.h>
+
+// Per-frame draw call, bind and upload counters
+#include <render_stats.h>
+
+// CPU scope tracing (compiled out in release builds)
+#include <cpu_trace.h>
+
+// Headless context, offscreen framebuffer, PNG output and golden-image comparison
+#include <headless.h>
+
+// Scripted camera path and frame time summaries for the benchmark mode
+#include <benchmark.h>
+
+// Primitive meshes (meshes.cpp in the repository root) and the generated stress scenes drawn with them
+#include <meshes.h>
+#include <stress_scene.h>
+
+// Lock-free snapshot hand-off between the simulation and render threads, and input-to-photon latency
+#include <triple_buffer.h>
+#include <latency_tracker.h>
+
+// Work-stealing job scheduler used for parallel loops, and its microbenchmarks
+#include <job_system.h>
+#include <job_benchmark.h>
+
 using namespace std; // Uses the standard namespace
 
 // Shader program Macro
@@ -30,6 +77,14 @@ namespace
     const int WINDOW_WIDTH = 1280;
     const int WINDOW_HEIGHT = 800;
 
+    // One glDrawArrays call of a mesh made of several fans and strips
+    struct DrawRange
+    {
+        GLenum mode;
+        GLint first;
+        GLsizei count;
+    };
+
     // Stores the GL data relative to a given mesh
     struct GLMesh
     {
@@ -38,11 +93,61 @@ namespace
         GLuint vbos[2];
         GLuint nVertices;   // Number of vertices of the mesh
         GLuint nIndices;
+        glm::vec3 boundsMin; // Local-space bounding box of the vertices
+        glm::vec3 boundsMax;
+        DrawRange ranges[3]; // Draw calls of the primitive meshes (used when nRanges > 0)
+        int nRanges;
+    };
+
+    // Stores the data needed to draw one textured object in the scene
+    struct SceneObject
+    {
+        const char* name;   // Name of the object
+        GLMesh* mesh;       // Mesh drawn for the object
+        GLuint textureId;   // Texture bound to texture unit 0
+        glm::mat4 model;    // Model matrix of the object
+        bool isOccluder;    // Solid box-shaped object that can hide the objects behind it
+        GLintptr drawDataOffset; // Offset of the object's DrawData in the uniform ring buffer this frame
+        glm::vec4 materialColor = glm::vec4(1.0f); // Multiplies the lit texture color
+    };
+
+    // Matches the FrameData uniform block (std140: every vec3 takes the space of a vec4)
+    struct FrameData
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec4 objectColor;
+        glm::vec4 keyLightColor;
+        glm::vec4 fillLightColor;
+        glm::vec4 keyLightPos;
+        glm::vec4 fillLightPos;
+        glm::vec4 keyViewPosition;
+        glm::vec4 fillViewPosition;
+        glm::vec2 uvScale;
+    };
+
+    // Matches the DrawData uniform block
+    struct DrawData
+    {
+        glm::mat4 model;
+        glm::mat4 normalMatrix;
+        glm::vec4 materialColor;
     };
 
+    // Uniform block binding points
+    const GLuint FRAME_DATA_BINDING = 0;
+    const GLuint DRAW_DATA_BINDING = 1;
+
+    // Bytes of uniform data each frame may write (frame data plus one DrawData per object and lamp); stress scenes need more
+    const GLsizeiptr UNIFORM_RING_FRAME_SIZE = 64 * 1024;
+
     // Main GLFW window
     GLFWwindow* gWindow = nullptr;
 
+    // Current framebuffer size of the window
+    int gWindowWidth = WINDOW_WIDTH;
+    int gWindowHeight = WINDOW_HEIGHT;
+
 
     // Triangle mesh data for the tip of the pen.
     GLMesh gPyramidMesh;
@@ -88,6 +193,75 @@ namespace
     // Shader program
     GLuint gProgramId;
     GLuint gLampProgramId;
+    GLuint gDepthProgramId;
+    GLuint gUpscaleProgramId;
+    GLuint gTextProgramId;
+
+    // Textured objects drawn by URender, in draw order
+    vector<SceneObject> gSceneObjects;
+
+    // Depth pre-pass: lays down depth with a position-only program so the lighting shader only runs once per pixel
+    bool gIsDepthPrepassEnabled = false;
+
+    // Overdraw measurement: counts fragment shader invocations of the color pass with and without the pre-pass
+    bool gIsOverdrawMeasuring = false;
+    GLuint gOverdrawQueries[2];                 // [0] without pre-pass, [1] with pre-pass
+    bool gIsOverdrawQueryPending[2] = { false, false };
+    GLuint64 gOverdrawInvocations[2] = { 0, 0 };
+    int gOverdrawFrames[2] = { 0, 0 };
+
+    // Occlusion culling: objects hidden behind the desk or the Rubik's cube are not submitted
+    bool gIsOcclusionCullingEnabled = false;
+    bool gIsShowingCulledObjects = false;      // draws the culled objects as wireframes
+    OcclusionCuller gOcclusionCuller;
+    int gLastRejectedCount = -1;
+
+    // Triple-buffered uniform data for the current frame
+    PersistentRingBuffer gUniformRing;
+
+    // Dynamic resolution: the scene is rendered offscreen at a scale that keeps its GPU time within budget
+    DynamicResolution gDynamicResolution;
+
+    // GPU profiler: times every pass and every object draw, shown on screen and saved when the program exits
+    GpuProfiler gGpuProfiler;
+    TextOverlay gTextOverlay;
+    const char* const GPU_PROFILE_CSV_PATH = "gpu_profile.csv";
+    const char* const GPU_PROFILE_JSON_PATH = "gpu_profile.json";
+
+    // Render statistics: counted every frame, shown with F5 and logged to a CSV file with F6
+    RenderStats gRenderStats;
+    bool gIsStatsOverlayVisible = false;
+    FILE* gRenderStatsLog = nullptr;
+    const char* const RENDER_STATS_CSV_PATH = "render_stats.csv";
+
+    // Headless mode: renders a fixed number of frames offscreen, saves the last one and compares it with a golden image
+    HeadlessOptions gHeadless;
+    HeadlessContext gHeadlessContext;
+    OffscreenTarget gOffscreenTarget;
+    const float HEADLESS_DELTA_TIME = 1.0f / 60.0f; // fixed so every run renders the same frames
+
+    // Benchmark mode: a camera path replaces user input and the frame times are saved as JSON
+    BenchmarkOptions gBenchmark;
+    CameraPath gCameraPath;
+
+    // Stress scenes: N generated instances of the primitive meshes replace the desk, optionally swept over several N
+    StressOptions gStress;
+    Meshes gMeshes;
+    bool gIsPrimitiveMeshesCreated = false;
+    GLMesh gStressMeshes[STRESS_PRIMITIVE_COUNT]; // the primitive meshes with their draw ranges and bounds
+    const float DEFAULT_FAR_PLANE = 100.0f;
+    float gFarPlane = DEFAULT_FAR_PLANE;          // pushed back so a large stress scene is not clipped
+
+    // Frame times in milliseconds recorded by UMeasureFrames
+    struct MeasuredFrames
+    {
+        vector<float> cpuTimes;
+        vector<float> gpuTimes;
+        vector<float> frameTimes;
+    };
+
+    // Chrome trace-event file written on exit by debug builds
+    const char* const CPU_TRACE_PATH = "cpu_trace.json";
 
     // camera
     Camera gCamera(glm::vec3(0.0f, 0.0f, 25.0f));
@@ -96,8 +270,11 @@ namespace
     bool gFirstMouse = true;
 
     // timing
-    float gDeltaTime = 0.0f; // Time between current frame and last frame
-    float gLastFrame = 0.0f;
+    float gDeltaTime = 0.0f; // Time simulated by this frame, or by this simulation tick when rendering on its own thread
+
+    // frame pacing
+    FramePacer gFramePacer;
+    const double FRAME_CAPS[] = { 0.0, 30.0, 60.0, 120.0 }; // frame rates selectable with F2 (0 = no cap)
 
     glm::vec3 gObjectColor(1.f, 0.2f, 0.0f);
 
@@ -114,6 +291,67 @@ namespace
     // Lamp animation
     bool gIsLampOrbiting = false;
 
+    // Render on demand: the loop only redraws after something changed and otherwise sleeps in glfwWaitEventsTimeout (F7 switches to continuous rendering)
+    bool gIsRenderOnDemand = true;
+    bool gIsFrameDirty = true;                  // set by input, camera changes, animations and resizes
+    const double ON_DEMAND_WAIT_SECONDS = 0.5;  // longest sleep between two checks of the loop
+
+    // Keys that change renderer settings. UProcessInput counts their presses and URender applies them,
+    // so they work the same whether or not rendering runs on its own thread
+    const int RENDER_KEYS[] = { GLFW_KEY_P, GLFW_KEY_R, GLFW_KEY_G, GLFW_KEY_F5, GLFW_KEY_F6, GLFW_KEY_F4, GLFW_KEY_F1, GLFW_KEY_F2,
+                                GLFW_KEY_F3, GLFW_KEY_C, GLFW_KEY_V, GLFW_KEY_O };
+    const int NUM_RENDER_KEYS = sizeof(RENDER_KEYS) / sizeof(RENDER_KEYS[0]);
+
+    // Immutable copy of the simulation state a frame is rendered from. The scene objects never move, so they are not copied.
+    struct SceneSnapshot
+    {
+        unsigned long long serial;              // increases with every captured snapshot
+        glm::mat4 view;
+        glm::vec3 cameraPosition;
+        float cameraZoom;
+        glm::vec3 keyLightPosition;
+        glm::vec3 fillLightPosition;
+        glm::vec2 uvScale;
+        int framebufferWidth;
+        int framebufferHeight;
+        unsigned int renderKeyPresses[NUM_RENDER_KEYS]; // presses of each render key since startup
+        bool isRenderOnDemand;
+        chrono::steady_clock::time_point inputTime;  // first input not on screen yet, time_point() when there is none
+    };
+
+    // Simulation state owned by the input thread (the main thread: GLFW only delivers events there)
+    unsigned int gRenderKeyPresses[NUM_RENDER_KEYS] = { 0 };
+    int gRequestedWidth = WINDOW_WIDTH;         // framebuffer size reported by GLFW, adopted by the renderer from the next snapshot
+    int gRequestedHeight = WINDOW_HEIGHT;
+    unsigned long long gSnapshotSerial = 0;
+    chrono::steady_clock::time_point gPendingInputTime;
+    unsigned long long gPendingInputSerial = 0; // first snapshot that contains the pending input
+
+    // Render state shared with the input thread
+    atomic<unsigned long long> gPresentedSerial(0); // serial of the last snapshot presented
+    atomic<bool> gIsRendererAnimating(false);       // renderer settings that need a frame every refresh
+    unsigned int gAppliedRenderKeyPresses[NUM_RENDER_KEYS] = { 0 };
+
+    // Render thread: the input thread publishes snapshots at SIMULATION_STEP_SECONDS and the render thread draws the latest one (F8)
+    bool gIsRenderThreadRequested = false;
+    bool gIsRenderThreaded = false;
+    thread gRenderThread;
+    atomic<bool> gIsRenderThreadRunning(false);
+    TripleBuffer<SceneSnapshot> gSnapshots;
+    mutex gSnapshotMutex;                       // only used to sleep on gSnapshotPublished; the snapshots themselves are lock-free
+    condition_variable gSnapshotPublished;
+    chrono::steady_clock::time_point gLastSimulationTick;
+    const double SIMULATION_STEP_SECONDS = 1.0 / 240.0;
+
+    // Input-to-photon latency, reported separately for each threading mode
+    LatencyTracker gLatencyTracker;
+    const size_t LATENCY_REPORT_SAMPLES = 30;
+
+    // Job system: one worker per hardware thread besides the main thread, which runs jobs while it waits for them
+    JobSystem gJobSystem;
+    JobBenchmarkOptions gJobBenchmark;
+    const int DRAW_DATA_BATCH = 256; // objects per job when the DrawData is written in parallel
+
     // for the projection
     bool perspective = false;
 
@@ -129,8 +367,25 @@ namespace
  */
 
 bool UInitialize(int, char* [], GLFWwindow** window);
+bool UInitializeHeadless();
+int URunHeadless();
+int URunBenchmark();
+int URunStressSweep();
+bool UMeasureFrames(int numWarmupFrames, int numMeasuredFrames, float timestep, MeasuredFrames& measured);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
+bool UWasKeyPressed(GLFWwindow* window, int key);
+bool UIsSceneAnimating();
+void UApplyRenderKey(int key);
+void UNoteInput();
+void USimulate(float deltaTime);
+void UCaptureSnapshot(SceneSnapshot& snapshot);
+void URunSimulationTick();
+void UStartRenderThread();
+void UStopRenderThread();
+void URenderThread();
+void UReportFrameStatistics();
+void UApplyResize(int width, int height);
 
 void UCreatePlaneMesh(GLMesh& mesh);
 void UCreatePyramidMesh(GLMesh& mesh);
@@ -138,12 +393,28 @@ void UCreateCylinderMesh(GLMesh& mesh);
 void UCreateCubeMesh(GLMesh& mesh);
 void UCreateSphereMesh(GLMesh& mesh);
 
+void UComputeMeshBounds(GLMesh& mesh, const GLfloat* verts, GLuint floatsPerVertexTotal);
 void UDestroyMesh(GLMesh& mesh);
 
-bool UCreateTexture(const char* filename, GLuint& textureId);
+// Pixels decoded by stb_image, flipped so the first row is the bottom of the texture
+struct DecodedImage
+{
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+};
+
+bool UDecodeImage(const char* filename, DecodedImage& image);
+bool UCreateTexture(const DecodedImage& image, GLuint& textureId);
 void UDestroyTexture(GLuint textureId);
 
-void URender();
+void UCreateSceneObjects();
+void UCreatePrimitiveMeshes();
+void UCreateStressScene(int count);
+bool UCreateUniformRing();
+GLintptr UWriteDrawData(const glm::mat4& model, const glm::vec4& materialColor = glm::vec4(1.0f));
+void URender(const SceneSnapshot& snapshot);
 
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
 void UDestroyShaderProgram(GLuint programId);
@@ -153,6 +424,10 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 
+// callback functions that mark the frame dirty for render on demand
+void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void UWindowRefreshCallback(GLFWwindow* window);
+
 
 // Objects Vertex Shader Source Code. 
 const GLchar* vertexShaderSource = GLSL(440,
@@ -163,11 +438,33 @@ layout(location = 2) in vec2 textureCoordinate;  // Texture data from Vertex Att
 out vec3 vertexNormal; // For outgoing normals to fragment shader
 out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 out vec2 vertexTextureCoordinate; // variable to transfer texture data to the fragment shader
+out vec4 vertexMaterialColor; // per-object tint for the fragment shader
+
+// Per-frame data written to the uniform ring buffer once per frame (binding 0)
+layout(std140, binding = 0) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 objectColor;
+    vec3 keyLightColor;
+    vec3 fillLightColor;
+    vec3 keyLightPos;
+    vec3 fillLightPos;
+    vec3 keyViewPosition;
+    vec3 fillViewPosition;
+    vec2 uvScale;
+};
+
+// Per-draw data written to the uniform ring buffer for every object (binding 1)
+layout(std140, binding = 1) uniform DrawData
+{
+    mat4 model;
+    mat4 normalMatrix; // transpose(inverse(model)), computed once on the CPU
+    vec4 materialColor;
+};
 
-// Global variable for the transform matricies
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Must match the depth pre-pass exactly so GL_EQUAL depth testing passes
+invariant gl_Position;
 
 void main()
 {
@@ -175,8 +472,9 @@ void main()
 
     vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
 
-    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
+    vertexNormal = mat3(normalMatrix) * normal; // get normal vectors in world space only and exclude normal translation properties
     vertexTextureCoordinate = textureCoordinate;
+    vertexMaterialColor = materialColor;
 }
 );
 
@@ -185,20 +483,27 @@ const GLchar* fragmentShaderSource = GLSL(440,
     in vec3 vertexNormal; // For incoming normals
 in vec3 vertexFragmentPos; // For incoming fragment position
 in vec2 vertexTextureCoordinate; // Variable to hold incoming color data from vertex shader
+in vec4 vertexMaterialColor; // Per-object tint
 
 out vec4 fragmentColor; // for outgoing object color to the GPU
 
 // Uniform / Global variables for object color, light color, light position, and camera/view position
-uniform vec3 objectColor;
-
-uniform vec3 keyLightColor;
-uniform vec3 fillLightColor;
-uniform vec3 keyLightPos;
-uniform vec3 fillLightPos;
-uniform vec3 keyViewPosition;
-uniform vec3 fillViewPosition;
+// Per-frame data written to the uniform ring buffer once per frame (binding 0)
+layout(std140, binding = 0) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 objectColor;
+    vec3 keyLightColor;
+    vec3 fillLightColor;
+    vec3 keyLightPos;
+    vec3 fillLightPos;
+    vec3 keyViewPosition;
+    vec3 fillViewPosition;
+    vec2 uvScale;
+};
+
 uniform sampler2D uTexture; // Useful when working with multiple textures
-uniform vec2 uvScale;
 
 void main()
 {
@@ -256,7 +561,7 @@ void main()
     vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
 
     // Calculate phong result
-    vec3 phong = (ambient1 + ambient2 + diffuse1 + diffuse2 + specular1 + specular2) * textureColor.xyz;
+    vec3 phong = (ambient1 + ambient2 + diffuse1 + diffuse2 + specular1 + specular2) * textureColor.xyz * vertexMaterialColor.xyz;
 
     fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
 }
@@ -267,10 +572,29 @@ const GLchar* lampVertexShaderSource = GLSL(440,
 
     layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
 
-//Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+//Uniform blocks shared with the objects shader
+// Per-frame data written to the uniform ring buffer once per frame (binding 0)
+layout(std140, binding = 0) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 objectColor;
+    vec3 keyLightColor;
+    vec3 fillLightColor;
+    vec3 keyLightPos;
+    vec3 fillLightPos;
+    vec3 keyViewPosition;
+    vec3 fillViewPosition;
+    vec2 uvScale;
+};
+
+// Per-draw data written to the uniform ring buffer for every object (binding 1)
+layout(std140, binding = 1) uniform DrawData
+{
+    mat4 model;
+    mat4 normalMatrix; // transpose(inverse(model)), computed once on the CPU
+    vec4 materialColor;
+};
 
 void main()
 {
@@ -290,6 +614,141 @@ void main()
 }
 );
 
+/* Upscale Vertex Shader Source Code*/
+const GLchar* upscaleVertexShaderSource = GLSL(440,
+
+    out vec2 screenCoordinate; // Position in the window from 0 to 1
+
+void main()
+{
+    // One triangle that covers the whole window, generated from the vertex index
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    screenCoordinate = corner;
+    gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
+);
+
+/* Upscale Fragment Shader Source Code*/
+const GLchar* upscaleFragmentShaderSource = GLSL(440,
+
+    in vec2 screenCoordinate;
+
+out vec4 fragmentColor;
+
+uniform sampler2D sceneTexture; // Offscreen color buffer of the scene
+uniform vec2 renderRegion;      // Part of the texture the scene was rendered to
+uniform vec2 uvMax;             // Last texel center inside that part
+uniform vec2 texelSize;
+uniform int filterMode;         // 0 = bilinear, 1 = edge-aware
+
+void main()
+{
+    vec2 uv = min(screenCoordinate * renderRegion, uvMax);
+    vec3 color = texture(sceneTexture, uv).rgb;
+
+    if (filterMode == 1)
+    {
+        vec3 north = texture(sceneTexture, min(uv + vec2(0.0f, texelSize.y), uvMax)).rgb;
+        vec3 south = texture(sceneTexture, max(uv - vec2(0.0f, texelSize.y), vec2(0.0f))).rgb;
+        vec3 east = texture(sceneTexture, min(uv + vec2(texelSize.x, 0.0f), uvMax)).rgb;
+        vec3 west = texture(sceneTexture, max(uv - vec2(texelSize.x, 0.0f), vec2(0.0f))).rgb;
+
+        // Sharpen flat areas the most and strong edges the least, and never overshoot the neighbors
+        vec3 minColor = min(color, min(min(north, south), min(east, west)));
+        vec3 maxColor = max(color, max(max(north, south), max(east, west)));
+        float contrast = max(maxColor.r - minColor.r, max(maxColor.g - minColor.g, maxColor.b - minColor.b));
+        float amount = 0.25f * (1.0f - contrast);
+
+        color = clamp(color + amount * (4.0f * color - north - south - east - west), minColor, maxColor);
+    }
+
+    fragmentColor = vec4(color, 1.0f);
+}
+);
+
+/* Text Overlay Vertex Shader Source Code*/
+const GLchar* textVertexShaderSource = GLSL(440,
+
+    layout(location = 0) in vec2 position;            // Window pixels, origin in the top-left corner
+layout(location = 1) in vec2 textureCoordinate;
+layout(location = 2) in vec4 color;
+
+out vec2 vertexTextureCoordinate;
+out vec4 vertexColor;
+
+uniform vec2 screenSize;
+
+void main()
+{
+    gl_Position = vec4(position.x / screenSize.x * 2.0f - 1.0f, 1.0f - position.y / screenSize.y * 2.0f, 0.0f, 1.0f);
+    vertexTextureCoordinate = textureCoordinate;
+    vertexColor = color;
+}
+);
+
+/* Text Overlay Fragment Shader Source Code*/
+const GLchar* textFragmentShaderSource = GLSL(440,
+
+    in vec2 vertexTextureCoordinate;
+in vec4 vertexColor;
+
+out vec4 fragmentColor;
+
+uniform sampler2D glyphAtlas; // Single channel, 1 where a glyph pixel is lit
+
+void main()
+{
+    fragmentColor = vec4(vertexColor.rgb, vertexColor.a * texture(glyphAtlas, vertexTextureCoordinate).r);
+}
+);
+
+/* Depth Pre-pass Vertex Shader Source Code*/
+const GLchar* depthVertexShaderSource = GLSL(440,
+
+    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+
+//Uniform blocks shared with the objects shader
+// Per-frame data written to the uniform ring buffer once per frame (binding 0)
+layout(std140, binding = 0) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 objectColor;
+    vec3 keyLightColor;
+    vec3 fillLightColor;
+    vec3 keyLightPos;
+    vec3 fillLightPos;
+    vec3 keyViewPosition;
+    vec3 fillViewPosition;
+    vec2 uvScale;
+};
+
+// Per-draw data written to the uniform ring buffer for every object (binding 1)
+layout(std140, binding = 1) uniform DrawData
+{
+    mat4 model;
+    mat4 normalMatrix; // transpose(inverse(model)), computed once on the CPU
+    vec4 materialColor;
+};
+
+// Must match the objects vertex shader exactly so GL_EQUAL depth testing passes
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+}
+);
+
+/* Depth Pre-pass Fragment Shader Source Code*/
+const GLchar* depthFragmentShaderSource = GLSL(440,
+
+void main()
+{
+    // Only depth is written
+}
+);
+
 // Images are loaded with Y axis goinf down, but OpenGL's Y axis goes up, so we will flip it
 void flipImageVertically(unsigned char* image, int width, int height, int channels)
 {
@@ -311,7 +770,25 @@ void flipImageVertically(unsigned char* image, int width, int height, int channe
 
 int main(int argc, char* argv[])
 {
-    if (!UInitialize(argc, argv, &gWindow))
+    TRACE_THREAD_NAME("Main");
+
+    // Command-line options of the job benchmark, benchmark, stress and headless modes
+    if (!gJobBenchmark.Parse(argc, argv) || !gBenchmark.Parse(argc, argv) || !gStress.Parse(argc, argv) || !gHeadless.Parse(argc, argv))
+        return EXIT_FAILURE;
+
+    // The job system benchmark needs no window or context
+    if (gJobBenchmark.IsEnabled)
+        return RunJobBenchmark(gJobBenchmark);
+
+    // Start the workers; this thread gets the first slot of the job system
+    gJobSystem.Create();
+
+    if (gHeadless.IsEnabled)
+    {
+        if (!UInitializeHeadless())
+            return EXIT_FAILURE;
+    }
+    else if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
 
     // Create the mesh
@@ -330,64 +807,84 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
         return EXIT_FAILURE;
-
-    // Load texture (relative to project's directory) for the plane
-    const char* texFilename = "plane_texture_2.png";
-    if (!UCreateTexture(texFilename, gTextureIdPlane))
-    {
-        cout << "Failed to load plane texture " << texFilename << endl;
+    if (!UCreateShaderProgram(depthVertexShaderSource, depthFragmentShaderSource, gDepthProgramId))
+        return EXIT_FAILURE;
+    if (!UCreateShaderProgram(upscaleVertexShaderSource, upscaleFragmentShaderSource, gUpscaleProgramId))
+        return EXIT_FAILURE;
+    if (!UCreateShaderProgram(textVertexShaderSource, textFragmentShaderSource, gTextProgramId))
         return EXIT_FAILURE;
-    }
 
-    // Load texture (relative to project's directory) for the tip of the pen
-    texFilename = "tip_of_pen_texture.png";
-    if (!UCreateTexture(texFilename, gTextureIdTipOfPen))
+    // Load the textures (relative to project's directory): the files are decoded in parallel, then uploaded in order
+    struct TextureFile
     {
-        cout << "Failed to load texture for the tip of the pen " << texFilename << endl;
-        return EXIT_FAILURE;
-    }
+        const char* filename;
+        GLuint* textureId;
+        const char* errorMessage;
+        DecodedImage image;
+    };
+    TextureFile textureFiles[] = {
+        { "plane_texture_2.png", &gTextureIdPlane, "Failed to load plane texture " },
+        { "tip_of_pen_texture.png", &gTextureIdTipOfPen, "Failed to load texture for the tip of the pen " },
+        { "body_of_pen_texture.png", &gTextureIdBodyOfPen, "Failed to load texture for the body of the pen " },
+        { "chapstick_texture.png", &gTextureIdChapstick, "Failed to load texture for the chapstick " },
+        { "rubik_cube_texture.jpg", &gTextureIdRubikCube, "Failed to load texture for the rubik cube " },
+        { "baseball_texture_2.jpg", &gTextureIdBaseball, "Failed to load texture for the baseball " },
+        { "duct_tape_texture2.jpg", &gTextureIdDuctTape, "Failed to load texture for the duct tape " }
+    };
+    const int numTextureFiles = sizeof(textureFiles) / sizeof(textureFiles[0]);
 
-    // Load texture (relative to project's directory) for the body of the pen
-    texFilename = "body_of_pen_texture.png";
-    if (!UCreateTexture(texFilename, gTextureIdBodyOfPen))
+    gJobSystem.ParallelFor(numTextureFiles, 1, [&](int begin, int end)
     {
-        cout << "Failed to load texture for the body of the pen " << texFilename << endl;
-        return EXIT_FAILURE;
-    }
-    
-    // Load texture (relative to project's directory) for the chapstick
-    texFilename = "chapstick_texture.png";
-    if (!UCreateTexture(texFilename, gTextureIdChapstick))
+        for (int i = begin; i < end; ++i)
+            UDecodeImage(textureFiles[i].filename, textureFiles[i].image);
+    });
+
+    bool isTexturesLoaded = true;
+    for (TextureFile& file : textureFiles)
     {
-        cout << "Failed to load texture for the chapstick " << texFilename << endl;
-        return EXIT_FAILURE;
+        if (isTexturesLoaded && !UCreateTexture(file.image, *file.textureId))
+        {
+            cout << file.errorMessage << file.filename << endl;
+            isTexturesLoaded = false;
+        }
+        stbi_image_free(file.image.pixels);
     }
-    
-    // Load texture (relative to project's directory) for the rubik cube
-    texFilename = "rubik_cube_texture.jpg";
-    if (!UCreateTexture(texFilename, gTextureIdRubikCube))
-    {
-        cout << "Failed to load texture for the chapstick " << texFilename << endl;
+    if (!isTexturesLoaded)
         return EXIT_FAILURE;
-    }
 
-    // Load texture (relative to project's directory) for the baseball
-    texFilename = "baseball_texture_2.jpg";
-    if (!UCreateTexture(texFilename, gTextureIdBaseball))
+    // Place the textured objects in the scene
+    UCreateSceneObjects();
+
+    // Replace them with generated instances of the primitive meshes in the stress modes
+    if (gStress.NumInstances > 0 || gStress.IsSweep())
+        UCreatePrimitiveMeshes();
+    if (gStress.NumInstances > 0 && !gStress.IsSweep())
+        UCreateStressScene(gStress.NumInstances);
+
+    // Create the persistently mapped buffer for the per-frame uniform data
+    if (!UCreateUniformRing())
     {
-        cout << "Failed to load texture for the baseball " << texFilename << endl;
+        cout << "Failed to create the uniform ring buffer" << endl;
         return EXIT_FAILURE;
     }
 
-    // Load texture (relative to project's directory) for the duct tape
-    texFilename = "duct_tape_texture2.jpg";
-    if (!UCreateTexture(texFilename, gTextureIdDuctTape))
+    // Create the offscreen framebuffer used by dynamic resolution
+    if (!gDynamicResolution.Create(gWindowWidth, gWindowHeight, gUpscaleProgramId))
     {
-        cout << "Failed to load texture for the duct tape " << texFilename << endl;
+        cout << "Failed to create the dynamic resolution framebuffer" << endl;
         return EXIT_FAILURE;
     }
 
-    
+    // Queries used by the overdraw measurement mode
+    glGenQueries(2, gOverdrawQueries);
+
+    // Timestamp query pools of the GPU profiler and the glyph atlas of its overlay
+    gGpuProfiler.Create();
+    gRenderStats.Create();
+    gLatencyTracker.Create();
+    gTextOverlay.Create(gTextProgramId);
+    gTextOverlay.SetScreenSize(gWindowWidth, gWindowHeight);
+
     // tell OpenGL for each sampler to which texture unit it belongs to (only has to be done once)
     glUseProgram(gProgramId);
 
@@ -400,23 +897,77 @@ int main(int argc, char* argv[])
     // uncomment the following line to render the object as a 3D mesh
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    int exitCode = EXIT_SUCCESS;
+
+    // Stress sweeps, benchmark and headless runs render a fixed number of frames instead of the render loop
+    bool isScripted = gStress.IsSweep() || gBenchmark.IsEnabled || gHeadless.IsEnabled;
+    if (gStress.IsSweep())
+        exitCode = URunStressSweep();
+    else if (gBenchmark.IsEnabled)
+        exitCode = URunBenchmark();
+    else if (gHeadless.IsEnabled)
+        exitCode = URunHeadless();
+
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(gWindow))
+    gLastSimulationTick = chrono::steady_clock::now();
+    while (!isScripted && !glfwWindowShouldClose(gWindow))
     {
-        // per-frame timing
-        float currentFrame = glfwGetTime();
-        gDeltaTime = currentFrame - gLastFrame;
-        gLastFrame = currentFrame;
+        TRACE_SCOPE("Frame");
+
+        // F8 moves rendering to its own thread or back to this one
+        if (gIsRenderThreadRequested != gIsRenderThreaded)
+        {
+            if (gIsRenderThreadRequested)
+                UStartRenderThread();
+            else
+                UStopRenderThread();
+        }
+
+        // Threaded: this thread only handles input and simulation; the render thread draws the latest snapshot
+        if (gIsRenderThreaded)
+        {
+            URunSimulationTick();
+            continue;
+        }
+
+        // Render on demand: while nothing changed, sleep until an event arrives instead of drawing the same frame again
+        if (gIsRenderOnDemand && !gIsFrameDirty && !UIsSceneAnimating())
+        {
+            {
+                TRACE_SCOPE("glfwWaitEventsTimeout");
+                glfwWaitEventsTimeout(ON_DEMAND_WAIT_SECONDS);
+            }
+            gFramePacer.OnIdle();
+            continue;
+        }
+        gIsFrameDirty = false;
+
+        // per-frame timing: waits for the GPU and the frame cap, then updates the smoothed delta time
+        {
+            TRACE_SCOPE("Frame pacing");
+            gFramePacer.BeginFrame();
+        }
+        gDeltaTime = gFramePacer.SmoothedDeltaTime;
         // input
         // -----
         UProcessInput(gWindow);
+        USimulate(gDeltaTime);
 
         // Render this frame
-        URender();
+        SceneSnapshot snapshot;
+        UCaptureSnapshot(snapshot);
+        URender(snapshot);
+
+        {
+            TRACE_SCOPE("glfwPollEvents");
+            glfwPollEvents();
+        }
 
-        glfwPollEvents();
+        UReportFrameStatistics();
     }
+    if (gIsRenderThreaded)
+        UStopRenderThread();
 
     // Release mesh data
     UDestroyMesh(gPlaneMesh);
@@ -424,6 +975,8 @@ int main(int argc, char* argv[])
     UDestroyMesh(gCylinderMesh);
     UDestroyMesh(gCubeMesh);
     UDestroyMesh(gSphereMesh);
+    if (gIsPrimitiveMeshesCreated)
+        gMeshes.DestroyMeshes();
 
     // Release texture
     UDestroyTexture(gTextureIdPlane);
@@ -437,13 +990,59 @@ int main(int argc, char* argv[])
     // Release shader program
     UDestroyShaderProgram(gProgramId);
     UDestroyShaderProgram(gLampProgramId);
+    UDestroyShaderProgram(gDepthProgramId);
+    UDestroyShaderProgram(gUpscaleProgramId);
+    UDestroyShaderProgram(gTextProgramId);
+
+    // Release the overdraw queries
+    glDeleteQueries(2, gOverdrawQueries);
+
+    // Release the uniform ring buffer and the frame fences
+    gUniformRing.Destroy();
+    gFramePacer.Destroy();
+
+    // Release the offscreen framebuffer
+    gDynamicResolution.Destroy();
+
+    // Save the GPU timings if the profiler was used, then release its queries and the overlay
+    if (!gGpuProfiler.Stats.empty())
+    {
+        if (gGpuProfiler.WriteCsv(GPU_PROFILE_CSV_PATH) && gGpuProfiler.WriteJson(GPU_PROFILE_JSON_PATH))
+            cout << "GPU profile written to " << GPU_PROFILE_CSV_PATH << " and " << GPU_PROFILE_JSON_PATH << endl;
+        else
+            cout << "Failed to write the GPU profile" << endl;
+    }
+    gGpuProfiler.Destroy();
+    gTextOverlay.Destroy();
+
+    // Finish the render statistics log if it is still open
+    if (gRenderStatsLog)
+        fclose(gRenderStatsLog);
+    gRenderStats.Destroy();
+    gLatencyTracker.Destroy();
+
+    // Release the headless framebuffer and context
+    if (gHeadless.IsEnabled)
+    {
+        gOffscreenTarget.Destroy();
+        gHeadlessContext.Destroy();
+    }
 
-    exit(EXIT_SUCCESS); // Terminates the program successfully
+    // Stop the workers before the trace is written so their buffers are complete
+    gJobSystem.Destroy();
+
+    // Save the CPU trace of debug builds; open it in chrome://tracing or ui.perfetto.dev
+    if (CPU_TRACE_WRITE(CPU_TRACE_PATH))
+        cout << "CPU trace written to " << CPU_TRACE_PATH << endl;
+
+    exit(exitCode); // Terminates the program (unsuccessfully when a headless run failed)
 }
 
 // Initialize GLFW, GLEW, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
+    TRACE_FUNCTION();
+
     // GLFW: initialize and configure
     // ------------------------------
     glfwInit();
@@ -471,11 +1070,20 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     glfwMakeContextCurrent(*window);
     glfwSetFramebufferSizeCallback(*window, UResizeWindow);
 
+    // The framebuffer can be larger than the window on high-DPI displays
+    glfwGetFramebufferSize(*window, &gWindowWidth, &gWindowHeight);
+    gRequestedWidth = gWindowWidth;
+    gRequestedHeight = gWindowHeight;
+
     // Register Mouse callbacks
     glfwSetCursorPosCallback(*window, UMousePositionCallback);
     glfwSetScrollCallback(*window, UMouseScrollCallback);
     glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
 
+    // Keys are polled in UProcessInput; the callbacks only wake the render-on-demand loop
+    glfwSetKeyCallback(*window, UKeyCallback);
+    glfwSetWindowRefreshCallback(*window, UWindowRefreshCallback);
+
     // tell GLFW to capture our mouse
     glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -492,693 +1100,1059 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
         return false;
     }
 
+    // Start with vsync; F1 switches between vsync, no vsync and adaptive vsync
+    gFramePacer.SetSwapInterval(1);
+
     // Displays GPU OpenGL version
     cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
 
     return true;
 }
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-void UProcessInput(GLFWwindow* window)
-{
-    static const float cameraSpeed = 2.5f;
-
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) // specifically checks if the escape key is pressed
-        glfwSetWindowShouldClose(window, true); // if the escape key is pressed it sets the glfwWindowShouldClose to true
 
-    float cameraOffset = cameraSpeed * gDeltaTime;
+// Creates a context without a window and the offscreen framebuffer the headless mode renders into
+bool UInitializeHeadless()
+{
+    TRACE_FUNCTION();
 
-    bool keypress = false;
+    if (!gHeadlessContext.Create(4, 4))
+        return false;
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-    {
-        cout << "You pressed W! ";
-        keypress = true;
-        gCamera.ProcessKeyboard(FORWARD, gDeltaTime);  // moves the camera forward
-    }
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    gWindowWidth = gRequestedWidth = gHeadless.Width;
+    gWindowHeight = gRequestedHeight = gHeadless.Height;
+    if (!gOffscreenTarget.Create(gWindowWidth, gWindowHeight))
     {
-        cout << "You pressed S! ";
-        keypress = true;
-        gCamera.ProcessKeyboard(BACKWARD, gDeltaTime); // moves the camera backward
+        cout << "Failed to create the headless framebuffer" << endl;
+        return false;
     }
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+
+    // The scene (or its upscaled image) ends up in the offscreen framebuffer instead of the window
+    gDynamicResolution.OutputFramebuffer = gOffscreenTarget.Framebuffer;
+    glViewport(0, 0, gWindowWidth, gWindowHeight);
+
+    // Displays GPU OpenGL version
+    cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
+
+    return true;
+}
+
+// Renders the headless frames, writes the last one to a PNG and compares it with the golden image. Returns the exit code.
+int URunHeadless()
+{
+    TRACE_FUNCTION();
+
+    for (int frame = 0; frame < gHeadless.NumFrames; ++frame)
     {
-        cout << "You pressed A! ";
-        keypress = true;
-        gCamera.ProcessKeyboard(LEFT, gDeltaTime); // moves the camera left
+        gFramePacer.BeginFrame(); // keeps the GPU queue bounded
+        gDeltaTime = HEADLESS_DELTA_TIME;
+        USimulate(gDeltaTime);
+
+        SceneSnapshot snapshot;
+        UCaptureSnapshot(snapshot);
+        URender(snapshot);
     }
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+
+    vector<unsigned char> pixels = gOffscreenTarget.ReadPixels();
+    if (!WritePng(gHeadless.OutputPath.c_str(), gWindowWidth, gWindowHeight, pixels))
     {
-        cout << "You pressed D! ";
-        keypress = true;
-        gCamera.ProcessKeyboard(RIGHT, gDeltaTime); // moves the camera right
+        cout << "Failed to write " << gHeadless.OutputPath << endl;
+        return EXIT_FAILURE;
     }
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+    cout << "Wrote " << gHeadless.OutputPath << " (" << gWindowWidth << "x" << gWindowHeight << ", frame " << gHeadless.NumFrames << ")" << endl;
+
+    if (gHeadless.GoldenPath.empty())
+        return EXIT_SUCCESS;
+
+    // GOLDEN IMAGE: compare with the stored reference
+    //----------------
+    int goldenWidth = 0, goldenHeight = 0;
+    vector<unsigned char> golden;
+    if (!LoadRgba(gHeadless.GoldenPath.c_str(), goldenWidth, goldenHeight, golden))
     {
-        cout << "You pressed Q! ";
-        keypress = true;
-        gCamera.ProcessKeyboard(DOWN, gDeltaTime); // moves the camera right
+        cout << "Failed to load the golden image " << gHeadless.GoldenPath << endl;
+        return EXIT_FAILURE;
     }
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+    if (goldenWidth != gWindowWidth || goldenHeight != gWindowHeight)
     {
-        cout << "You pressed Q! ";
-        keypress = true;
-        gCamera.ProcessKeyboard(UP, gDeltaTime); // moves the camera right
+        cout << "Golden image is " << goldenWidth << "x" << goldenHeight << ", rendered " << gWindowWidth << "x" << gWindowHeight << endl;
+        return EXIT_FAILURE;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS)
-    {
-        gUVScale += 0.1f;
-        cout << "Current scale (" << gUVScale[0] << ", " << gUVScale[1] << ")" << endl;
-    }
-    else if (glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS)
+    ImageComparison comparison = CompareImages(pixels, golden, gWindowWidth, gWindowHeight, gHeadless.Threshold);
+    bool isMatching = comparison.DifferentFraction <= gHeadless.MaxDifferentFraction;
+    cout << "Golden image " << (isMatching ? "matches" : "DIFFERS") << ": " << comparison.NumDifferentPixels << " pixels ("
+         << 100.0f * comparison.DifferentFraction << "%) above threshold " << gHeadless.Threshold << ", max delta " << comparison.MaxDelta << endl;
+
+    if (!gHeadless.DiffPath.empty() && !WritePng(gHeadless.DiffPath.c_str(), gWindowWidth, gWindowHeight, comparison.DiffImage))
+        cout << "Failed to write " << gHeadless.DiffPath << endl;
+
+    return isMatching ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Flies the camera along the benchmark path at a fixed timestep and writes the frame time statistics. Returns the exit code.
+int URunBenchmark()
+{
+    TRACE_FUNCTION();
+
+    if (!gCameraPath.Load(gBenchmark.PathFile.c_str()))
+        return EXIT_FAILURE;
+
+    // With vsync the benchmark would measure the display instead of the renderer
+    if (!gHeadless.IsEnabled)
+        gFramePacer.SetSwapInterval(0);
+
+    cout << "Benchmark: " << gBenchmark.NumWarmupFrames << " warm-up and " << gBenchmark.NumMeasuredFrames << " measured frames along "
+         << gBenchmark.PathFile << " (" << gCameraPath.Keyframes.size() << " keyframes, " << gCameraPath.Duration() << " s)" << endl;
+
+    MeasuredFrames measured;
+    if (!UMeasureFrames(gBenchmark.NumWarmupFrames, gBenchmark.NumMeasuredFrames, gBenchmark.Timestep, measured))
     {
-        gUVScale -= 0.1f;
-        cout << "Current scale (" << gUVScale[0] << ", " << gUVScale[1] << ")" << endl;
+        cout << "Benchmark cancelled" << endl;
+        return EXIT_FAILURE;
     }
 
-    // Pause and resume lamp orbiting
-    static bool isLKeyDown = false;
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && !gIsLampOrbiting)
-        gIsLampOrbiting = true;
-    else if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && gIsLampOrbiting)
-        gIsLampOrbiting = false;
-    if (keypress)
+    FrameTimeSummary cpu = FrameTimeSummary::FromSamples(measured.cpuTimes);
+    FrameTimeSummary gpu = FrameTimeSummary::FromSamples(measured.gpuTimes);
+    FrameTimeSummary wall = FrameTimeSummary::FromSamples(measured.frameTimes);
+
+    cout << "CPU ms: mean " << cpu.Mean << ", p50 " << cpu.P50 << ", p99 " << cpu.P99 << endl;
+    cout << "GPU ms: mean " << gpu.Mean << ", p50 " << gpu.P50 << ", p99 " << gpu.P99 << " (" << gpu.Count << " frames)" << endl;
+    cout << "Frame ms: mean " << wall.Mean << ", p50 " << wall.P50 << ", p99 " << wall.P99 << endl;
+
+    // REPORT: one JSON object a script can diff against a baseline
+    //----------------
+    FILE* file = fopen(gBenchmark.ReportPath.c_str(), "w");
+    if (!file)
     {
-        double x, y;
-        glfwGetCursorPos(window, &x, &y);
-        cout << "Cursor at position (" << x << ", " << y << ")" << endl;
+        cout << "Failed to write " << gBenchmark.ReportPath << endl;
+        return EXIT_FAILURE;
     }
+
+    // Keep the strings valid JSON without escaping
+    string renderer = (const char*)glGetString(GL_RENDERER);
+    replace(renderer.begin(), renderer.end(), '"', '\'');
+    string pathFile = gBenchmark.PathFile;
+    replace(pathFile.begin(), pathFile.end(), '\\', '/');
+    fprintf(file, "{\n  \"path\": \"%s\",\n  \"renderer\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"headless\": %s,\n",
+        pathFile.c_str(), renderer.c_str(), gWindowWidth, gWindowHeight, gHeadless.IsEnabled ? "true" : "false");
+    fprintf(file, "  \"warmupFrames\": %d,\n  \"measuredFrames\": %d,\n  \"timestep\": %.6f,\n", gBenchmark.NumWarmupFrames, gBenchmark.NumMeasuredFrames, gBenchmark.Timestep);
+    fprintf(file, "  \"cpuFrameMs\": ");
+    cpu.WriteJson(file);
+    fprintf(file, ",\n  \"gpuFrameMs\": ");
+    gpu.WriteJson(file);
+    fprintf(file, ",\n  \"frameMs\": ");
+    wall.WriteJson(file);
+    fprintf(file, "\n}\n");
+    fclose(file);
+
+    cout << "Benchmark results written to " << gBenchmark.ReportPath << endl;
+    return EXIT_SUCCESS;
 }
 
-// glfw: Whenever the mouse moves, this callback is called.
-void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
+// Renders the warm-up frames and then the measured frames at a fixed timestep, following the camera path when one is loaded.
+// Returns false when the window was closed before the end.
+bool UMeasureFrames(int numWarmupFrames, int numMeasuredFrames, float timestep, MeasuredFrames& measured)
 {
-    cout << "Mouse at (" << xpos << ", " << ypos << ")" << endl;
-    if (gFirstMouse)
+    TRACE_FUNCTION();
+
+    unsigned int firstMeasuredFrame = 0;
+    bool isCancelled = false;
+
+    gRenderStats.GpuTimes.clear();
+    gRenderStats.IsRecordingGpuTimes = true;
+
+    const int totalFrames = numWarmupFrames + numMeasuredFrames;
+    for (int frame = 0; frame < totalFrames && !isCancelled; ++frame)
     {
-        gLastX = xpos;
-        gLastY = ypos;
-        gFirstMouse = false;
+        chrono::steady_clock::time_point frameStart = chrono::steady_clock::now();
+        if (frame == numWarmupFrames)
+            firstMeasuredFrame = gRenderStats.FrameNumber + 1;
+
+        gFramePacer.BeginFrame();
+
+        // Simulated time comes from the frame index, never from the clock
+        gDeltaTime = timestep;
+        if (!gCameraPath.Keyframes.empty())
+        {
+            CameraPath::Keyframe pose = gCameraPath.Evaluate(frame * timestep);
+            gCamera.SetPose(pose.Position, pose.Yaw, pose.Pitch);
+        }
+        USimulate(gDeltaTime);
+
+        SceneSnapshot snapshot;
+        UCaptureSnapshot(snapshot);
+        URender(snapshot);
+
+        if (!gHeadless.IsEnabled)
+        {
+            glfwPollEvents();
+            isCancelled = glfwWindowShouldClose(gWindow) != 0;
+        }
+
+        if (frame >= numWarmupFrames)
+        {
+            measured.cpuTimes.push_back(gRenderStats.LastFrame.CpuFrameMs);
+            measured.frameTimes.push_back(chrono::duration<float, milli>(chrono::steady_clock::now() - frameStart).count());
+        }
     }
 
-    float xoffset = xpos - gLastX;
-    float yoffset = gLastY - ypos;
+    // GPU times arrive a few frames late; wait for the last ones
+    gRenderStats.FinishGpuFrames();
+    gRenderStats.IsRecordingGpuTimes = false;
 
-    gLastX = xpos;
-    gLastY = ypos;
+    for (const GpuFrameTime& gpuTime : gRenderStats.GpuTimes)
+        if (gpuTime.FrameNumber >= firstMeasuredFrame)
+            measured.gpuTimes.push_back(gpuTime.Ms);
+    gRenderStats.GpuTimes.clear();
 
-    gCamera.ProcessMouseMovement(xoffset, yoffset);
+    return !isCancelled;
 }
 
-// glfw: Whenever the mouse scroll wheel scrolls, this callback is called.
-void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
+// Renders a stress scene of every instance count of the sweep and writes the frame times and memory use of each. Returns the exit code.
+int URunStressSweep()
 {
-    gCamera.ProcessMouseScroll(yoffset);
-    cout << "Mouse wheel (" << xoffset << ", " << yoffset << ")" << endl;
-}
+    TRACE_FUNCTION();
 
-// glfw: Handle mouse button events.
-void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
-{
-    switch (button)
-    {
-    case GLFW_MOUSE_BUTTON_LEFT:
+    // The sweep follows the benchmark path when one is given and keeps the camera still otherwise
+    if (gBenchmark.IsEnabled && !gCameraPath.Load(gBenchmark.PathFile.c_str()))
+        return EXIT_FAILURE;
+    if (!gHeadless.IsEnabled)
+        gFramePacer.SetSwapInterval(0);
+
+    FILE* file = fopen(gStress.SweepReportPath.c_str(), "w");
+    if (!file)
     {
-        if (action == GLFW_PRESS)
-            cout << "Left mouse button pressed" << endl;
-        else
-            cout << "Left mouse button released" << endl;
+        cout << "Failed to write " << gStress.SweepReportPath << endl;
+        return EXIT_FAILURE;
     }
-    break;
+    fprintf(file, "instances,cpu_mean_ms,cpu_p95_ms,gpu_mean_ms,gpu_p95_ms,frame_mean_ms,frame_p95_ms,draw_calls,triangles,process_mb,gpu_mb,uniform_ring_mb\n");
 
-    case GLFW_MOUSE_BUTTON_MIDDLE:
+    struct SweepPoint
     {
-        if (action == GLFW_PRESS)
-            cout << "Middle mouse button pressed" << endl;
-        else
-            cout << "Middle mouse button released" << endl;
-    }
-    break;
+        int count;
+        float frameMs;
+        double processMb;
+    };
+    vector<SweepPoint> points;
 
-    case GLFW_MOUSE_BUTTON_RIGHT:
+    const int numWarmupFrames = max(2, gStress.NumSweepFrames / 6);
+    for (int count : gStress.SweepCounts)
     {
-        if (action == GLFW_PRESS)
-            cout << "Right mouse button pressed" << endl;
-        else
-            cout << "Right mouse button released" << endl;
+        // No frame in flight may still read the uniform ring that is about to be replaced
+        glFinish();
+        UCreateStressScene(count);
+        if (!UCreateUniformRing())
+        {
+            cout << "Failed to create the uniform ring buffer for " << count << " instances" << endl;
+            fclose(file);
+            return EXIT_FAILURE;
+        }
+
+        MeasuredFrames measured;
+        if (!UMeasureFrames(numWarmupFrames, gStress.NumSweepFrames, gBenchmark.Timestep, measured))
+        {
+            cout << "Stress sweep cancelled" << endl;
+            fclose(file);
+            return EXIT_FAILURE;
+        }
+
+        FrameTimeSummary cpu = FrameTimeSummary::FromSamples(measured.cpuTimes);
+        FrameTimeSummary gpu = FrameTimeSummary::FromSamples(measured.gpuTimes);
+        FrameTimeSummary wall = FrameTimeSummary::FromSamples(measured.frameTimes);
+
+        const double MB = 1024.0 * 1024.0;
+        double processMb = ProcessMemoryBytes() / MB;
+        long long gpuBytes = GpuMemoryUsedBytes();
+        double gpuMb = gpuBytes >= 0 ? gpuBytes / MB : -1.0;
+        double ringMb = (double)gUniformRing.FrameSize * RING_BUFFER_FRAMES / MB;
+
+        fprintf(file, "%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%u,%u,%.1f,%.1f,%.1f\n", count, cpu.Mean, cpu.P95, gpu.Mean, gpu.P95, wall.Mean, wall.P95,
+            gRenderStats.LastFrame.DrawCalls, gRenderStats.LastFrame.Triangles, processMb, gpuMb, ringMb);
+        fflush(file);
+
+        cout << count << " instances: frame " << wall.Mean << " ms (CPU " << cpu.Mean << ", GPU " << gpu.Mean << "), " << processMb << " MB process, "
+             << ringMb << " MB uniform ring" << endl;
+        points.push_back({ count, wall.Mean, processMb });
     }
-    break;
+    fclose(file);
 
-    default:
-        cout << "Unhandled mouse button event" << endl;
-        break;
+    // CHART: mean frame time and process memory against the instance count
+    //----------------
+    const int BAR_WIDTH = 50;
+    float maxFrameMs = 0.0f;
+    double maxProcessMb = 0.0;
+    for (const SweepPoint& point : points)
+    {
+        maxFrameMs = max(maxFrameMs, point.frameMs);
+        maxProcessMb = max(maxProcessMb, point.processMb);
     }
-}
 
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
-void UResizeWindow(GLFWwindow* window, int width, int height)
-{
-    glViewport(0, 0, width, height); // resizes the viewport
+    printf("\n%9s  %-*s %10s\n", "instances", BAR_WIDTH, "frame time", "ms");
+    for (const SweepPoint& point : points)
+        printf("%9d |%-*s %10.2f\n", point.count, BAR_WIDTH, string(maxFrameMs > 0.0f ? (size_t)(BAR_WIDTH * point.frameMs / maxFrameMs) : 0, '#').c_str(), point.frameMs);
+
+    printf("\n%9s  %-*s %10s\n", "instances", BAR_WIDTH, "process memory", "MB");
+    for (const SweepPoint& point : points)
+        printf("%9d |%-*s %10.1f\n", point.count, BAR_WIDTH, string(maxProcessMb > 0.0 ? (size_t)(BAR_WIDTH * point.processMb / maxProcessMb) : 0, '#').c_str(), point.processMb);
+
+    cout << endl << "Stress sweep results written to " << gStress.SweepReportPath << endl;
+    return EXIT_SUCCESS;
 }
 
-// Function called to render a frame
-void URender()
+// Advances the animations by deltaTime seconds
+void USimulate(float deltaTime)
 {
     // Lamp orbits around the origin
     const float angularVelocity = glm::radians(45.0f);
     if (gIsLampOrbiting)
     {
         // key light orbits on the y-axis
-        glm::vec4 newPosition1 = glm::rotate(angularVelocity * gDeltaTime, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(gKeyLightPosition, 1.0f);
+        glm::vec4 newPosition1 = glm::rotate(angularVelocity * deltaTime, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(gKeyLightPosition, 1.0f);
         gKeyLightPosition.x = newPosition1.x;
         gKeyLightPosition.y = newPosition1.y;
         gKeyLightPosition.z = newPosition1.z;
 
         // second light will orbit on the x-axis
         // uncomment the following four lines if you want both lights to orbit
-        //glm::vec4 newPosition2 = glm::rotate(angularVelocity * gDeltaTime, glm::vec3(1.0f, 0.0f, 0.0f)) * glm::vec4(gFillLightPosition, 1.0f);
+        //glm::vec4 newPosition2 = glm::rotate(angularVelocity * deltaTime, glm::vec3(1.0f, 0.0f, 0.0f)) * glm::vec4(gFillLightPosition, 1.0f);
         //gFillLightPosition.x = newPosition2.x;
         //gFillLightPosition.y = newPosition2.y;
         //gFillLightPosition.z = newPosition2.z;
     }
+}
 
-    // Enable z-depth
-    glEnable(GL_DEPTH_TEST);
+// Records the time of an input event and marks the frame dirty
+void UNoteInput()
+{
+    gIsFrameDirty = true;
 
-    // clear the frame and z buffers
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Only the first input since the last presented one is timed
+    if (gPendingInputTime == chrono::steady_clock::time_point())
+    {
+        gPendingInputTime = chrono::steady_clock::now();
+        gPendingInputSerial = gSnapshotSerial + 1;
+    }
+}
 
-    // Activate the VAO (used by the plane and the lamps)
-    glBindVertexArray(gPlaneMesh.vao);
+// Copies the simulation state the renderer needs into snapshot
+void UCaptureSnapshot(SceneSnapshot& snapshot)
+{
+    // The pending input is carried by every snapshot until one containing it has been presented
+    if (gPendingInputTime != chrono::steady_clock::time_point() && gPresentedSerial.load() >= gPendingInputSerial)
+        gPendingInputTime = chrono::steady_clock::time_point();
+
+    snapshot.serial = ++gSnapshotSerial;
+    snapshot.view = gCamera.GetViewMatrix();
+    snapshot.cameraPosition = gCamera.Position;
+    snapshot.cameraZoom = gCamera.Zoom;
+    snapshot.keyLightPosition = gKeyLightPosition;
+    snapshot.fillLightPosition = gFillLightPosition;
+    snapshot.uvScale = gUVScale;
+    snapshot.framebufferWidth = gRequestedWidth;
+    snapshot.framebufferHeight = gRequestedHeight;
+    for (int i = 0; i < NUM_RENDER_KEYS; ++i)
+        snapshot.renderKeyPresses[i] = gRenderKeyPresses[i];
+    snapshot.isRenderOnDemand = gIsRenderOnDemand;
+    snapshot.inputTime = gPendingInputTime;
+}
 
-    // PLANE: draw the plane
-    //----------------
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+// Threaded mode: waits for input for at most one simulation step, updates the simulation and publishes a snapshot when it changed
+void URunSimulationTick()
+{
+    TRACE_FUNCTION();
 
-    // 1. Scales the object
-    glm::mat4 scale = glm::scale(glm::vec3(6.0f, 4.0f, 1.0f));
+    bool isIdle = gIsRenderOnDemand && !gIsFrameDirty && !UIsSceneAnimating();
+    {
+        TRACE_SCOPE("glfwWaitEventsTimeout");
+        glfwWaitEventsTimeout(isIdle ? ON_DEMAND_WAIT_SECONDS : SIMULATION_STEP_SECONDS);
+    }
 
-    // 2. Rotates shape by 0 degrees on the y axis
-    glm::mat4 rotation = glm::rotate(0.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+    // The time spent idle is not simulated, so a key pressed after a pause does not jump the camera
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    gDeltaTime = isIdle ? 0.0f : min((float)chrono::duration<double>(now - gLastSimulationTick).count(), MAX_DELTA_TIME);
+    gLastSimulationTick = now;
 
-    // 3. Place object at origin
-    glm::mat4 translation = glm::translate(glm::vec3(0.0f, 0.0f, -0.1f));
+    bool isChanged = gIsFrameDirty;
+    gIsFrameDirty = false;
+    UProcessInput(gWindow);     // held keys set gIsFrameDirty again, which keeps the ticks coming
+    USimulate(gDeltaTime);
 
-    // Model matrix: Transformations are applied right-to-left order
-    glm::mat4 model = translation * rotation * scale;
+    if (!isChanged && !gIsFrameDirty && gIsRenderOnDemand && !UIsSceneAnimating())
+        return;
 
-    // camera/view transformation
-    glm::mat4 view = gCamera.GetViewMatrix();
-
-    // Creates a perspective projection
-    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
-
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the pyramid Shader program for the pyramid color, light color, light position, and camera position
-    GLint objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    GLint keyLightColorLoc = glGetUniformLocation(gProgramId, "keyLightColor");
-    GLint keyLightPositionLoc = glGetUniformLocation(gProgramId, "keyLightPos");
-    GLint keyViewPositionLoc = glGetUniformLocation(gProgramId, "keyViewPosition");
-    GLint fillLightColorLoc = glGetUniformLocation(gProgramId, "fillLightColor");
-    GLint fillLightPositionLoc = glGetUniformLocation(gProgramId, "fillLightPos");
-    GLint fillViewPositionLoc = glGetUniformLocation(gProgramId, "fillViewPosition");
-
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(fillLightColorLoc, gFillLightColor.r, gFillLightColor.g, gFillLightColor.b);
-    glUniform3f(fillLightPositionLoc, gFillLightPosition.x, gFillLightPosition.y, gFillLightPosition.z);
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(keyViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-    glUniform3f(fillViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    GLint UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureIdPlane);
-
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
-
-    // --------------------------------------------  PYRAMID: draw the tip of the pen  ------------------------------------
-
-    // PYRAMID: draw the pyramid
-    //----------------
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+    UCaptureSnapshot(gSnapshots.Back());
+    gSnapshots.Publish();
+
+    // Taking the mutex orders the publish before the render thread's check, so the wake-up can not be lost
+    {
+        lock_guard<mutex> lock(gSnapshotMutex);
+    }
+    gSnapshotPublished.notify_one();
+}
 
-    // Activate the VAO (used by the pyramid and the lamps)
-    glBindVertexArray(gPyramidMesh.vao);
+// Hands the GL context to a new render thread. The main thread keeps handling input and simulation.
+void UStartRenderThread()
+{
+    gLatencyTracker.Reset();
+
+    // The render thread starts from a complete snapshot
+    UCaptureSnapshot(gSnapshots.Back());
+    gSnapshots.Publish();
+
+    glfwMakeContextCurrent(NULL);
+    gIsRenderThreaded = true;
+    gIsRenderThreadRunning.store(true);
+    gRenderThread = thread(URenderThread);
+    gLastSimulationTick = chrono::steady_clock::now();
+    cout << "Rendering on a separate thread" << endl;
+}
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.1f, 0.1f, 0.5f));
+// Stops the render thread and takes the GL context back
+void UStopRenderThread()
+{
+    gIsRenderThreadRunning.store(false);
+    {
+        lock_guard<mutex> lock(gSnapshotMutex);
+    }
+    gSnapshotPublished.notify_one();
+    gRenderThread.join();
+
+    glfwMakeContextCurrent(gWindow);
+    gIsRenderThreaded = false;
+    gIsRenderThreadRequested = false;
+    gLatencyTracker.Reset();
+    gFramePacer.OnIdle();
+    cout << "Rendering on the main thread" << endl;
+}
 
-    // 2. Rotates shape by 55 degrees on the x axis
-    rotation = glm::rotate(55.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+// Render thread: draws the latest published snapshot, or sleeps until one arrives when rendering on demand
+void URenderThread()
+{
+    TRACE_THREAD_NAME("Render");
+    glfwMakeContextCurrent(gWindow);
 
-    // Rotate the shape on its y-axis 120 degrees
-    rotation = glm::rotate(rotation, glm::radians(120.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    // Without a slot the parallel loops of URender run on this thread alone
+    if (!gJobSystem.RegisterThread())
+        cout << "No job system slot for the render thread; its loops run serially" << endl;
 
-    // 3. Place object at origin
-    translation = glm::translate(glm::vec3(2.0f, -1.0f, 0.0f));
+    while (gIsRenderThreadRunning.load())
+    {
+        TRACE_SCOPE("Frame");
 
-    // Model matrix: Transformations are applied right-to-left order
-    model = translation * rotation * scale;
+        if (!gSnapshots.Update() && gSnapshots.Front().isRenderOnDemand && !gIsRendererAnimating.load())
+        {
+            {
+                TRACE_SCOPE("Wait for snapshot");
+                unique_lock<mutex> lock(gSnapshotMutex);
+                gSnapshotPublished.wait_for(lock, chrono::duration<double>(ON_DEMAND_WAIT_SECONDS),
+                    [] { return gSnapshots.HasNewer() || !gIsRenderThreadRunning.load(); });
+            }
+            gFramePacer.OnIdle();
+            continue;
+        }
 
-    // camera/view transformation
-    view = gCamera.GetViewMatrix();
+        {
+            TRACE_SCOPE("Frame pacing");
+            gFramePacer.BeginFrame();
+        }
+        URender(gSnapshots.Front());
+        UReportFrameStatistics();
+    }
 
-    if (!perspective)
+    gJobSystem.UnregisterThread();
+    glfwMakeContextCurrent(NULL);
+}
+
+// Prints the frame pacing every few seconds and the input-to-photon latency every few inputs (on the thread that renders)
+void UReportFrameStatistics()
+{
+    // Report the present-to-present jitter every few seconds
+    if (gFramePacer.NumFrames >= 300)
     {
-        // create a perspective projection matrix
-        // First parameter is the field of view
-        // Second parameter is the aspect ratio
-        // Third parameter is the distance of the near plane to the camera
-        // Fourth parameter is the distance of the far plane to the camera
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        cout << "Frame pacing: " << 1000.0 * gFramePacer.SumPresentInterval / gFramePacer.NumFrames << " ms between presents, jitter "
+             << 1000.0 * gFramePacer.SumJitter / gFramePacer.NumFrames << " ms average / " << 1000.0 * gFramePacer.MaxJitter << " ms max, "
+             << gFramePacer.NumFenceWaits << " frames waited for the GPU" << endl;
+        gFramePacer.ResetStatistics();
     }
-    else
+
+    gLatencyTracker.Collect();
+    if (gLatencyTracker.Samples.size() >= LATENCY_REPORT_SAMPLES)
     {
-        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f); // creates the ortho projection if the perspective is set to true
+        FrameTimeSummary latency = FrameTimeSummary::FromSamples(gLatencyTracker.Samples);
+        cout << "Input-to-photon latency (" << (gIsRenderThreaded ? "render thread" : "single thread") << "): mean " << latency.Mean
+             << " ms, p50 " << latency.P50 << " ms, p95 " << latency.P95 << " ms, max " << latency.Max << " ms over " << latency.Count
+             << " inputs (" << gLatencyTracker.NumDropped << " not timed)" << endl;
+        gLatencyTracker.Reset();
     }
+}
 
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    viewLoc = glGetUniformLocation(gProgramId, "view");
-    projLoc = glGetUniformLocation(gProgramId, "projection");
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+void UProcessInput(GLFWwindow* window)
+{
+    TRACE_FUNCTION();
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    static const float cameraSpeed = 2.5f;
 
-    // Reference matrix uniforms from the pyramid Shader program for the pyramid color, light color, light position, and camera position
-    objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    keyLightColorLoc = glGetUniformLocation(gProgramId, "keyLightColor");
-    keyLightPositionLoc = glGetUniformLocation(gProgramId, "keyLightPos");
-    keyViewPositionLoc = glGetUniformLocation(gProgramId, "keyViewPosition");
-    fillLightColorLoc = glGetUniformLocation(gProgramId, "fillLightColor");
-    fillLightPositionLoc = glGetUniformLocation(gProgramId, "fillLightPos");
-    fillViewPositionLoc = glGetUniformLocation(gProgramId, "fillViewPosition");
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) // specifically checks if the escape key is pressed
+        glfwSetWindowShouldClose(window, true); // if the escape key is pressed it sets the glfwWindowShouldClose to true
 
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(fillLightColorLoc, gFillLightColor.r, gFillLightColor.g, gFillLightColor.b);
-    glUniform3f(fillLightPositionLoc, gFillLightPosition.x, gFillLightPosition.y, gFillLightPosition.z);
-    //const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(keyViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-    glUniform3f(fillViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    float cameraOffset = cameraSpeed * gDeltaTime;
 
-    UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
+    bool keypress = false;
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureIdTipOfPen);
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    {
+        cout << "You pressed W! ";
+        keypress = true;
+        gCamera.ProcessKeyboard(FORWARD, gDeltaTime);  // moves the camera forward
+    }
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    {
+        cout << "You pressed S! ";
+        keypress = true;
+        gCamera.ProcessKeyboard(BACKWARD, gDeltaTime); // moves the camera backward
+    }
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    {
+        cout << "You pressed A! ";
+        keypress = true;
+        gCamera.ProcessKeyboard(LEFT, gDeltaTime); // moves the camera left
+    }
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    {
+        cout << "You pressed D! ";
+        keypress = true;
+        gCamera.ProcessKeyboard(RIGHT, gDeltaTime); // moves the camera right
+    }
+    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+    {
+        cout << "You pressed Q! ";
+        keypress = true;
+        gCamera.ProcessKeyboard(DOWN, gDeltaTime); // moves the camera right
+    }
+    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+    {
+        cout << "You pressed Q! ";
+        keypress = true;
+        gCamera.ProcessKeyboard(UP, gDeltaTime); // moves the camera right
+    }
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gPyramidMesh.nVertices);
+    // Held movement keys keep redrawing until they are released
+    if (keypress)
+        gIsFrameDirty = true;
 
-    // --------------------------------------------  CYLINDER: draw the body of the pen  ------------------------------------
+    if (glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS)
+    {
+        gIsFrameDirty = true;
+        gUVScale += 0.1f;
+        cout << "Current scale (" << gUVScale[0] << ", " << gUVScale[1] << ")" << endl;
+    }
+    else if (glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS)
+    {
+        gIsFrameDirty = true;
+        gUVScale -= 0.1f;
+        cout << "Current scale (" << gUVScale[0] << ", " << gUVScale[1] << ")" << endl;
+    }
 
-    // CYLINDER: draw the cylinder
-    //----------------
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+    // Pause and resume lamp orbiting
+    static bool isLKeyDown = false;
+    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && !gIsLampOrbiting)
+        gIsLampOrbiting = true;
+    else if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && gIsLampOrbiting)
+        gIsLampOrbiting = false;
 
-    // Activate the VAO (used by the cylinder and the lamps)
-    glBindVertexArray(gCylinderMesh.vao);
+    // Renderer settings are applied by URender from the snapshot, possibly on the render thread
+    for (int i = 0; i < NUM_RENDER_KEYS; ++i)
+        if (UWasKeyPressed(window, RENDER_KEYS[i]))
+            gRenderKeyPresses[i]++;
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.1f, 0.1f, 1.75f));
+    // Switch between rendering on demand and rendering every frame
+    if (UWasKeyPressed(window, GLFW_KEY_F7))
+    {
+        gIsRenderOnDemand = !gIsRenderOnDemand;
+        cout << "Rendering " << (gIsRenderOnDemand ? "on demand" : "continuously") << endl;
+    }
 
-    // 2. Rotates shape by 55 degrees on the x axis
-    rotation = glm::rotate(55.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+    // Move rendering to its own thread and back
+    if (UWasKeyPressed(window, GLFW_KEY_F8))
+        gIsRenderThreadRequested = !gIsRenderThreadRequested;
 
-    // Rotate the shape on its y-axis 120 degrees
-    rotation = glm::rotate(rotation, glm::radians(120.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    if (keypress)
+    {
+        double x, y;
+        glfwGetCursorPos(window, &x, &y);
+        cout << "Cursor at position (" << x << ", " << y << ")" << endl;
+    }
+}
 
-    // 3. Place object at origin
-    translation = glm::translate(glm::vec3(2.0f, -1.0f, 0.0f));
+// Returns true while the picture changes every frame without any input, which keeps the render-on-demand loop drawing
+bool UIsSceneAnimating()
+{
+    // The profiler overlay and the statistics log need a stream of frames to measure (published by URender)
+    return gIsLampOrbiting || gIsRendererAnimating.load();
+}
 
-    // Model matrix: transformations are applied right-to-left order
-    //glm::mat4 model = glm::translate(gPyramidPosition) * glm::scale(gPyramidScale);
+// Applies a renderer setting key counted by UProcessInput
+void UApplyRenderKey(int key)
+{
+    switch (key)
+    {
+    // Turn the depth pre-pass on and off
+    case GLFW_KEY_P:
+    {
+        gIsDepthPrepassEnabled = !gIsDepthPrepassEnabled;
+        cout << "Depth pre-pass " << (gIsDepthPrepassEnabled ? "enabled" : "disabled") << endl;
+    }
+    break;
 
-    // Model matrix: Transformations are applied right-to-left order
-    model = translation * rotation * scale;
+    // Turn dynamic resolution on and off
+    case GLFW_KEY_R:
+    {
+        gDynamicResolution.IsEnabled = !gDynamicResolution.IsEnabled;
+        cout << "Dynamic resolution " << (gDynamicResolution.IsEnabled ? "enabled" : "disabled") << endl;
+    }
+    break;
 
-    // camera/view transformation
-    view = gCamera.GetViewMatrix();
+    // Show and hide the GPU profiler (timing only runs while it is shown)
+    case GLFW_KEY_G:
+    {
+        gGpuProfiler.IsEnabled = !gGpuProfiler.IsEnabled;
+        cout << "GPU profiler " << (gGpuProfiler.IsEnabled ? "enabled" : "disabled") << endl;
+    }
+    break;
 
-    if (!perspective)
+    // Show and hide the render statistics
+    case GLFW_KEY_F5:
     {
-        // create a perspective projection matrix
-        // First parameter is the field of view
-        // Second parameter is the aspect ratio
-        // Third parameter is the distance of the near plane to the camera
-        // Fourth parameter is the distance of the far plane to the camera
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        gIsStatsOverlayVisible = !gIsStatsOverlayVisible;
     }
-    else
+    break;
+
+    // Start and stop logging the render statistics of every frame
+    case GLFW_KEY_F6:
     {
-        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f); // creates the ortho projection if the perspective is set to true
+        if (gRenderStatsLog)
+        {
+            fclose(gRenderStatsLog);
+            gRenderStatsLog = nullptr;
+            cout << "Render statistics saved to " << RENDER_STATS_CSV_PATH << endl;
+        }
+        else if ((gRenderStatsLog = fopen(RENDER_STATS_CSV_PATH, "w")) != nullptr)
+        {
+            RenderStats::WriteCsvHeader(gRenderStatsLog);
+            cout << "Logging render statistics to " << RENDER_STATS_CSV_PATH << endl;
+        }
     }
+    break;
 
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    viewLoc = glGetUniformLocation(gProgramId, "view");
-    projLoc = glGetUniformLocation(gProgramId, "projection");
+    // Switch between the bilinear and the edge-aware upscaling filter
+    case GLFW_KEY_F4:
+    {
+        gDynamicResolution.Filter = gDynamicResolution.Filter == UPSCALE_BILINEAR ? UPSCALE_EDGE_AWARE : UPSCALE_BILINEAR;
+        cout << "Upscaling filter " << (gDynamicResolution.Filter == UPSCALE_BILINEAR ? "bilinear" : "edge-aware") << endl;
+    }
+    break;
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // Cycle the swap interval: vsync -> off -> adaptive
+    case GLFW_KEY_F1:
+    {
+        int interval = gFramePacer.SwapInterval == 1 ? 0 : (gFramePacer.SwapInterval == 0 ? -1 : 1);
+        gFramePacer.SetSwapInterval(interval);
+        cout << "Swap interval " << gFramePacer.SwapInterval << endl;
+    }
+    break;
 
-    // Reference matrix uniforms from the pyramid Shader program for the pyramid color, light color, light position, and camera position
-    objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    keyLightColorLoc = glGetUniformLocation(gProgramId, "keyLightColor");
-    keyLightPositionLoc = glGetUniformLocation(gProgramId, "keyLightPos");
-    keyViewPositionLoc = glGetUniformLocation(gProgramId, "keyViewPosition");
-    fillLightColorLoc = glGetUniformLocation(gProgramId, "fillLightColor");
-    fillLightPositionLoc = glGetUniformLocation(gProgramId, "fillLightPos");
-    fillViewPositionLoc = glGetUniformLocation(gProgramId, "fillViewPosition");
+    // Cycle the frame cap
+    case GLFW_KEY_F2:
+    {
+        static int frameCapIndex = 0;
+        frameCapIndex = (frameCapIndex + 1) % (sizeof(FRAME_CAPS) / sizeof(FRAME_CAPS[0]));
+        gFramePacer.TargetFrameRate = FRAME_CAPS[frameCapIndex];
+        cout << "Frame cap " << gFramePacer.TargetFrameRate << " fps" << endl;
+    }
+    break;
 
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(fillLightColorLoc, gFillLightColor.r, gFillLightColor.g, gFillLightColor.b);
-    glUniform3f(fillLightPositionLoc, gFillLightPosition.x, gFillLightPosition.y, gFillLightPosition.z);
-    //const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(keyViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-    glUniform3f(fillViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    // Cycle the number of frames the GPU may queue
+    case GLFW_KEY_F3:
+    {
+        gFramePacer.MaxFramesInFlight = gFramePacer.MaxFramesInFlight % MAX_FRAMES_IN_FLIGHT + 1;
+        cout << "Frames in flight " << gFramePacer.MaxFramesInFlight << endl;
+    }
+    break;
 
-    UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
+    // Turn occlusion culling on and off
+    case GLFW_KEY_C:
+    {
+        gIsOcclusionCullingEnabled = !gIsOcclusionCullingEnabled;
+        gLastRejectedCount = -1;
+        cout << "Occlusion culling " << (gIsOcclusionCullingEnabled ? "enabled" : "disabled") << endl;
+    }
+    break;
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureIdBodyOfPen);
+    // Show or hide the culled objects as wireframes
+    case GLFW_KEY_V:
+    {
+        gIsShowingCulledObjects = !gIsShowingCulledObjects;
+        cout << "Culled objects " << (gIsShowingCulledObjects ? "shown" : "hidden") << endl;
+    }
+    break;
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gCylinderMesh.nVertices);
+    // Start and stop measuring fragment shader invocations with and without the pre-pass
+    case GLFW_KEY_O:
+    {
+        if (!GLEW_ARB_pipeline_statistics_query)
+            cout << "Overdraw measurement requires GL_ARB_pipeline_statistics_query" << endl;
+        else
+        {
+            gIsOverdrawMeasuring = !gIsOverdrawMeasuring;
+            cout << "Overdraw measurement " << (gIsOverdrawMeasuring ? "started" : "stopped") << endl;
+        }
+    }
+    break;
+    }
+}
 
-    // --------------------------------------  DRAW THE CHAPSTICK  ------------------------------------------------
+// Returns true only on the frame a key goes from released to pressed
+bool UWasKeyPressed(GLFWwindow* window, int key)
+{
+    static bool isKeyDown[GLFW_KEY_LAST + 1] = { false };
 
-    // CYLINDER: draw the cylinder
-    //----------------
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+    bool wasKeyDown = isKeyDown[key];
+    isKeyDown[key] = glfwGetKey(window, key) == GLFW_PRESS;
 
-    // Activate the VAO 
-    glBindVertexArray(gCylinderMesh.vao);
+    return isKeyDown[key] && !wasKeyDown;
+}
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.15f, 0.1f, 0.75f));
+// glfw: Whenever the mouse moves, this callback is called.
+void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
+{
+    cout << "Mouse at (" << xpos << ", " << ypos << ")" << endl;
+    if (gFirstMouse)
+    {
+        gLastX = xpos;
+        gLastY = ypos;
+        gFirstMouse = false;
+    }
 
-    // 2. Rotates shape by 55 degrees on the x axis
-    rotation = glm::rotate(55.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+    float xoffset = xpos - gLastX;
+    float yoffset = gLastY - ypos;
 
-    // Rotate the shape on its y-axis 120 degrees
-    rotation = glm::rotate(rotation, glm::radians(120.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    gLastX = xpos;
+    gLastY = ypos;
 
-    // 3. Place object at origin
-    translation = glm::translate(glm::vec3(-3.0f, -0.5f, 0.1f));
+    gCamera.ProcessMouseMovement(xoffset, yoffset);
+    UNoteInput();
+}
 
-    // Model matrix: transformations are applied right-to-left order
-    //glm::mat4 model = glm::translate(gPyramidPosition) * glm::scale(gPyramidScale);
+// glfw: Whenever the mouse scroll wheel scrolls, this callback is called.
+void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    gCamera.ProcessMouseScroll(yoffset);
+    UNoteInput();
+    cout << "Mouse wheel (" << xoffset << ", " << yoffset << ")" << endl;
+}
 
-    // Model matrix: Transformations are applied right-to-left order
-    model = translation * rotation * scale;
+// glfw: Handle mouse button events.
+void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+{
+    UNoteInput();
 
-    // camera/view transformation
-    view = gCamera.GetViewMatrix();
+    switch (button)
+    {
+    case GLFW_MOUSE_BUTTON_LEFT:
+    {
+        if (action == GLFW_PRESS)
+            cout << "Left mouse button pressed" << endl;
+        else
+            cout << "Left mouse button released" << endl;
+    }
+    break;
 
-    if (!perspective)
+    case GLFW_MOUSE_BUTTON_MIDDLE:
     {
-        // create a perspective projection matrix
-        // First parameter is the field of view
-        // Second parameter is the aspect ratio
-        // Third parameter is the distance of the near plane to the camera
-        // Fourth parameter is the distance of the far plane to the camera
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        if (action == GLFW_PRESS)
+            cout << "Middle mouse button pressed" << endl;
+        else
+            cout << "Middle mouse button released" << endl;
     }
-    else
+    break;
+
+    case GLFW_MOUSE_BUTTON_RIGHT:
     {
-        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f); // creates the ortho projection if the perspective is set to true
+        if (action == GLFW_PRESS)
+            cout << "Right mouse button pressed" << endl;
+        else
+            cout << "Right mouse button released" << endl;
+    }
+    break;
+
+    default:
+        cout << "Unhandled mouse button event" << endl;
+        break;
     }
+}
 
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    viewLoc = glGetUniformLocation(gProgramId, "view");
-    projLoc = glGetUniformLocation(gProgramId, "projection");
+// glfw: every key press, repeat and release may change what is drawn (the keys themselves are read in UProcessInput)
+void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    UNoteInput();
+}
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+// glfw: the window contents were damaged (uncovered or restored) and must be drawn again
+void UWindowRefreshCallback(GLFWwindow* window)
+{
+    gIsFrameDirty = true;
+}
 
-    // Reference matrix uniforms from the pyramid Shader program for the pyramid color, light color, light position, and camera position
-    objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    keyLightColorLoc = glGetUniformLocation(gProgramId, "keyLightColor");
-    keyLightPositionLoc = glGetUniformLocation(gProgramId, "keyLightPos");
-    keyViewPositionLoc = glGetUniformLocation(gProgramId, "keyViewPosition");
-    fillLightColorLoc = glGetUniformLocation(gProgramId, "fillLightColor");
-    fillLightPositionLoc = glGetUniformLocation(gProgramId, "fillLightPos");
-    fillViewPositionLoc = glGetUniformLocation(gProgramId, "fillViewPosition");
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+void UResizeWindow(GLFWwindow* window, int width, int height)
+{
+    // A minimized window reports a size of zero
+    if (width == 0 || height == 0)
+        return;
+
+    // The GL objects are resized by the renderer, which may run on another thread
+    gRequestedWidth = width;
+    gRequestedHeight = height;
+    gIsFrameDirty = true;
+}
 
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(fillLightColorLoc, gFillLightColor.r, gFillLightColor.g, gFillLightColor.b);
-    glUniform3f(fillLightPositionLoc, gFillLightPosition.x, gFillLightPosition.y, gFillLightPosition.z);
-    //const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(keyViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-    glUniform3f(fillViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+// Resizes the viewport and the framebuffer-sized GL objects (on the thread that renders)
+void UApplyResize(int width, int height)
+{
+    gWindowWidth = width;
+    gWindowHeight = height;
 
-    UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
+    glViewport(0, 0, width, height); // resizes the viewport
+    gDynamicResolution.Resize(width, height);
+    gTextOverlay.SetScreenSize(width, height);
+}
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureIdChapstick);
+// Builds the list of textured objects drawn by URender (called once the textures are loaded)
+void UCreateSceneObjects()
+{
+    gSceneObjects.clear();
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gCylinderMesh.nVertices);
+    // PLANE: the desk
+    glm::mat4 scale = glm::scale(glm::vec3(6.0f, 4.0f, 1.0f));
+    glm::mat4 rotation = glm::rotate(0.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 translation = glm::translate(glm::vec3(0.0f, 0.0f, -0.1f));
+    gSceneObjects.push_back({ "Desk", &gPlaneMesh, gTextureIdPlane, translation * rotation * scale, true, 0 });
 
-    // -------------------------------------  DRAW THE RUBIK CUBE  ------------------------------------------------
+    // PYRAMID: the tip of the pen
+    scale = glm::scale(glm::vec3(0.1f, 0.1f, 0.5f));
+    rotation = glm::rotate(55.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+    rotation = glm::rotate(rotation, glm::radians(120.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    translation = glm::translate(glm::vec3(2.0f, -1.0f, 0.0f));
+    gSceneObjects.push_back({ "Tip of pen", &gPyramidMesh, gTextureIdTipOfPen, translation * rotation * scale, false, 0 });
 
-    // CUBE: draw the cube
-    //----------------
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+    // CYLINDER: the body of the pen
+    scale = glm::scale(glm::vec3(0.1f, 0.1f, 1.75f));
+    gSceneObjects.push_back({ "Body of pen", &gCylinderMesh, gTextureIdBodyOfPen, translation * rotation * scale, false, 0 });
 
-    // Activate the VAO 
-    glBindVertexArray(gCubeMesh.vao);
+    // CYLINDER: the chapstick
+    scale = glm::scale(glm::vec3(0.15f, 0.1f, 0.75f));
+    translation = glm::translate(glm::vec3(-3.0f, -0.5f, 0.1f));
+    gSceneObjects.push_back({ "Chapstick", &gCylinderMesh, gTextureIdChapstick, translation * rotation * scale, false, 0 });
 
-    // 1. Scales the object
+    // CUBE: the Rubik's cube
     scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
+    translation = glm::translate(glm::vec3(1.75f, 1.0f, 0.5f));
+    gSceneObjects.push_back({ "Rubik's cube", &gCubeMesh, gTextureIdRubikCube, translation * rotation * scale, true, 0 });
 
-    // 2. Rotates shape by 55 degrees on the x axis
+    // SPHERE: the baseball
     rotation = glm::rotate(55.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+    rotation = glm::rotate(rotation, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    translation = glm::translate(glm::vec3(0.0f, -2.0f, 1.0f));
+    gSceneObjects.push_back({ "Baseball", &gSphereMesh, gTextureIdBaseball, translation * rotation * scale, false, 0 });
 
-    // Rotate the shape on its y-axis 120 degrees
-    rotation = glm::rotate(rotation, glm::radians(120.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-    // 3. Place object at origin
-    translation = glm::translate(glm::vec3(1.75f, 1.0f, 0.5f));
-
-    // Model matrix: transformations are applied right-to-left order
-    //glm::mat4 model = glm::translate(gPyramidPosition) * glm::scale(gPyramidScale);
+    // CYLINDER: the outside of the duct tape
+    scale = glm::scale(glm::vec3(1.15f, 1.15f, 0.5f));
+    translation = glm::translate(glm::vec3(-1.0f, 1.0f, 0.1f));
+    gSceneObjects.push_back({ "Duct tape (outside)", &gCylinderMesh, gTextureIdDuctTape, translation * rotation * scale, false, 0 });
 
-    // Model matrix: Transformations are applied right-to-left order
-    model = translation * rotation * scale;
+    // CYLINDER: the inside of the duct tape
+    scale = glm::scale(glm::vec3(1.0f, 1.0f, 0.51f));
+    gSceneObjects.push_back({ "Duct tape (inside)", &gCylinderMesh, gTextureIdPlane, translation * rotation * scale, false, 0 });
+}
 
-    // camera/view transformation
-    view = gCamera.GetViewMatrix();
+// Creates the primitive meshes of meshes.cpp and records how each one is drawn
+void UCreatePrimitiveMeshes()
+{
+    gMeshes.CreateMeshes();
+    gIsPrimitiveMeshesCreated = true;
 
-    if (!perspective)
-    {
-        // create a perspective projection matrix
-        // First parameter is the field of view
-        // Second parameter is the aspect ratio
-        // Third parameter is the distance of the near plane to the camera
-        // Fourth parameter is the distance of the far plane to the camera
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
-    }
-    else
+    const Meshes::GLMesh* primitives[STRESS_PRIMITIVE_COUNT] = {
+        &gMeshes.gBoxMesh, &gMeshes.gConeMesh, &gMeshes.gCylinderMesh, &gMeshes.gTaperedCylinderMesh, &gMeshes.gSphereMesh,
+        &gMeshes.gTorusMesh, &gMeshes.gPrismMesh, &gMeshes.gPyramid3Mesh, &gMeshes.gPyramid4Mesh
+    };
+    for (int i = 0; i < STRESS_PRIMITIVE_COUNT; ++i)
     {
-        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f); // creates the ortho projection if the perspective is set to true
+        GLMesh& mesh = gStressMeshes[i];
+        mesh = GLMesh();
+        mesh.vao = primitives[i]->vao;
+        mesh.vbos[0] = primitives[i]->vbos[0];
+        mesh.vbos[1] = primitives[i]->vbos[1];
+        mesh.nVertices = primitives[i]->nVertices;
+        mesh.nIndices = primitives[i]->nIndices;
+        StressPrimitiveBounds((Stress_Primitive)i, mesh.boundsMin, mesh.boundsMax);
     }
 
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    viewLoc = glGetUniformLocation(gProgramId, "view");
-    projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the pyramid Shader program for the pyramid color, light color, light position, and camera position
-    objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    keyLightColorLoc = glGetUniformLocation(gProgramId, "keyLightColor");
-    keyLightPositionLoc = glGetUniformLocation(gProgramId, "keyLightPos");
-    keyViewPositionLoc = glGetUniformLocation(gProgramId, "keyViewPosition");
-    fillLightColorLoc = glGetUniformLocation(gProgramId, "fillLightColor");
-    fillLightPositionLoc = glGetUniformLocation(gProgramId, "fillLightPos");
-    fillViewPositionLoc = glGetUniformLocation(gProgramId, "fillViewPosition");
+    // The box and the sphere are indexed triangles and the torus plain triangles; the others are fans and strips (see meshes.cpp)
+    gStressMeshes[STRESS_TORUS].nIndices = 0;
 
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(fillLightColorLoc, gFillLightColor.r, gFillLightColor.g, gFillLightColor.b);
-    glUniform3f(fillLightPositionLoc, gFillLightPosition.x, gFillLightPosition.y, gFillLightPosition.z);
-    //const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(keyViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-    glUniform3f(fillViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    GLMesh& cone = gStressMeshes[STRESS_CONE];
+    cone.ranges[0] = { GL_TRIANGLE_FAN, 0, 36 };        // bottom
+    cone.ranges[1] = { GL_TRIANGLE_STRIP, 36, 108 };    // sides
+    cone.nRanges = 2;
 
-    UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
+    GLMesh& cylinder = gStressMeshes[STRESS_CYLINDER];
+    cylinder.ranges[0] = { GL_TRIANGLE_FAN, 0, 36 };    // bottom
+    cylinder.ranges[1] = { GL_TRIANGLE_FAN, 36, 36 };   // top
+    cylinder.ranges[2] = { GL_TRIANGLE_STRIP, 72, 146 }; // sides
+    cylinder.nRanges = 3;
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureIdRubikCube);
+    GLMesh& taperedCylinder = gStressMeshes[STRESS_TAPERED_CYLINDER];
+    taperedCylinder.ranges[0] = { GL_TRIANGLE_FAN, 0, 36 };
+    taperedCylinder.ranges[1] = { GL_TRIANGLE_FAN, 36, 72 };
+    taperedCylinder.ranges[2] = { GL_TRIANGLE_STRIP, 72, 146 };
+    taperedCylinder.nRanges = 3;
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
+    const Stress_Primitive strips[] = { STRESS_PRISM, STRESS_PYRAMID3, STRESS_PYRAMID4 };
+    for (Stress_Primitive primitive : strips)
+    {
+        GLMesh& mesh = gStressMeshes[primitive];
+        mesh.ranges[0] = { GL_TRIANGLE_STRIP, 0, (GLsizei)mesh.nVertices };
+        mesh.nRanges = 1;
+    }
+}
 
-    // -------------------------------------  Draw the baseball  ---------------------------------------------------
+// Replaces the scene objects with count generated instances of the primitive meshes
+void UCreateStressScene(int count)
+{
+    const GLuint textures[] = { gTextureIdPlane, gTextureIdTipOfPen, gTextureIdBodyOfPen, gTextureIdChapstick, gTextureIdRubikCube,
+                                gTextureIdBaseball, gTextureIdDuctTape };
+    const int numTextures = sizeof(textures) / sizeof(textures[0]);
 
-    // SPHERE: draw the sphere
-    //----------------
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+    vector<StressInstance> instances = GenerateStressScene(count, gStress.Seed, numTextures);
 
-    // Activate the VAO 
-    glBindVertexArray(gSphereMesh.vao);
+    // Release the previous scene first so the memory measured by a sweep belongs to this one
+    vector<SceneObject>().swap(gSceneObjects);
+    gSceneObjects.reserve(instances.size());
+    for (const StressInstance& instance : instances)
+        gSceneObjects.push_back({ StressPrimitiveName(instance.Primitive), &gStressMeshes[instance.Primitive], textures[instance.TextureIndex],
+                                  instance.Model, false, 0, instance.MaterialColor });
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
+    // Keep the far corner of the field in view
+    gFarPlane = DEFAULT_FAR_PLANE + 2.0f * StressSceneSide(count);
+}
 
-    // 2. Rotates shape by 55 degrees on the x axis
-    rotation = glm::rotate(55.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+// (Re)creates the uniform ring buffer with room for the frame data, the DrawData of every scene object and the two lamps
+bool UCreateUniformRing()
+{
+    GLint alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment = max(alignment, 1);
 
-    // Rotate the shape on its y-axis 120 degrees
-    //rotation = glm::rotate(rotation, glm::radians(120.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    rotation = glm::rotate(rotation, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    GLsizeiptr frameDataSize = (sizeof(FrameData) + alignment - 1) / alignment * alignment;
+    GLsizeiptr drawDataSize = (sizeof(DrawData) + alignment - 1) / alignment * alignment;
+    GLsizeiptr frameSize = max(UNIFORM_RING_FRAME_SIZE, frameDataSize + (GLsizeiptr)(gSceneObjects.size() + 2) * drawDataSize);
 
-    // 3. Place object at origin
-    translation = glm::translate(glm::vec3(0.0f, -2.0f, 1.0f));
+    gUniformRing.Destroy();
+    return gUniformRing.Create(GL_UNIFORM_BUFFER, frameSize);
+}
 
-    // Model matrix: transformations are applied right-to-left order
-    //glm::mat4 model = glm::translate(gPyramidPosition) * glm::scale(gPyramidScale);
+// Writes the model and normal matrices of an object to the uniform ring buffer and returns their offset
+GLintptr UWriteDrawData(const glm::mat4& model, const glm::vec4& materialColor)
+{
+    DrawData drawData;
+    drawData.model = model;
+    drawData.normalMatrix = glm::transpose(glm::inverse(model));
+    drawData.materialColor = materialColor;
 
-    // Model matrix: Transformations are applied right-to-left order
-    model = translation * rotation * scale;
+    gRenderStats.CountUniformUpload(sizeof(DrawData));
+    return gUniformRing.Write(&drawData, sizeof(DrawData));
+}
 
-    // camera/view transformation
-    view = gCamera.GetViewMatrix();
+// Issues the draw call for a scene object with the currently bound shader program
+void UDrawSceneObject(const SceneObject& object)
+{
+    gRenderStats.BindVertexArray(object.mesh->vao);
+    gUniformRing.BindRange(DRAW_DATA_BINDING, object.drawDataOffset, sizeof(DrawData));
 
-    if (!perspective)
+    // The primitive meshes are made of several fans and strips; the sphere is the only indexed mesh
+    if (object.mesh->nRanges > 0)
     {
-        // create a perspective projection matrix
-        // First parameter is the field of view
-        // Second parameter is the aspect ratio
-        // Third parameter is the distance of the near plane to the camera
-        // Fourth parameter is the distance of the far plane to the camera
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        for (int i = 0; i < object.mesh->nRanges; ++i)
+            gRenderStats.DrawArrays(object.mesh->ranges[i].mode, object.mesh->ranges[i].first, object.mesh->ranges[i].count);
     }
+    else if (object.mesh->nIndices > 0)
+        gRenderStats.DrawElements(GL_TRIANGLES, object.mesh->nIndices, GL_UNSIGNED_INT, (void*)0);
     else
-    {
-        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f); // creates the ortho projection if the perspective is set to true
-    }
-
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    viewLoc = glGetUniformLocation(gProgramId, "view");
-    projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the pyramid Shader program for the pyramid color, light color, light position, and camera position
-    objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    keyLightColorLoc = glGetUniformLocation(gProgramId, "keyLightColor");
-    keyLightPositionLoc = glGetUniformLocation(gProgramId, "keyLightPos");
-    keyViewPositionLoc = glGetUniformLocation(gProgramId, "keyViewPosition");
-    fillLightColorLoc = glGetUniformLocation(gProgramId, "fillLightColor");
-    fillLightPositionLoc = glGetUniformLocation(gProgramId, "fillLightPos");
-    fillViewPositionLoc = glGetUniformLocation(gProgramId, "fillViewPosition");
-
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(fillLightColorLoc, gFillLightColor.r, gFillLightColor.g, gFillLightColor.b);
-    glUniform3f(fillLightPositionLoc, gFillLightPosition.x, gFillLightPosition.y, gFillLightPosition.z);
-    //const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(keyViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-    glUniform3f(fillViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureIdBaseball);
-
-    // Draws the triangles
-    //glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-    glDrawElements(GL_TRIANGLES, gSphereMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+        gRenderStats.DrawArrays(GL_TRIANGLES, 0, object.mesh->nVertices);
+}
 
-    //  -----------------------------------------------  Draw the first cylinder for the outside of the duct tape  -----------------------------------
+// Reads back the fragment shader invocation query of the previous measured frame (if any)
+void UCollectOverdrawQuery(int mode)
+{
+    if (!gIsOverdrawQueryPending[mode])
+        return;
+
+    GLuint64 invocations = 0;
+    glGetQueryObjectui64v(gOverdrawQueries[mode], GL_QUERY_RESULT, &invocations);
+    gOverdrawInvocations[mode] += invocations;
+    gOverdrawFrames[mode]++;
+    gIsOverdrawQueryPending[mode] = false;
+
+    // Report once both modes have enough samples
+    const int reportInterval = 60;
+    if (gOverdrawFrames[0] >= reportInterval && gOverdrawFrames[1] >= reportInterval)
+    {
+        double withoutPrepass = (double)gOverdrawInvocations[0] / gOverdrawFrames[0];
+        double withPrepass = (double)gOverdrawInvocations[1] / gOverdrawFrames[1];
+        cout << "Fragment shader invocations per frame: " << withoutPrepass << " without pre-pass, "
+             << withPrepass << " with pre-pass (" << 100.0 * (1.0 - withPrepass / withoutPrepass) << "% fewer)" << endl;
 
-    // CYLINDER: draw the cylinder
-    //----------------
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+        gOverdrawInvocations[0] = gOverdrawInvocations[1] = 0;
+        gOverdrawFrames[0] = gOverdrawFrames[1] = 0;
+    }
+}
 
-    // Activate the VAO 
-    glBindVertexArray(gCylinderMesh.vao);
+// Function called to render a frame
+void URender(const SceneSnapshot& snapshot)
+{
+    TRACE_FUNCTION();
 
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(1.15f, 1.15f, 0.5f));
+    // Renderer settings changed by keys since the last frame
+    for (int i = 0; i < NUM_RENDER_KEYS; ++i)
+    {
+        for (; gAppliedRenderKeyPresses[i] != snapshot.renderKeyPresses[i]; gAppliedRenderKeyPresses[i]++)
+            UApplyRenderKey(RENDER_KEYS[i]);
+    }
 
-    // 2. Rotates shape by 55 degrees on the x axis
-    //rotation = glm::rotate(55.0f, glm::vec3(1.0f, 0.0f, 0.0f));
+    if (snapshot.framebufferWidth != gWindowWidth || snapshot.framebufferHeight != gWindowHeight)
+        UApplyResize(snapshot.framebufferWidth, snapshot.framebufferHeight);
 
-    // Rotate the shape on its y-axis 120 degrees
-    rotation = glm::rotate(rotation, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    // Read back the GPU timings of an earlier frame and start timing this one
+    gGpuProfiler.BeginFrame();
+    gGpuProfiler.BeginScope("Frame");
+    gRenderStats.BeginFrame();
 
-    // 3. Place object at origin
-    translation = glm::translate(glm::vec3(-1.0f, 1.0f, 0.1f));
+    // Render the scene offscreen when dynamic resolution is on
+    gDynamicResolution.BeginScene();
 
-    // Model matrix: transformations are applied right-to-left order
-    //glm::mat4 model = glm::translate(gPyramidPosition) * glm::scale(gPyramidScale);
+    // Enable z-depth
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
 
-    // Model matrix: Transformations are applied right-to-left order
-    model = translation * rotation * scale;
+    // clear the frame and z buffers
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // camera/view transformation
-    view = gCamera.GetViewMatrix();
+    glm::mat4 view = snapshot.view;
 
+    glm::mat4 projection;
     if (!perspective)
     {
         // create a perspective projection matrix
@@ -1186,182 +2160,262 @@ void URender()
         // Second parameter is the aspect ratio
         // Third parameter is the distance of the near plane to the camera
         // Fourth parameter is the distance of the far plane to the camera
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        projection = glm::perspective(glm::radians(snapshot.cameraZoom), (GLfloat)gWindowWidth / (GLfloat)gWindowHeight, 0.1f, gFarPlane);
     }
     else
     {
-        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f); // creates the ortho projection if the perspective is set to true
+        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, gFarPlane); // creates the ortho projection if the perspective is set to true
     }
 
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    viewLoc = glGetUniformLocation(gProgramId, "view");
-    projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the pyramid Shader program for the pyramid color, light color, light position, and camera position
-    objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    keyLightColorLoc = glGetUniformLocation(gProgramId, "keyLightColor");
-    keyLightPositionLoc = glGetUniformLocation(gProgramId, "keyLightPos");
-    keyViewPositionLoc = glGetUniformLocation(gProgramId, "keyViewPosition");
-    fillLightColorLoc = glGetUniformLocation(gProgramId, "fillLightColor");
-    fillLightPositionLoc = glGetUniformLocation(gProgramId, "fillLightPos");
-    fillViewPositionLoc = glGetUniformLocation(gProgramId, "fillViewPosition");
+    // UNIFORM DATA: write this frame's shader data straight into the mapped ring buffer
+    //----------------
+    gUniformRing.BeginFrame();
+
+    FrameData frameData;
+    frameData.view = view;
+    frameData.projection = projection;
+    frameData.objectColor = glm::vec4(gObjectColor, 1.0f);
+    frameData.keyLightColor = glm::vec4(gKeyLightColor, 1.0f);
+    frameData.fillLightColor = glm::vec4(gFillLightColor, 1.0f);
+    frameData.keyLightPos = glm::vec4(snapshot.keyLightPosition, 1.0f);
+    frameData.fillLightPos = glm::vec4(snapshot.fillLightPosition, 1.0f);
+    frameData.keyViewPosition = glm::vec4(snapshot.cameraPosition, 1.0f);
+    frameData.fillViewPosition = glm::vec4(snapshot.cameraPosition, 1.0f);
+    frameData.uvScale = snapshot.uvScale;
+
+    GLintptr frameDataOffset = gUniformRing.Write(&frameData, sizeof(FrameData));
+    gRenderStats.CountUniformUpload(sizeof(FrameData));
+    gUniformRing.BindRange(FRAME_DATA_BINDING, frameDataOffset, sizeof(FrameData));
+
+    // Every pass that draws an object reuses the same DrawData. The blocks of all objects are reserved at once
+    // and filled in parallel; each object's block is at a fixed stride from the first one.
+    {
+        TRACE_SCOPE("Draw data");
+        GLsizeiptr drawDataStride = gUniformRing.AlignedSize(sizeof(DrawData));
+        GLintptr firstOffset = gUniformRing.Allocate(drawDataStride * (GLsizeiptr)gSceneObjects.size());
+        gJobSystem.ParallelFor(firstOffset >= 0 ? (int)gSceneObjects.size() : 0, DRAW_DATA_BATCH, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                SceneObject& object = gSceneObjects[i];
+                object.drawDataOffset = firstOffset + i * drawDataStride;
+
+                DrawData* drawData = (DrawData*)gUniformRing.MappedPointer(object.drawDataOffset);
+                drawData->model = object.model;
+                drawData->normalMatrix = glm::transpose(glm::inverse(object.model));
+                drawData->materialColor = object.materialColor;
+            }
+        });
+
+        // Counted here because the render statistics are not thread-safe; a full ring leaves the objects without data
+        for (SceneObject& object : gSceneObjects)
+        {
+            if (firstOffset < 0)
+                object.drawDataOffset = -1;
+            gRenderStats.CountUniformUpload(sizeof(DrawData));
+        }
+    }
 
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(fillLightColorLoc, gFillLightColor.r, gFillLightColor.g, gFillLightColor.b);
-    glUniform3f(fillLightPositionLoc, gFillLightPosition.x, gFillLightPosition.y, gFillLightPosition.z);
-    //const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(keyViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-    glUniform3f(fillViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    // OCCLUSION CULLING: rasterize the occluders on the CPU and test every other object against the depth pyramid
+    //----------------
+    vector<const SceneObject*> visibleObjects;
+    vector<const SceneObject*> culledObjects;
+    if (gIsOcclusionCullingEnabled)
+    {
+        TRACE_SCOPE("Occlusion culling");
+        glm::mat4 viewProjection = projection * view;
 
-    UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
+        gOcclusionCuller.BeginFrame();
+        for (const SceneObject& object : gSceneObjects)
+            if (object.isOccluder)
+                gOcclusionCuller.AddOccluderBox(object.mesh->boundsMin, object.mesh->boundsMax, viewProjection * object.model);
+        gOcclusionCuller.BuildPyramid();
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureIdDuctTape);
+        // Occluders are in the depth buffer themselves, so they are always drawn
+        for (const SceneObject& object : gSceneObjects)
+        {
+            if (object.isOccluder || gOcclusionCuller.IsVisible(object.mesh->boundsMin, object.mesh->boundsMax, viewProjection * object.model))
+                visibleObjects.push_back(&object);
+            else
+                culledObjects.push_back(&object);
+        }
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gCylinderMesh.nVertices);
+        // Report the number of rejected objects whenever it changes
+        if (gOcclusionCuller.NumRejected != gLastRejectedCount)
+        {
+            gLastRejectedCount = gOcclusionCuller.NumRejected;
+            cout << "Occlusion culling rejected " << gOcclusionCuller.NumRejected << " of " << gOcclusionCuller.NumTested << " objects" << endl;
+        }
+    }
+    else
+    {
+        for (const SceneObject& object : gSceneObjects)
+            visibleObjects.push_back(&object);
+    }
 
-    //  -----------------------------------------------  Draw the first cylinder for the inside of the duct tape  -----------------------------------
+    // In measurement mode the pre-pass is switched on and off every other frame so both can be compared
+    bool isDepthPrepassEnabled = gIsDepthPrepassEnabled;
+    int overdrawMode = 0;
+    if (gIsOverdrawMeasuring)
+    {
+        static unsigned int measuredFrame = 0;
+        overdrawMode = measuredFrame++ & 1;
+        isDepthPrepassEnabled = overdrawMode == 1;
+    }
 
-    // CYLINDER: draw the cylinder
+    // DEPTH PRE-PASS: lay down the depth of every object without shading
     //----------------
-    // Set the shader to be used
-    glUseProgram(gProgramId);
-
-    // Activate the VAO 
-    glBindVertexArray(gCylinderMesh.vao);
-
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(1.0f, 1.0f, 0.51f));
-
-    // 2. Rotates shape by 55 degrees on the x axis
-    //rotation = glm::rotate(55.0f, glm::vec3(1.0f, 0.0f, 0.0f));
-
-    // Rotate the shape on its y-axis 120 degrees
-    rotation = glm::rotate(rotation, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    if (isDepthPrepassEnabled)
+    {
+        gGpuProfiler.BeginScope("Depth pre-pass");
+        gRenderStats.UseProgram(gDepthProgramId);
 
-    // 3. Place object at origin
-    translation = glm::translate(glm::vec3(-1.0f, 1.0f, 0.1f));
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        for (const SceneObject* object : visibleObjects)
+        {
+            gGpuProfiler.BeginScope(object->name);
+            UDrawSceneObject(*object);
+            gGpuProfiler.EndScope();
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        gGpuProfiler.EndScope();
 
-    // Model matrix: transformations are applied right-to-left order
-    //glm::mat4 model = glm::translate(gPyramidPosition) * glm::scale(gPyramidScale);
+        // Only the visible surface of each pixel passes the depth test in the color pass
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
 
-    // Model matrix: Transformations are applied right-to-left order
-    model = translation * rotation * scale;
+    // COLOR PASS: draw every object with the lighting shader
+    //----------------
+    gGpuProfiler.BeginScope("Color pass");
 
-    // camera/view transformation
-    view = gCamera.GetViewMatrix();
+    // Set the shader to be used
+    gRenderStats.UseProgram(gProgramId);
 
-    if (!perspective)
+    if (gIsOverdrawMeasuring)
     {
-        // create a perspective projection matrix
-        // First parameter is the field of view
-        // Second parameter is the aspect ratio
-        // Third parameter is the distance of the near plane to the camera
-        // Fourth parameter is the distance of the far plane to the camera
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
-    }
-    else
-    {
-        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f); // creates the ortho projection if the perspective is set to true
+        UCollectOverdrawQuery(overdrawMode);
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, gOverdrawQueries[overdrawMode]);
     }
 
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    viewLoc = glGetUniformLocation(gProgramId, "view");
-    projLoc = glGetUniformLocation(gProgramId, "projection");
+    for (const SceneObject* object : visibleObjects)
+    {
+        gGpuProfiler.BeginScope(object->name);
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        // bind textures on corresponding texture units
+        glActiveTexture(GL_TEXTURE0);
+        gRenderStats.BindTexture(GL_TEXTURE_2D, object->textureId);
 
-    // Reference matrix uniforms from the pyramid Shader program for the pyramid color, light color, light position, and camera position
-    objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    keyLightColorLoc = glGetUniformLocation(gProgramId, "keyLightColor");
-    keyLightPositionLoc = glGetUniformLocation(gProgramId, "keyLightPos");
-    keyViewPositionLoc = glGetUniformLocation(gProgramId, "keyViewPosition");
-    fillLightColorLoc = glGetUniformLocation(gProgramId, "fillLightColor");
-    fillLightPositionLoc = glGetUniformLocation(gProgramId, "fillLightPos");
-    fillViewPositionLoc = glGetUniformLocation(gProgramId, "fillViewPosition");
+        // Draws the triangles
+        UDrawSceneObject(*object);
 
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(fillLightColorLoc, gFillLightColor.r, gFillLightColor.g, gFillLightColor.b);
-    glUniform3f(fillLightPositionLoc, gFillLightPosition.x, gFillLightPosition.y, gFillLightPosition.z);
-    //const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(keyViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-    glUniform3f(fillViewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+        gGpuProfiler.EndScope();
+    }
 
-    UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
+    if (gIsOverdrawMeasuring)
+    {
+        glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+        gIsOverdrawQueryPending[overdrawMode] = true;
+    }
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureIdPlane);
+    gGpuProfiler.EndScope();
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gCylinderMesh.nVertices);
+    // The lamps are not part of the pre-pass
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
 
     // LAMP: draw lamp 1
     //----------------
-    glUseProgram(gLampProgramId);
+    gGpuProfiler.BeginScope("Lamps");
+    gRenderStats.UseProgram(gLampProgramId);
 
-    //Transform the smaller cube used as a visual que for the light source
-    model = glm::translate(gKeyLightPosition) * glm::scale(gKeyLightScale);
+    // CULLED OBJECTS: draw the objects rejected by occlusion culling as white wireframes on top of their occluders
+    if (gIsShowingCulledObjects && !culledObjects.empty())
+    {
+        glDisable(GL_DEPTH_TEST);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        for (const SceneObject* object : culledObjects)
+            UDrawSceneObject(*object);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    // Activate the VAO (used by the plane and the lamps)
+    gRenderStats.BindVertexArray(gPlaneMesh.vao);
 
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
+    //Transform the smaller cube used as a visual que for the light source
+    glm::mat4 model = glm::translate(snapshot.keyLightPosition) * glm::scale(gKeyLightScale);
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // Pass matrix data to the Lamp Shader program's DrawData block
+    gUniformRing.BindRange(DRAW_DATA_BINDING, UWriteDrawData(model), sizeof(DrawData));
 
-    glDrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
+    gRenderStats.DrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
 
     // LAMP: draw lamp 2
     //----------------
-    glUseProgram(gLampProgramId);
-
     //Transform the smaller cube used as a visual que for the light source
-    model = glm::translate(gFillLightPosition) * glm::scale(gFillLightScale);
-
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
+    model = glm::translate(snapshot.fillLightPosition) * glm::scale(gFillLightScale);
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // Pass matrix data to the Lamp Shader program's DrawData block
+    gUniformRing.BindRange(DRAW_DATA_BINDING, UWriteDrawData(model), sizeof(DrawData));
 
-    glDrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
+    gRenderStats.DrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
 
     // Deactivate the Vertex Array Object and shader program
     glBindVertexArray(0);
     glUseProgram(0);
+    gGpuProfiler.EndScope();
+
+    // Upscale the offscreen scene to the window and pick the resolution of the next frame
+    gGpuProfiler.BeginScope("Upscale");
+    gDynamicResolution.EndScene();
+    gGpuProfiler.EndScope();
+
+    // The overlays below are not part of the counted frame
+    gRenderStats.EndFrame();
+    if (gRenderStatsLog)
+        gRenderStats.WriteCsvRow(gRenderStatsLog);
+
+    // OVERLAYS: GPU profiler and render statistics, drawn at window resolution on top of the upscaled scene
+    //----------------
+    if (gGpuProfiler.IsEnabled || gIsStatsOverlayVisible)
+    {
+        gGpuProfiler.BeginScope("Overlay");
+        if (gGpuProfiler.IsEnabled)
+            gGpuProfiler.DrawOverlay(gTextOverlay, 10.0f, 10.0f);
+        if (gIsStatsOverlayVisible)
+            gRenderStats.DrawOverlay(gTextOverlay, gWindowWidth - 10.0f, 10.0f);
+        gTextOverlay.Flush();
+        gGpuProfiler.EndScope();
+    }
+    gGpuProfiler.EndScope();
+
+    // The GPU is done with this frame's uniform data once it passes this point
+    gUniformRing.EndFrame();
+
+    // Report the ring buffer statistics every few seconds
+    if (gUniformRing.TotalFrames % 600 == 0)
+        cout << "Uniform ring buffer: " << gUniformRing.BytesWritten << " bytes written this frame, "
+             << gUniformRing.TotalStalls << " stalls in " << gUniformRing.TotalFrames << " frames" << endl;
 
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    if (!gHeadless.IsEnabled)
+    {
+        TRACE_SCOPE("glfwSwapBuffers");
+        glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    }
+    gFramePacer.OnPresent();
+
+    // Time the first frame that shows an input and tell the input thread it is on screen
+    gLatencyTracker.OnPresent(snapshot.inputTime);
+    gPresentedSerial.store(snapshot.serial);
+    gIsRendererAnimating.store(gIsOverdrawMeasuring || gGpuProfiler.IsEnabled || gRenderStatsLog != nullptr);
 }
 
 // Implements the UCreateCubeMesh function
 void UCreateCubeMesh(GLMesh& mesh) {
+    TRACE_FUNCTION();
+
     // Position and Color data
     GLfloat verts[] = {
         //Positions            //Normals
@@ -1420,6 +2474,7 @@ void UCreateCubeMesh(GLMesh& mesh) {
     const GLuint floatsPerUV = 2;
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    UComputeMeshBounds(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
     glBindVertexArray(mesh.vao);
@@ -1445,6 +2500,8 @@ void UCreateCubeMesh(GLMesh& mesh) {
 
 // Implements the UCreateSphereMesh function
 void UCreateSphereMesh(GLMesh& mesh) {
+    TRACE_FUNCTION();
+
     GLfloat verts[] = {
         // vertex data					// index
         // top center point
@@ -2231,6 +3288,7 @@ void UCreateSphereMesh(GLMesh& mesh) {
     // store vertex and index count
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex));
     mesh.nIndices = sizeof(indices) / (sizeof(indices[0]));
+    UComputeMeshBounds(mesh, verts, floatsPerVertex);
 
     glm::vec3 normal;
     glm::vec3 vert;
@@ -2284,6 +3342,8 @@ void UCreateSphereMesh(GLMesh& mesh) {
 // Implements the UCreatePlaneMesh function
 void UCreatePlaneMesh(GLMesh& mesh)
 {
+    TRACE_FUNCTION();
+
     const float REPEAT = 1;
     // Specifies normalized device coordinates (x,y,z) and color for square vertices
     GLfloat verts[] = {
@@ -2304,6 +3364,7 @@ void UCreatePlaneMesh(GLMesh& mesh)
     const GLuint floatsPerUV = 2;
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    UComputeMeshBounds(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
     glBindVertexArray(mesh.vao);
@@ -2330,6 +3391,8 @@ void UCreatePlaneMesh(GLMesh& mesh)
 // Implements the UCreatePyramidMesh function
 void UCreatePyramidMesh(GLMesh& mesh)
 {
+    TRACE_FUNCTION();
+
     const float REPEAT = 1;
     // Specifies normalized device coordinates (x,y,z) and color for square vertices
     GLfloat verts[] = {
@@ -2372,6 +3435,7 @@ void UCreatePyramidMesh(GLMesh& mesh)
     const GLuint floatsPerUV = 2;
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    UComputeMeshBounds(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
     glBindVertexArray(mesh.vao);
@@ -2398,6 +3462,8 @@ void UCreatePyramidMesh(GLMesh& mesh)
 // Implements the UCreateCylinderMesh function
 void UCreateCylinderMesh(GLMesh& mesh)
 {
+    TRACE_FUNCTION();
+
     const float REPEAT = 1;
     // Specifies normalized device coordinates (x,y,z) and color for square vertices
     GLfloat verts[] = {
@@ -2550,6 +3616,7 @@ void UCreateCylinderMesh(GLMesh& mesh)
     const GLuint floatsPerUV = 2;
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    UComputeMeshBounds(mesh, verts, floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
     glBindVertexArray(mesh.vao);
@@ -2573,6 +3640,20 @@ void UCreateCylinderMesh(GLMesh& mesh)
     glEnableVertexAttribArray(2);
 }
 
+// Stores the local-space bounding box of the first mesh.nVertices vertices
+void UComputeMeshBounds(GLMesh& mesh, const GLfloat* verts, GLuint floatsPerVertexTotal)
+{
+    mesh.boundsMin = glm::vec3(verts[0], verts[1], verts[2]);
+    mesh.boundsMax = mesh.boundsMin;
+
+    for (GLuint i = 1; i < mesh.nVertices; ++i)
+    {
+        const GLfloat* position = verts + i * floatsPerVertexTotal;
+        mesh.boundsMin = glm::min(mesh.boundsMin, glm::vec3(position[0], position[1], position[2]));
+        mesh.boundsMax = glm::max(mesh.boundsMax, glm::vec3(position[0], position[1], position[2]));
+    }
+}
+
 // de-allocates resources once they have outlived their purpose
 void UDestroyMesh(GLMesh& mesh)
 {
@@ -2581,44 +3662,53 @@ void UDestroyMesh(GLMesh& mesh)
     glDeleteBuffers(2, mesh.vbos);
 }
 
-bool UCreateTexture(const char* filename, GLuint& textureId)
+// Decodes an image file and flips it vertically; runs on any thread
+bool UDecodeImage(const char* filename, DecodedImage& image)
 {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
-    {
-        flipImageVertically(image, width, height, channels);
-
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
+    TRACE_FUNCTION();
 
-        // Set the texture wrapping parameters.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // Set texture filtering parameters.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    image.pixels = stbi_load(filename, &image.width, &image.height, &image.channels, 0);
+    if (!image.pixels)
+        return false;
 
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
-        {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
-        }
+    flipImageVertically(image.pixels, image.width, image.height, image.channels);
+    return true;
+}
 
-        glGenerateMipmap(GL_TEXTURE_2D);
+// Uploads a decoded image as a mipmapped texture (on the thread that owns the context)
+bool UCreateTexture(const DecodedImage& image, GLuint& textureId)
+{
+    TRACE_FUNCTION();
 
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture.
+    // Error loading the image
+    if (!image.pixels)
+        return false;
 
-        return true;
+    if (image.channels != 3 && image.channels != 4)
+    {
+        cout << "Not implemented to handle image with " << image.channels << " channels" << endl;
+        return false;
     }
 
-    // Error loading the image
-    return false;
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+
+    // Set the texture wrapping parameters.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // Set texture filtering parameters.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if (image.channels == 3)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture.
+
+    return true;
 }
 
 void UDestroyTexture(GLuint textureId)
@@ -2629,6 +3719,8 @@ void UDestroyTexture(GLuint textureId)
 // Implements the UCreateShaders function
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
 {
+    TRACE_FUNCTION();
+
     // Compilation and linkage error reporting
     int success = 0;
     char infoLog[512];
@@ -0,0 +1,240 @@
+#pragma once
+/* Deterministic benchmark mode.
+
+A camera path file replaces mouse and keyboard input. Every non-empty line that does not
+start with '#' is a keyframe:
+
+    time  x  y  z  yaw  pitch
+
+with time in seconds (increasing), the position in world units and the angles in degrees.
+The path is interpolated with a Catmull-Rom spline and sampled at a fixed simulated
+timestep, so every run renders exactly the same frames regardless of how fast they are
+drawn. After the warm-up frames, the CPU time, GPU time and wall-clock time of each
+measured frame are recorded and summarized (min/mean/p50/p95/p99) in a JSON file.
+
+Command-line options:
+    --benchmark PATH        camera path file (enables the mode)
+    --warmup N              frames rendered before measuring (default 120)
+    --measure N             measured frames (default 600)
+    --timestep SECONDS      simulated time per frame (default 1/60)
+    --report PATH           JSON results (default benchmark.json)
+*/
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+struct BenchmarkOptions
+{
+    bool IsEnabled;
+    std::string PathFile;
+    int NumWarmupFrames;
+    int NumMeasuredFrames;
+    float Timestep;
+    std::string ReportPath;
+
+    BenchmarkOptions() : IsEnabled(false), NumWarmupFrames(120), NumMeasuredFrames(600), Timestep(1.0f / 60.0f), ReportPath("benchmark.json") {}
+
+    // reads the benchmark options and removes them from argv so other parsers do not see them. Returns false when an option is invalid.
+    bool Parse(int& argc, char* argv[])
+    {
+        int kept = 1;
+        for (int i = 1; i < argc; ++i)
+        {
+            const char* option = argv[i];
+            bool isBenchmarkOption = strcmp(option, "--benchmark") == 0 || strcmp(option, "--warmup") == 0 || strcmp(option, "--measure") == 0 ||
+                                     strcmp(option, "--timestep") == 0 || strcmp(option, "--report") == 0;
+            if (!isBenchmarkOption)
+            {
+                argv[kept++] = argv[i];
+                continue;
+            }
+
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "Missing value for %s\n", option);
+                return false;
+            }
+            const char* value = argv[++i];
+
+            if (strcmp(option, "--benchmark") == 0)
+            {
+                IsEnabled = true;
+                PathFile = value;
+            }
+            else if (strcmp(option, "--warmup") == 0)
+                NumWarmupFrames = std::max(0, atoi(value));
+            else if (strcmp(option, "--measure") == 0)
+                NumMeasuredFrames = std::max(1, atoi(value));
+            else if (strcmp(option, "--timestep") == 0)
+                Timestep = (float)atof(value);
+            else
+                ReportPath = value;
+        }
+        argc = kept;
+
+        if (Timestep <= 0.0f)
+        {
+            fprintf(stderr, "The timestep must be positive\n");
+            return false;
+        }
+        return true;
+    }
+};
+
+class CameraPath
+{
+public:
+    struct Keyframe
+    {
+        float Time;
+        glm::vec3 Position;
+        float Yaw;
+        float Pitch;
+    };
+
+    std::vector<Keyframe> Keyframes;
+
+    // reads the keyframes of a path file. Returns false (after printing the problem) when the file is missing or malformed.
+    bool Load(const char* path)
+    {
+        FILE* file = fopen(path, "r");
+        if (!file)
+        {
+            fprintf(stderr, "Failed to open the camera path %s\n", path);
+            return false;
+        }
+
+        Keyframes.clear();
+        char line[256];
+        int lineNumber = 0;
+        bool isValid = true;
+        while (isValid && fgets(line, sizeof(line), file))
+        {
+            lineNumber++;
+            const char* text = line + strspn(line, " \t\r\n");
+            if (*text == '\0' || *text == '#')
+                continue;
+
+            Keyframe key;
+            if (sscanf(text, "%f %f %f %f %f %f", &key.Time, &key.Position.x, &key.Position.y, &key.Position.z, &key.Yaw, &key.Pitch) != 6)
+            {
+                fprintf(stderr, "%s:%d: expected 'time x y z yaw pitch'\n", path, lineNumber);
+                isValid = false;
+            }
+            else if (!Keyframes.empty() && key.Time <= Keyframes.back().Time)
+            {
+                fprintf(stderr, "%s:%d: keyframe times must increase\n", path, lineNumber);
+                isValid = false;
+            }
+            else
+                Keyframes.push_back(key);
+        }
+        fclose(file);
+
+        if (isValid && Keyframes.empty())
+        {
+            fprintf(stderr, "%s: no keyframes\n", path);
+            isValid = false;
+        }
+        return isValid;
+    }
+
+    float Duration() const
+    {
+        return Keyframes.empty() ? 0.0f : Keyframes.back().Time - Keyframes.front().Time;
+    }
+
+    // returns the camera pose at time seconds from the first keyframe. The path loops after its last keyframe.
+    Keyframe Evaluate(float time) const
+    {
+        if (Keyframes.size() == 1 || Duration() <= 0.0f)
+            return Keyframes.front();
+
+        time = Keyframes.front().Time + std::fmod(std::max(time, 0.0f), Duration());
+
+        size_t segment = 0;
+        while (segment + 2 < Keyframes.size() && Keyframes[segment + 1].Time <= time)
+            segment++;
+
+        const Keyframe& p1 = Keyframes[segment];
+        const Keyframe& p2 = Keyframes[segment + 1];
+        const Keyframe& p0 = segment > 0 ? Keyframes[segment - 1] : p1;
+        const Keyframe& p3 = segment + 2 < Keyframes.size() ? Keyframes[segment + 2] : p2;
+        float t = (time - p1.Time) / (p2.Time - p1.Time);
+
+        Keyframe result;
+        result.Time = time;
+        result.Position = glm::vec3(catmullRom(p0.Position.x, p1.Position.x, p2.Position.x, p3.Position.x, t),
+                                    catmullRom(p0.Position.y, p1.Position.y, p2.Position.y, p3.Position.y, t),
+                                    catmullRom(p0.Position.z, p1.Position.z, p2.Position.z, p3.Position.z, t));
+        result.Yaw = catmullRom(p0.Yaw, p1.Yaw, p2.Yaw, p3.Yaw, t);
+        result.Pitch = std::max(-89.0f, std::min(89.0f, catmullRom(p0.Pitch, p1.Pitch, p2.Pitch, p3.Pitch, t)));
+        return result;
+    }
+
+private:
+    static float catmullRom(float p0, float p1, float p2, float p3, float t)
+    {
+        float t2 = t * t;
+        float t3 = t2 * t;
+        return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+};
+
+// Summary of a series of frame times in milliseconds
+struct FrameTimeSummary
+{
+    int Count;
+    float Min;
+    float Mean;
+    float P50;
+    float P95;
+    float P99;
+    float Max;
+
+    static FrameTimeSummary FromSamples(std::vector<float> samples)
+    {
+        FrameTimeSummary summary = FrameTimeSummary();
+        summary.Count = (int)samples.size();
+        if (samples.empty())
+            return summary;
+
+        std::sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (float sample : samples)
+            sum += sample;
+
+        summary.Min = samples.front();
+        summary.Max = samples.back();
+        summary.Mean = (float)(sum / samples.size());
+        summary.P50 = percentile(samples, 0.50f);
+        summary.P95 = percentile(samples, 0.95f);
+        summary.P99 = percentile(samples, 0.99f);
+        return summary;
+    }
+
+    void WriteJson(FILE* file) const
+    {
+        fprintf(file, "{ \"count\": %d, \"min\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }",
+            Count, Min, Mean, P50, P95, P99, Max);
+    }
+
+private:
+    // nearest-rank percentile of sorted samples
+    static float percentile(const std::vector<float>& sorted, float fraction)
+    {
+        size_t rank = (size_t)std::ceil(fraction * sorted.size());
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+};
+#endif
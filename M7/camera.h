@@ -142,6 +142,15 @@ public:
             MovementSpeed = 45.0f;
     }
 
+    // places the camera directly (used by scripted camera paths instead of input)
+    void SetPose(const glm::vec3& position, float yaw, float pitch)
+    {
+        Position = position;
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
 private:
     // calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors()
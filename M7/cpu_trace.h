@@ -0,0 +1,206 @@
+#pragma once
+/* CPU scope tracing with Chrome trace-event export.
+
+TRACE_SCOPE(name) records the time between its declaration and the end of the enclosing
+block; TRACE_FUNCTION() does the same with the name of the current function. Every thread
+writes into its own fixed-size ring of events, so recording takes no lock: the owning
+thread is the only writer and publishes each event with an atomic store. When a ring is
+full the oldest events are overwritten.
+
+CPU_TRACE_WRITE(path) saves the events of every thread as a Chrome trace-event JSON file
+that opens in chrome://tracing or ui.perfetto.dev. Call it once the other threads have
+stopped recording (for example on exit).
+
+Tracing is compiled out completely when NDEBUG is defined, unless CPU_TRACE_FORCE is
+defined as well; the macros then expand to nothing.
+*/
+
+#ifndef CPU_TRACE_H
+#define CPU_TRACE_H
+
+#if !defined(NDEBUG) || defined(CPU_TRACE_FORCE)
+#define CPU_TRACE_ENABLED 1
+#else
+#define CPU_TRACE_ENABLED 0
+#endif
+
+#if CPU_TRACE_ENABLED
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Events kept per thread (the newest ones win)
+const size_t CPU_TRACE_EVENTS_PER_THREAD = 1 << 16;
+
+namespace CpuTrace
+{
+    typedef std::chrono::steady_clock clock;
+
+    struct Event
+    {
+        const char* Name;
+        long long BeginNs;      // since the trace epoch
+        long long DurationNs;
+    };
+
+    // Events recorded by one thread. Only the owning thread writes Events and NumWritten.
+    struct ThreadBuffer
+    {
+        int ThreadId;
+        std::string ThreadName;
+        std::vector<Event> Events;
+        std::atomic<size_t> NumWritten;
+
+        ThreadBuffer(int id) : ThreadId(id), Events(CPU_TRACE_EVENTS_PER_THREAD), NumWritten(0) {}
+    };
+
+    // Every thread buffer ever created. The mutex is only taken when a thread records its first event and when writing the file.
+    struct Registry
+    {
+        std::mutex Mutex;
+        std::vector<ThreadBuffer*> Buffers;
+        clock::time_point Epoch;
+
+        Registry() : Epoch(clock::now()) {}
+        ~Registry()
+        {
+            for (ThreadBuffer* buffer : Buffers)
+                delete buffer;
+        }
+    };
+
+    inline Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    // buffer of the calling thread, created the first time the thread records an event
+    inline ThreadBuffer& threadBuffer()
+    {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer)
+        {
+            Registry& reg = registry();
+            std::lock_guard<std::mutex> lock(reg.Mutex);
+            buffer = new ThreadBuffer((int)reg.Buffers.size() + 1);
+            reg.Buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    inline long long nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - registry().Epoch).count();
+    }
+
+    // names the calling thread in the trace viewer
+    inline void SetThreadName(const char* name)
+    {
+        threadBuffer().ThreadName = name;
+    }
+
+    inline void Record(const char* name, long long beginNs, long long endNs)
+    {
+        ThreadBuffer& buffer = threadBuffer();
+        size_t index = buffer.NumWritten.load(std::memory_order_relaxed);
+
+        Event& event = buffer.Events[index % CPU_TRACE_EVENTS_PER_THREAD];
+        event.Name = name;
+        event.BeginNs = beginNs;
+        event.DurationNs = endNs - beginNs;
+
+        buffer.NumWritten.store(index + 1, std::memory_order_release);
+    }
+
+    // records the lifetime of the object as one event
+    class Scope
+    {
+    public:
+        Scope(const char* scopeName) : name(scopeName), beginNs(nowNs()) {}
+        ~Scope() { Record(name, beginNs, nowNs()); }
+
+    private:
+        const char* name;
+        long long beginNs;
+
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+    };
+
+    inline void writeJsonString(FILE* file, const char* text)
+    {
+        fputc('"', file);
+        for (const char* c = text; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\')
+                fputc('\\', file);
+            if ((unsigned char)*c >= 0x20)
+                fputc(*c, file);
+        }
+        fputc('"', file);
+    }
+
+    // writes the events of every thread in the Chrome trace-event format. Returns false when the file can not be opened.
+    inline bool WriteChromeJson(const char* path)
+    {
+        FILE* file = fopen(path, "w");
+        if (!file)
+            return false;
+
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.Mutex);
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        bool isFirst = true;
+        for (ThreadBuffer* buffer : reg.Buffers)
+        {
+            // Thread name metadata
+            if (!buffer->ThreadName.empty())
+            {
+                fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", isFirst ? "" : ",", buffer->ThreadId);
+                writeJsonString(file, buffer->ThreadName.c_str());
+                fprintf(file, "}}");
+                isFirst = false;
+            }
+
+            // Complete ("X") events, oldest first; timestamps are in microseconds
+            size_t numWritten = buffer->NumWritten.load(std::memory_order_acquire);
+            size_t first = numWritten > CPU_TRACE_EVENTS_PER_THREAD ? numWritten - CPU_TRACE_EVENTS_PER_THREAD : 0;
+            for (size_t i = first; i < numWritten; ++i)
+            {
+                const Event& event = buffer->Events[i % CPU_TRACE_EVENTS_PER_THREAD];
+                fprintf(file, "%s\n{\"name\":", isFirst ? "" : ",");
+                writeJsonString(file, event.Name);
+                fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", buffer->ThreadId, event.BeginNs / 1000.0, event.DurationNs / 1000.0);
+                isFirst = false;
+            }
+        }
+        fprintf(file, "\n]}\n");
+
+        fclose(file);
+        return true;
+    }
+}
+
+#define CPU_TRACE_CONCAT_INNER(a, b) a##b
+#define CPU_TRACE_CONCAT(a, b) CPU_TRACE_CONCAT_INNER(a, b)
+
+#define TRACE_SCOPE(name) CpuTrace::Scope CPU_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__FUNCTION__)
+#define TRACE_THREAD_NAME(name) CpuTrace::SetThreadName(name)
+#define CPU_TRACE_WRITE(path) CpuTrace::WriteChromeJson(path)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_FUNCTION()
+#define TRACE_THREAD_NAME(name)
+#define CPU_TRACE_WRITE(path) false
+
+#endif
+#endif
@@ -0,0 +1,230 @@
+#pragma once
+/* Dynamic resolution scaling.
+
+The scene is rendered into the lower-left corner of an offscreen framebuffer that is as
+large as the window. The size of that corner (the render scale) is adjusted every frame so
+the GPU time of the scene, measured with GL_TIME_ELAPSED queries, stays within a budget.
+The result is then drawn over the whole window with an upscaling shader.
+
+Timer results are read a few frames late so the CPU never waits for the GPU, which means
+the controller reacts to the frame that finished, not the one being drawn.
+*/
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+
+// Number of timer queries in flight
+const int DYNAMIC_RESOLUTION_QUERIES = 4;
+
+// Default GPU time budget for the scene in milliseconds (leaves headroom inside a 60 Hz frame)
+const float DYNAMIC_RESOLUTION_TARGET_MS = 14.0f;
+
+// Render scale limits and the largest change per frame
+const float DYNAMIC_RESOLUTION_MIN_SCALE = 0.5f;
+const float DYNAMIC_RESOLUTION_MAX_SCALE = 1.0f;
+const float DYNAMIC_RESOLUTION_MAX_STEP = 0.05f;
+
+// Upscaling filters
+enum Upscale_Filter {
+    UPSCALE_BILINEAR,
+    UPSCALE_EDGE_AWARE
+};
+
+class DynamicResolution
+{
+public:
+    // Settings
+    bool IsEnabled;
+    float TargetGpuMs;
+    Upscale_Filter Filter;
+    // Current state
+    float Scale;                // fraction of the window size the scene is rendered at
+    int RenderWidth;
+    int RenderHeight;
+    float LastGpuMs;            // GPU time of the most recently finished scene
+    GLuint OutputFramebuffer;   // where the final image goes: 0 for the window, or an offscreen target in headless mode
+
+    DynamicResolution() : IsEnabled(false), TargetGpuMs(DYNAMIC_RESOLUTION_TARGET_MS), Filter(UPSCALE_BILINEAR), Scale(1.0f),
+        RenderWidth(0), RenderHeight(0), LastGpuMs(0.0f), OutputFramebuffer(0), framebuffer(0), colorTexture(0), depthRenderbuffer(0), emptyVao(0),
+        upscaleProgramId(0), windowWidth(0), windowHeight(0), queryIndex(0)
+    {
+        for (int i = 0; i < DYNAMIC_RESOLUTION_QUERIES; ++i)
+        {
+            queries[i] = 0;
+            isQueryPending[i] = false;
+        }
+    }
+
+    // creates the offscreen framebuffer at the window size. programId is the compiled upscaling shader.
+    bool Create(int width, int height, GLuint programId)
+    {
+        upscaleProgramId = programId;
+
+        glGenQueries(DYNAMIC_RESOLUTION_QUERIES, queries);
+        glGenVertexArrays(1, &emptyVao); // the full-screen triangle is generated from gl_VertexID
+
+        return Resize(width, height);
+    }
+
+    // reallocates the offscreen framebuffer when the window size changes
+    bool Resize(int width, int height)
+    {
+        windowWidth = std::max(width, 1);
+        windowHeight = std::max(height, 1);
+
+        destroyFramebuffer();
+
+        glGenTextures(1, &colorTexture);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, windowWidth, windowHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenRenderbuffers(1, &depthRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, windowWidth, windowHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+        bool isComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        updateRenderSize();
+        return isComplete;
+    }
+
+    // releases every GL object
+    void Destroy()
+    {
+        destroyFramebuffer();
+        glDeleteQueries(DYNAMIC_RESOLUTION_QUERIES, queries);
+        glDeleteVertexArrays(1, &emptyVao);
+        emptyVao = 0;
+    }
+
+    // binds the render target of the scene and starts timing it
+    void BeginScene()
+    {
+        if (!IsEnabled)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, OutputFramebuffer);
+            glViewport(0, 0, windowWidth, windowHeight);
+            return;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, RenderWidth, RenderHeight);
+
+        // Reuse the oldest query; if its result never arrived the frame is simply not measured
+        collectQuery(queryIndex);
+        glBeginQuery(GL_TIME_ELAPSED, queries[queryIndex]);
+    }
+
+    // stops timing the scene, upscales it to the window and adjusts the render scale for the next frame
+    void EndScene()
+    {
+        if (!IsEnabled)
+            return;
+
+        glEndQuery(GL_TIME_ELAPSED);
+        isQueryPending[queryIndex] = true;
+        queryIndex = (queryIndex + 1) % DYNAMIC_RESOLUTION_QUERIES;
+
+        // UPSCALE: draw the rendered corner of the offscreen color buffer over the whole window
+        glBindFramebuffer(GL_FRAMEBUFFER, OutputFramebuffer);
+        glViewport(0, 0, windowWidth, windowHeight);
+        glDisable(GL_DEPTH_TEST);
+
+        glUseProgram(upscaleProgramId);
+        glUniform2f(glGetUniformLocation(upscaleProgramId, "uvMax"), (RenderWidth - 0.5f) / windowWidth, (RenderHeight - 0.5f) / windowHeight);
+        glUniform2f(glGetUniformLocation(upscaleProgramId, "texelSize"), 1.0f / windowWidth, 1.0f / windowHeight);
+        glUniform2f(glGetUniformLocation(upscaleProgramId, "renderRegion"), (float)RenderWidth / windowWidth, (float)RenderHeight / windowHeight);
+        glUniform1i(glGetUniformLocation(upscaleProgramId, "filterMode"), (int)Filter);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glBindVertexArray(emptyVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glEnable(GL_DEPTH_TEST);
+
+        // Read every finished query without waiting and steer the scale towards the budget
+        for (int i = 0; i < DYNAMIC_RESOLUTION_QUERIES; ++i)
+            collectQuery(i);
+    }
+
+private:
+    GLuint framebuffer;
+    GLuint colorTexture;
+    GLuint depthRenderbuffer;
+    GLuint emptyVao;
+    GLuint upscaleProgramId;
+    int windowWidth;
+    int windowHeight;
+    GLuint queries[DYNAMIC_RESOLUTION_QUERIES];
+    bool isQueryPending[DYNAMIC_RESOLUTION_QUERIES];
+    int queryIndex;
+
+    // reads a finished timer query and feeds it to the controller
+    void collectQuery(int index)
+    {
+        if (!isQueryPending[index])
+            return;
+
+        GLint isAvailable = GL_FALSE;
+        glGetQueryObjectiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (!isAvailable)
+            return;
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &nanoseconds);
+        isQueryPending[index] = false;
+
+        LastGpuMs = nanoseconds / 1.0e6f;
+        updateScale();
+    }
+
+    // GPU time is roughly proportional to the pixel count, so the scale moves by the square root of the ratio
+    void updateScale()
+    {
+        if (LastGpuMs <= 0.0f)
+            return;
+
+        float ideal = Scale * std::sqrt(TargetGpuMs / LastGpuMs);
+        float step = std::max(-DYNAMIC_RESOLUTION_MAX_STEP, std::min(DYNAMIC_RESOLUTION_MAX_STEP, ideal - Scale));
+        Scale = std::max(DYNAMIC_RESOLUTION_MIN_SCALE, std::min(DYNAMIC_RESOLUTION_MAX_SCALE, Scale + step));
+
+        updateRenderSize();
+    }
+
+    void updateRenderSize()
+    {
+        RenderWidth = std::max(1, (int)(windowWidth * Scale + 0.5f));
+        RenderHeight = std::max(1, (int)(windowHeight * Scale + 0.5f));
+    }
+
+    void destroyFramebuffer()
+    {
+        if (framebuffer)
+            glDeleteFramebuffers(1, &framebuffer);
+        if (colorTexture)
+            glDeleteTextures(1, &colorTexture);
+        if (depthRenderbuffer)
+            glDeleteRenderbuffers(1, &depthRenderbuffer);
+        framebuffer = colorTexture = depthRenderbuffer = 0;
+    }
+};
+#endif
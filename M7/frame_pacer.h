@@ -0,0 +1,179 @@
+#pragma once
+/* Frame pacing: swap interval, CPU frame-rate cap, GPU frames-in-flight limit and
+smoothed delta time.
+
+BeginFrame is called at the top of the render loop. It waits until the GPU has no more
+than MaxFramesInFlight frames queued, sleeps (then spins for the last few hundred
+microseconds) until the frame cap allows the next frame, and updates the delta times.
+OnPresent is called right after glfwSwapBuffers to fence the frame and measure the
+present-to-present interval and its jitter. OnIdle is called after the loop waited for
+events without rendering.
+*/
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <GL/glew.h>
+#include <glfw3.h>
+
+#include <chrono>
+#include <thread>
+#include <deque>
+#include <cmath>
+#include <algorithm>
+
+// Largest number of GPU frames that can be queued at once
+const int MAX_FRAMES_IN_FLIGHT = 3;
+
+// Time before a frame-cap deadline where the pacer stops sleeping and spins instead
+const double FRAME_CAP_SPIN_SECONDS = 0.002;
+
+// Weight of the newest frame in the smoothed delta time
+const float DELTA_TIME_SMOOTHING = 0.1f;
+
+// Deltas longer than this (breakpoints, window drags) are clamped so animations do not jump
+const float MAX_DELTA_TIME = 0.25f;
+
+class FramePacer
+{
+public:
+    // Settings
+    int SwapInterval;           // 0 = off, 1 = vsync, -1 = adaptive vsync when supported
+    double TargetFrameRate;     // CPU-side frame cap in frames per second, 0 for no cap
+    int MaxFramesInFlight;      // 1 to MAX_FRAMES_IN_FLIGHT
+    // Timing of the current frame in seconds
+    float RawDeltaTime;
+    float SmoothedDeltaTime;
+    double PresentInterval;     // time between the last two presents
+    double PresentJitter;       // change of PresentInterval from the frame before
+    // Statistics since the last call to ResetStatistics
+    int NumFrames;
+    int NumFenceWaits;          // frames that waited for the GPU to catch up
+    double SumJitter;
+    double MaxJitter;
+    double SumPresentInterval;
+
+    FramePacer() : SwapInterval(1), TargetFrameRate(0.0), MaxFramesInFlight(2), RawDeltaTime(0.0f), SmoothedDeltaTime(0.0f),
+        PresentInterval(0.0), PresentJitter(0.0), lastFrameStart(clock::now()), lastPresent(clock::now()), hasPresented(false)
+    {
+        ResetStatistics();
+    }
+
+    // sets the swap interval of the current context. Adaptive vsync falls back to regular vsync when it is not supported.
+    void SetSwapInterval(int interval)
+    {
+        if (interval < 0 && !IsAdaptiveVsyncSupported())
+            interval = 1;
+
+        SwapInterval = interval;
+        glfwSwapInterval(SwapInterval);
+    }
+
+    // returns true when the driver accepts a negative swap interval
+    bool IsAdaptiveVsyncSupported() const
+    {
+        return glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+    }
+
+    // limits the GPU queue, applies the frame cap and updates the delta times
+    void BeginFrame()
+    {
+        // Frames-in-flight limit: wait for the oldest frame while too many are queued on the GPU
+        while ((int)fences.size() >= MaxFramesInFlight)
+        {
+            GLenum result = glClientWaitSync(fences.front(), 0, 0);
+            if (result == GL_TIMEOUT_EXPIRED)
+            {
+                NumFenceWaits++;
+                do
+                {
+                    result = glClientWaitSync(fences.front(), GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+                } while (result == GL_TIMEOUT_EXPIRED);
+            }
+            glDeleteSync(fences.front());
+            fences.pop_front();
+        }
+
+        // Frame cap: sleep most of the remaining time, then spin to hit the deadline precisely
+        if (TargetFrameRate > 0.0)
+        {
+            clock::time_point deadline = lastFrameStart + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / TargetFrameRate));
+
+            double remaining = secondsBetween(clock::now(), deadline);
+            if (remaining > FRAME_CAP_SPIN_SECONDS)
+                std::this_thread::sleep_for(std::chrono::duration<double>(remaining - FRAME_CAP_SPIN_SECONDS));
+            while (clock::now() < deadline)
+                std::this_thread::yield();
+        }
+
+        // Delta time
+        clock::time_point now = clock::now();
+        RawDeltaTime = std::min((float)secondsBetween(lastFrameStart, now), MAX_DELTA_TIME);
+        lastFrameStart = now;
+
+        if (SmoothedDeltaTime <= 0.0f)
+            SmoothedDeltaTime = RawDeltaTime;
+        else
+            SmoothedDeltaTime += (RawDeltaTime - SmoothedDeltaTime) * DELTA_TIME_SMOOTHING;
+    }
+
+    // fences the frame that was just submitted and measures the present-to-present interval
+    void OnPresent()
+    {
+        fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+
+        clock::time_point now = clock::now();
+        if (hasPresented)
+        {
+            double interval = secondsBetween(lastPresent, now);
+            PresentJitter = NumFrames > 0 ? std::fabs(interval - PresentInterval) : 0.0;
+            PresentInterval = interval;
+
+            NumFrames++;
+            SumPresentInterval += PresentInterval;
+            SumJitter += PresentJitter;
+            MaxJitter = std::max(MaxJitter, PresentJitter);
+        }
+        lastPresent = now;
+        hasPresented = true;
+    }
+
+    // restarts the frame clocks after the loop slept waiting for events, so the idle time is neither a delta time nor a present interval
+    void OnIdle()
+    {
+        lastFrameStart = clock::now();
+        hasPresented = false;
+    }
+
+    // clears the accumulated statistics
+    void ResetStatistics()
+    {
+        NumFrames = 0;
+        NumFenceWaits = 0;
+        SumJitter = 0.0;
+        MaxJitter = 0.0;
+        SumPresentInterval = 0.0;
+    }
+
+    // deletes the outstanding fences
+    void Destroy()
+    {
+        for (GLsync fence : fences)
+            glDeleteSync(fence);
+        fences.clear();
+    }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    std::deque<GLsync> fences;  // one per frame still queued on the GPU, oldest first
+    clock::time_point lastFrameStart;
+    clock::time_point lastPresent;
+    bool hasPresented;
+
+    static double secondsBetween(clock::time_point from, clock::time_point to)
+    {
+        return std::chrono::duration<double>(to - from).count();
+    }
+};
+#endif
@@ -0,0 +1,329 @@
+#pragma once
+/* GPU timer-query profiler.
+
+Every scope writes a GL_TIMESTAMP query when it begins and another when it ends, so
+scopes can nest (a pass and the draws inside it) and no query object is ever active
+twice. Queries come from one pool per frame; a pool is read back GPU_PROFILER_FRAMES
+frames after it was written, by which time the results are normally available and the
+CPU never waits. A frame whose results are still missing is dropped instead.
+
+Each scope keeps the last GPU_PROFILER_HISTORY samples, from which min, average and
+99th percentile times are computed. DrawOverlay lists them on screen and WriteCsv /
+WriteJson save them to a file.
+*/
+
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <text_overlay.h>
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+// Frames between writing a query pool and reading it back
+const int GPU_PROFILER_FRAMES = 4;
+
+// Largest number of scopes per frame; scopes past this are not timed
+const int GPU_PROFILER_MAX_SCOPES = 128;
+
+// Number of samples per scope used for the statistics
+const int GPU_PROFILER_HISTORY = 240;
+
+// Largest nesting depth of scopes
+const int GPU_PROFILER_MAX_DEPTH = 8;
+
+class GpuProfiler
+{
+public:
+    struct ScopeStats
+    {
+        const char* Name;
+        int Parent;                 // index of the enclosing scope in Stats, -1 at the top level
+        int Depth;
+        std::vector<float> History; // milliseconds, oldest sample overwritten first
+        int NextSample;
+        int NumSamples;             // total samples ever recorded
+        float LastMs;
+        float MinMs;
+        float AvgMs;
+        float P99Ms;
+    };
+
+    bool IsEnabled;
+    // Scopes in the order they were first seen (use TreeOrder to list children under their parent)
+    std::vector<ScopeStats> Stats;
+    // Frames read back and frames dropped because their results were not ready
+    int NumFramesRead;
+    int NumFramesDropped;
+
+    GpuProfiler() : IsEnabled(false), NumFramesRead(0), NumFramesDropped(0), frameIndex(0), depth(0)
+    {
+        for (int i = 0; i < GPU_PROFILER_FRAMES; ++i)
+            frames[i].NumScopes = 0;
+    }
+
+    // allocates the query pools
+    void Create()
+    {
+        for (int i = 0; i < GPU_PROFILER_FRAMES; ++i)
+        {
+            frames[i].Queries.resize(GPU_PROFILER_MAX_SCOPES * 2);
+            frames[i].Scopes.resize(GPU_PROFILER_MAX_SCOPES);
+            glGenQueries(GPU_PROFILER_MAX_SCOPES * 2, frames[i].Queries.data());
+        }
+    }
+
+    // deletes the query pools
+    void Destroy()
+    {
+        for (int i = 0; i < GPU_PROFILER_FRAMES; ++i)
+        {
+            if (!frames[i].Queries.empty())
+                glDeleteQueries(GPU_PROFILER_MAX_SCOPES * 2, frames[i].Queries.data());
+            frames[i].Queries.clear();
+            frames[i].NumScopes = 0;
+        }
+    }
+
+    // reads back the oldest pool and starts writing into it. Call once before the first scope of a frame.
+    void BeginFrame()
+    {
+        frameIndex = (frameIndex + 1) % GPU_PROFILER_FRAMES;
+        depth = 0;
+
+        readFrame(frames[frameIndex]);
+        frames[frameIndex].NumScopes = 0;
+    }
+
+    // starts timing a scope. name must stay valid for the lifetime of the profiler (a string literal or an object name).
+    void BeginScope(const char* name)
+    {
+        if (!IsEnabled || frames[frameIndex].Queries.empty())
+            return;
+
+        FrameQueries& frame = frames[frameIndex];
+        int parent = depth > 0 ? openScopes[depth - 1] : -1;
+        int statsIndex = findStats(name, parent < 0 ? -1 : frame.Scopes[parent].StatsIndex);
+
+        if (depth < GPU_PROFILER_MAX_DEPTH)
+            openScopes[depth] = frame.NumScopes < GPU_PROFILER_MAX_SCOPES ? frame.NumScopes : -1;
+        depth++;
+
+        if (frame.NumScopes >= GPU_PROFILER_MAX_SCOPES || depth > GPU_PROFILER_MAX_DEPTH)
+            return;
+
+        frame.Scopes[frame.NumScopes].StatsIndex = statsIndex;
+        glQueryCounter(frame.Queries[frame.NumScopes * 2], GL_TIMESTAMP);
+        frame.NumScopes++;
+    }
+
+    // stops timing the innermost open scope
+    void EndScope()
+    {
+        if (!IsEnabled || depth == 0)
+            return;
+
+        depth--;
+        if (depth >= GPU_PROFILER_MAX_DEPTH || openScopes[depth] < 0)
+            return;
+
+        glQueryCounter(frames[frameIndex].Queries[openScopes[depth] * 2 + 1], GL_TIMESTAMP);
+    }
+
+    // returns the indices of Stats with every scope followed by its children
+    std::vector<int> TreeOrder() const
+    {
+        std::vector<int> order;
+        appendChildren(-1, order);
+        return order;
+    }
+
+    // clears every scope and its history
+    void Reset()
+    {
+        Stats.clear();
+        NumFramesRead = 0;
+        NumFramesDropped = 0;
+        for (int i = 0; i < GPU_PROFILER_FRAMES; ++i)
+            frames[i].NumScopes = 0;
+    }
+
+    // queues a table of every scope (indented by depth) on the text overlay
+    void DrawOverlay(TextOverlay& overlay, float x, float y) const
+    {
+        const glm::vec4 background(0.0f, 0.0f, 0.0f, 0.6f);
+        const glm::vec4 header(1.0f, 0.85f, 0.3f, 1.0f);
+        const glm::vec4 text(1.0f, 1.0f, 1.0f, 1.0f);
+
+        char line[128];
+        float lineHeight = overlay.LineHeight();
+        float width = overlay.TextWidth(std::string(52, ' '));
+
+        overlay.AddRect(x - 4.0f, y - 4.0f, width + 8.0f, lineHeight * (Stats.size() + 1) + 8.0f, background);
+
+        snprintf(line, sizeof(line), "%-28s %7s %7s %7s", "GPU (ms)", "min", "avg", "p99");
+        overlay.AddText(x, y, line, header);
+        y += lineHeight;
+
+        for (int index : TreeOrder())
+        {
+            const ScopeStats& scope = Stats[index];
+            std::string name = std::string(scope.Depth * 2, ' ') + scope.Name;
+            if (name.size() > 28)
+                name.resize(28);
+            snprintf(line, sizeof(line), "%-28s %7.3f %7.3f %7.3f", name.c_str(), scope.MinMs, scope.AvgMs, scope.P99Ms);
+            overlay.AddText(x, y, line, text);
+            y += lineHeight;
+        }
+    }
+
+    // writes one row per scope with its statistics. Returns false when the file can not be opened.
+    bool WriteCsv(const char* path) const
+    {
+        FILE* file = fopen(path, "w");
+        if (!file)
+            return false;
+
+        fprintf(file, "scope,parent,depth,samples,last_ms,min_ms,avg_ms,p99_ms\n");
+        for (int index : TreeOrder())
+        {
+            const ScopeStats& scope = Stats[index];
+            fprintf(file, "\"%s\",\"%s\",%d,%d,%.4f,%.4f,%.4f,%.4f\n", scope.Name, scope.Parent >= 0 ? Stats[scope.Parent].Name : "",
+                scope.Depth, scope.NumSamples, scope.LastMs, scope.MinMs, scope.AvgMs, scope.P99Ms);
+        }
+
+        fclose(file);
+        return true;
+    }
+
+    // writes the statistics and the sample window of every scope. Returns false when the file can not be opened.
+    bool WriteJson(const char* path) const
+    {
+        FILE* file = fopen(path, "w");
+        if (!file)
+            return false;
+
+        fprintf(file, "{\n  \"framesRead\": %d,\n  \"framesDropped\": %d,\n  \"scopes\": [", NumFramesRead, NumFramesDropped);
+        std::vector<int> order = TreeOrder();
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            const ScopeStats& scope = Stats[order[i]];
+            fprintf(file, "%s\n    { \"name\": \"%s\", \"parent\": %d, \"depth\": %d, \"samples\": %d, \"minMs\": %.4f, \"avgMs\": %.4f, \"p99Ms\": %.4f, \"history\": [",
+                i > 0 ? "," : "", scope.Name, scope.Parent, scope.Depth, scope.NumSamples, scope.MinMs, scope.AvgMs, scope.P99Ms);
+
+            // Oldest sample first
+            int count = std::min(scope.NumSamples, GPU_PROFILER_HISTORY);
+            int first = scope.NumSamples > GPU_PROFILER_HISTORY ? scope.NextSample : 0;
+            for (int j = 0; j < count; ++j)
+                fprintf(file, "%s%.4f", j > 0 ? ", " : "", scope.History[(first + j) % GPU_PROFILER_HISTORY]);
+            fprintf(file, "] }");
+        }
+        fprintf(file, "\n  ]\n}\n");
+
+        fclose(file);
+        return true;
+    }
+
+private:
+    struct ScopeQuery
+    {
+        int StatsIndex;
+    };
+
+    struct FrameQueries
+    {
+        std::vector<GLuint> Queries;    // begin and end timestamp of each scope
+        std::vector<ScopeQuery> Scopes;
+        int NumScopes;
+    };
+
+    FrameQueries frames[GPU_PROFILER_FRAMES];
+    int frameIndex;
+    int openScopes[GPU_PROFILER_MAX_DEPTH]; // scope slots of the current frame that have not ended, -1 when untimed
+    int depth;
+    std::vector<float> sortScratch;
+
+    // returns the statistics entry of a scope, adding it the first time it is seen
+    int findStats(const char* name, int parent)
+    {
+        for (size_t i = 0; i < Stats.size(); ++i)
+            if (Stats[i].Parent == parent && (Stats[i].Name == name || strcmp(Stats[i].Name, name) == 0))
+                return (int)i;
+
+        ScopeStats scope;
+        scope.Name = name;
+        scope.Parent = parent;
+        scope.Depth = parent < 0 ? 0 : Stats[parent].Depth + 1;
+        scope.History.assign(GPU_PROFILER_HISTORY, 0.0f);
+        scope.NextSample = 0;
+        scope.NumSamples = 0;
+        scope.LastMs = scope.MinMs = scope.AvgMs = scope.P99Ms = 0.0f;
+
+        Stats.push_back(scope);
+        return (int)Stats.size() - 1;
+    }
+
+    void appendChildren(int parent, std::vector<int>& order) const
+    {
+        for (size_t i = 0; i < Stats.size(); ++i)
+        {
+            if (Stats[i].Parent != parent)
+                continue;
+            order.push_back((int)i);
+            appendChildren((int)i, order);
+        }
+    }
+
+    // collects the timestamps of a finished frame without waiting for the GPU
+    void readFrame(FrameQueries& frame)
+    {
+        if (frame.NumScopes == 0)
+            return;
+
+        GLint isAvailable = GL_FALSE;
+        glGetQueryObjectiv(frame.Queries[frame.NumScopes * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (!isAvailable)
+        {
+            NumFramesDropped++;
+            return;
+        }
+
+        for (int i = 0; i < frame.NumScopes; ++i)
+        {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(frame.Queries[i * 2], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.Queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+            addSample(Stats[frame.Scopes[i].StatsIndex], end > begin ? (end - begin) / 1.0e6f : 0.0f);
+        }
+        NumFramesRead++;
+    }
+
+    void addSample(ScopeStats& scope, float ms)
+    {
+        scope.LastMs = ms;
+        scope.History[scope.NextSample] = ms;
+        scope.NextSample = (scope.NextSample + 1) % GPU_PROFILER_HISTORY;
+        scope.NumSamples++;
+
+        int count = std::min(scope.NumSamples, GPU_PROFILER_HISTORY);
+        sortScratch.assign(scope.History.begin(), scope.History.begin() + count);
+
+        float sum = 0.0f;
+        for (float sample : sortScratch)
+            sum += sample;
+        scope.AvgMs = sum / count;
+        scope.MinMs = *std::min_element(sortScratch.begin(), sortScratch.end());
+
+        std::vector<float>::iterator p99 = sortScratch.begin() + std::min(count - 1, (int)(count * 0.99f));
+        std::nth_element(sortScratch.begin(), p99, sortScratch.end());
+        scope.P99Ms = *p99;
+    }
+};
+#endif
@@ -0,0 +1,286 @@
+#pragma once
+/* Headless rendering: an OpenGL context without a visible window and an offscreen
+framebuffer the scene is rendered into.
+
+When HEADLESS_USE_EGL is defined (Linux build agents), the context is a surfaceless EGL
+context, which Mesa provides without a display server or GPU (llvmpipe). Otherwise a
+hidden GLFW window is created only to own the context; nothing is ever shown.
+
+Command-line options (all optional after --headless):
+    --size WIDTHxHEIGHT     resolution of the offscreen framebuffer (default 1280x720)
+    --frames N              frames rendered before the image is captured (default 3)
+    --output PATH           PNG written with the last frame (default headless.png)
+    --golden PATH           reference image the frame is compared with
+    --diff PATH             PNG marking the pixels that differ from the reference
+    --threshold T           per-pixel perceptual threshold, 0 to 1
+    --max-diff F            fraction of pixels allowed to differ
+*/
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <GL/glew.h>
+#include <glfw3.h>
+
+#ifdef HEADLESS_USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <image_diff.h>
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+struct HeadlessOptions
+{
+    bool IsEnabled;
+    int Width;
+    int Height;
+    int NumFrames;
+    std::string OutputPath;
+    std::string GoldenPath;
+    std::string DiffPath;
+    float Threshold;
+    float MaxDifferentFraction;
+
+    HeadlessOptions() : IsEnabled(false), Width(1280), Height(720), NumFrames(3), OutputPath("headless.png"),
+        Threshold(IMAGE_DIFF_THRESHOLD), MaxDifferentFraction(IMAGE_DIFF_MAX_FRACTION) {}
+
+    // reads the options from the command line. Returns false (after printing the problem) when an option is invalid.
+    bool Parse(int argc, char* argv[])
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const char* option = argv[i];
+            const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+            if (strcmp(option, "--headless") == 0)
+            {
+                IsEnabled = true;
+                continue;
+            }
+
+            if (!value)
+            {
+                fprintf(stderr, "Missing value for %s\n", option);
+                return false;
+            }
+
+            if (strcmp(option, "--size") == 0)
+            {
+                if (sscanf(value, "%dx%d", &Width, &Height) != 2 || Width <= 0 || Height <= 0)
+                {
+                    fprintf(stderr, "Invalid size %s, expected WIDTHxHEIGHT\n", value);
+                    return false;
+                }
+            }
+            else if (strcmp(option, "--frames") == 0)
+                NumFrames = std::max(1, atoi(value));
+            else if (strcmp(option, "--output") == 0)
+                OutputPath = value;
+            else if (strcmp(option, "--golden") == 0)
+                GoldenPath = value;
+            else if (strcmp(option, "--diff") == 0)
+                DiffPath = value;
+            else if (strcmp(option, "--threshold") == 0)
+                Threshold = (float)atof(value);
+            else if (strcmp(option, "--max-diff") == 0)
+                MaxDifferentFraction = (float)atof(value);
+            else
+            {
+                fprintf(stderr, "Unknown option %s\n", option);
+                return false;
+            }
+            ++i;
+        }
+        return true;
+    }
+};
+
+class HeadlessContext
+{
+public:
+    HeadlessContext() : window(nullptr)
+#ifdef HEADLESS_USE_EGL
+        , display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT)
+#endif
+    {}
+
+    // creates an OpenGL core context of the given version, makes it current and loads the entry points with GLEW
+    bool Create(int majorVersion, int minorVersion)
+    {
+#ifdef HEADLESS_USE_EGL
+        // Prefer the surfaceless platform, which needs no display server at all
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major = 0, minor = 0;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            fprintf(stderr, "Failed to initialize EGL\n");
+            return false;
+        }
+
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config;
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0 || !eglBindAPI(EGL_OPENGL_API))
+        {
+            fprintf(stderr, "No EGL configuration supports desktop OpenGL\n");
+            return false;
+        }
+
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, majorVersion,
+            EGL_CONTEXT_MINOR_VERSION, minorVersion,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            fprintf(stderr, "Failed to create a surfaceless OpenGL %d.%d context\n", majorVersion, minorVersion);
+            return false;
+        }
+
+        // glewInit also initializes GLX, which fails without an X display; only the GL entry points are needed
+        glewExperimental = GL_TRUE;
+        GLenum result = glewContextInit();
+#else
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, majorVersion);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minorVersion);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+        window = glfwCreateWindow(1, 1, "", NULL, NULL);
+        if (!window)
+        {
+            fprintf(stderr, "Failed to create a hidden GLFW window\n");
+            glfwTerminate();
+            return false;
+        }
+        glfwMakeContextCurrent(window);
+
+        glewExperimental = GL_TRUE;
+        GLenum result = glewInit();
+#endif
+        if (result != GLEW_OK)
+        {
+            fprintf(stderr, "%s\n", (const char*)glewGetErrorString(result));
+            return false;
+        }
+        return true;
+    }
+
+    // releases the context
+    void Destroy()
+    {
+#ifdef HEADLESS_USE_EGL
+        if (display != EGL_NO_DISPLAY)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+        }
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+#else
+        if (window)
+        {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
+        window = nullptr;
+#endif
+    }
+
+private:
+    GLFWwindow* window;
+#ifdef HEADLESS_USE_EGL
+    EGLDisplay display;
+    EGLContext context;
+#endif
+};
+
+// Color and depth framebuffer that stands in for the window
+class OffscreenTarget
+{
+public:
+    GLuint Framebuffer;
+    int Width;
+    int Height;
+
+    OffscreenTarget() : Framebuffer(0), Width(0), Height(0), colorRenderbuffer(0), depthRenderbuffer(0) {}
+
+    bool Create(int width, int height)
+    {
+        Width = width;
+        Height = height;
+
+        glGenRenderbuffers(1, &colorRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &depthRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &Framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+        bool isComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        return isComplete;
+    }
+
+    void Destroy()
+    {
+        glDeleteFramebuffers(1, &Framebuffer);
+        glDeleteRenderbuffers(1, &colorRenderbuffer);
+        glDeleteRenderbuffers(1, &depthRenderbuffer);
+        Framebuffer = colorRenderbuffer = depthRenderbuffer = 0;
+    }
+
+    // returns the color buffer as RGBA, top row first
+    std::vector<unsigned char> ReadPixels() const
+    {
+        std::vector<unsigned char> pixels((size_t)Width * Height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, Framebuffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+        // OpenGL rows start at the bottom
+        size_t rowSize = (size_t)Width * 4;
+        std::vector<unsigned char> row(rowSize);
+        for (int y = 0; y < Height / 2; ++y)
+        {
+            unsigned char* top = &pixels[y * rowSize];
+            unsigned char* bottom = &pixels[(Height - 1 - y) * rowSize];
+            memcpy(row.data(), top, rowSize);
+            memcpy(top, bottom, rowSize);
+            memcpy(bottom, row.data(), rowSize);
+        }
+        return pixels;
+    }
+
+private:
+    GLuint colorRenderbuffer;
+    GLuint depthRenderbuffer;
+};
+#endif
@@ -0,0 +1,206 @@
+#pragma once
+/* PNG output and perceptual image comparison for regression runs.
+
+WritePng saves 8-bit RGBA pixels (top row first) as an uncompressed PNG, so no image
+library is needed to write; stb_image reads the golden images back.
+
+CompareImages measures the color difference of every pixel in the YIQ space, weighted
+the way the eye perceives luma and chroma. A pixel counts as different when the delta
+is above threshold (0 to 1 of the largest possible delta, applied to the square root so
+it behaves like a distance). Images are considered a match when the fraction of
+different pixels is at most IMAGE_DIFF_MAX_FRACTION (or a limit chosen by the caller).
+*/
+
+#ifndef IMAGE_DIFF_H
+#define IMAGE_DIFF_H
+
+#include <stb_image.h>
+
+#include <vector>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+// Default per-pixel threshold and share of pixels allowed to differ
+const float IMAGE_DIFF_THRESHOLD = 0.1f;
+const float IMAGE_DIFF_MAX_FRACTION = 0.001f;
+
+struct ImageComparison
+{
+    bool IsSizeMatching;
+    int NumDifferentPixels;
+    float DifferentFraction;
+    float MaxDelta;             // largest pixel delta, 0 to 1
+    std::vector<unsigned char> DiffImage; // RGBA: different pixels in red over a faded copy of the expected image
+};
+
+namespace ImageDiff
+{
+    inline unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0)
+    {
+        static unsigned int table[256];
+        static bool isTableBuilt = false;
+        if (!isTableBuilt)
+        {
+            for (unsigned int n = 0; n < 256; ++n)
+            {
+                unsigned int c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            isTableBuilt = true;
+        }
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    inline void appendBigEndian(std::vector<unsigned char>& out, unsigned int value)
+    {
+        out.push_back((value >> 24) & 0xFF);
+        out.push_back((value >> 16) & 0xFF);
+        out.push_back((value >> 8) & 0xFF);
+        out.push_back(value & 0xFF);
+    }
+
+    inline void writeChunk(FILE* file, const char* type, const std::vector<unsigned char>& data)
+    {
+        std::vector<unsigned char> chunk;
+        appendBigEndian(chunk, (unsigned int)data.size());
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        appendBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+        fwrite(chunk.data(), 1, chunk.size(), file);
+    }
+
+    // YIQ delta of two RGB colors, 0 to 35215
+    inline float colorDelta(const unsigned char* a, const unsigned char* b)
+    {
+        float r = (float)a[0] - b[0], g = (float)a[1] - b[1], bl = (float)a[2] - b[2];
+        float y = r * 0.29889531f + g * 0.58662247f + bl * 0.11448223f;
+        float i = r * 0.59597799f - g * 0.27417610f - bl * 0.32180189f;
+        float q = r * 0.21147017f - g * 0.52261711f + bl * 0.31114694f;
+        return 0.5053f * y * y + 0.299f * i * i + 0.1957f * q * q;
+    }
+}
+
+// writes width x height RGBA pixels, top row first. Returns false when the file can not be written.
+inline bool WritePng(const char* path, int width, int height, const std::vector<unsigned char>& rgba)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(signature, 1, sizeof(signature), file);
+
+    std::vector<unsigned char> header;
+    ImageDiff::appendBigEndian(header, width);
+    ImageDiff::appendBigEndian(header, height);
+    header.push_back(8);    // bit depth
+    header.push_back(6);    // RGBA
+    header.push_back(0);    // deflate
+    header.push_back(0);    // adaptive filtering
+    header.push_back(0);    // no interlace
+    ImageDiff::writeChunk(file, "IHDR", header);
+
+    // Scanlines with filter type 0, wrapped in a zlib stream of stored (uncompressed) deflate blocks
+    std::vector<unsigned char> scanlines;
+    scanlines.reserve((size_t)(width * 4 + 1) * height);
+    for (int y = 0; y < height; ++y)
+    {
+        scanlines.push_back(0);
+        scanlines.insert(scanlines.end(), rgba.begin() + (size_t)y * width * 4, rgba.begin() + (size_t)(y + 1) * width * 4);
+    }
+
+    std::vector<unsigned char> zlib;
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    const size_t MAX_BLOCK = 65535;
+    size_t offset = 0;
+    do
+    {
+        size_t size = std::min(MAX_BLOCK, scanlines.size() - offset);
+        zlib.push_back(offset + size == scanlines.size() ? 1 : 0); // last block flag
+        zlib.push_back(size & 0xFF);
+        zlib.push_back((size >> 8) & 0xFF);
+        zlib.push_back(~size & 0xFF);
+        zlib.push_back((~size >> 8) & 0xFF);
+        zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + size);
+        offset += size;
+    } while (offset < scanlines.size());
+
+    unsigned int a = 1, b = 0;
+    for (unsigned char byte : scanlines)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    ImageDiff::appendBigEndian(zlib, (b << 16) | a);
+
+    ImageDiff::writeChunk(file, "IDAT", zlib);
+    ImageDiff::writeChunk(file, "IEND", std::vector<unsigned char>());
+
+    bool isWritten = ferror(file) == 0;
+    fclose(file);
+    return isWritten;
+}
+
+// loads an image as RGBA, top row first. Returns false when it can not be read.
+inline bool LoadRgba(const char* path, int& width, int& height, std::vector<unsigned char>& rgba)
+{
+    int channels = 0;
+    unsigned char* pixels = stbi_load(path, &width, &height, &channels, 4);
+    if (!pixels)
+        return false;
+
+    rgba.assign(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+    return true;
+}
+
+// compares two RGBA images of the same size, pixel by pixel
+inline ImageComparison CompareImages(const std::vector<unsigned char>& actual, const std::vector<unsigned char>& expected, int width, int height,
+    float threshold = IMAGE_DIFF_THRESHOLD)
+{
+    const float MAX_YIQ_DELTA = 35215.0f;
+
+    ImageComparison result;
+    result.NumDifferentPixels = 0;
+    result.DifferentFraction = 0.0f;
+    result.MaxDelta = 0.0f;
+    result.IsSizeMatching = actual.size() == expected.size() && actual.size() == (size_t)width * height * 4;
+    if (!result.IsSizeMatching)
+        return result;
+
+    float maxAllowed = MAX_YIQ_DELTA * threshold * threshold;
+    result.DiffImage.resize(actual.size());
+    for (size_t pixel = 0; pixel < (size_t)width * height; ++pixel)
+    {
+        const unsigned char* a = &actual[pixel * 4];
+        const unsigned char* e = &expected[pixel * 4];
+        unsigned char* d = &result.DiffImage[pixel * 4];
+
+        float delta = ImageDiff::colorDelta(a, e);
+        result.MaxDelta = std::max(result.MaxDelta, std::sqrt(delta / MAX_YIQ_DELTA));
+
+        if (delta > maxAllowed)
+        {
+            result.NumDifferentPixels++;
+            d[0] = 255; d[1] = 0; d[2] = 0;
+        }
+        else
+        {
+            unsigned char gray = (unsigned char)(255 - (255 - (e[0] * 0.299f + e[1] * 0.587f + e[2] * 0.114f)) * 0.1f);
+            d[0] = d[1] = d[2] = gray;
+        }
+        d[3] = 255;
+    }
+
+    result.DifferentFraction = (float)result.NumDifferentPixels / (width * height);
+    return result;
+}
+#endif
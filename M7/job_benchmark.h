@@ -0,0 +1,204 @@
+#pragma once
+/* Microbenchmarks of the job system.
+
+Run with --job-benchmark before anything else is initialized; the program prints the
+results and exits. Three measurements:
+
+    overhead    empty jobs submitted and waited for in groups, in nanoseconds per job, and an
+                empty ParallelFor call with one batch per thread, in microseconds per call
+    chain       jobs that each depend on the previous one, in nanoseconds per link (the
+                latency from one job finishing to the next one starting)
+    scaling     normal matrices of JOB_BENCHMARK_MATRICES model matrices (the per-object
+                work of the renderer) with 1, 2, 4, ... threads, as speedup and efficiency
+                over a single thread
+
+Command-line options:
+    --job-benchmark         run the benchmarks and exit
+    --job-threads N         largest thread count of the scaling test (default: hardware threads, at most 64)
+*/
+
+#ifndef JOB_BENCHMARK_H
+#define JOB_BENCHMARK_H
+
+#include <job_system.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+
+// Model matrices transformed by the scaling test
+const int JOB_BENCHMARK_MATRICES = 1 << 18;
+
+// Items per ParallelFor batch of the scaling test
+const int JOB_BENCHMARK_BATCH = 512;
+
+// Empty jobs submitted before waiting for them, well within the job pool of a thread
+const int JOB_BENCHMARK_GROUP = JOB_QUEUE_CAPACITY / 2;
+
+struct JobBenchmarkOptions
+{
+    bool IsEnabled;
+    int MaxThreads;
+
+    JobBenchmarkOptions() : IsEnabled(false), MaxThreads(0) {}
+
+    // reads the job benchmark options and removes them from argv so other parsers do not see them. Returns false when an option is invalid.
+    bool Parse(int& argc, char* argv[])
+    {
+        int kept = 1;
+        for (int i = 1; i < argc; ++i)
+        {
+            const char* option = argv[i];
+            if (strcmp(option, "--job-benchmark") == 0)
+                IsEnabled = true;
+            else if (strcmp(option, "--job-threads") == 0)
+            {
+                if (i + 1 >= argc)
+                {
+                    fprintf(stderr, "Missing value for %s\n", option);
+                    return false;
+                }
+                MaxThreads = atoi(argv[++i]);
+                if (MaxThreads < 1 || MaxThreads > JOB_MAX_WORKERS + 1)
+                {
+                    fprintf(stderr, "--job-threads expects 1 to %d threads\n", JOB_MAX_WORKERS + 1);
+                    return false;
+                }
+            }
+            else
+                argv[kept++] = argv[i];
+        }
+        argc = kept;
+        return true;
+    }
+};
+
+namespace JobBenchmark
+{
+    typedef std::chrono::steady_clock clock;
+
+    inline double secondsSince(clock::time_point start)
+    {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    inline void emptyJob(Job&)
+    {
+    }
+
+    // nanoseconds per empty job submitted with Run and waited for in groups
+    inline double measureJobOverhead(JobSystem& jobs, int numJobs)
+    {
+        clock::time_point start = clock::now();
+        for (int submitted = 0; submitted < numJobs; submitted += JOB_BENCHMARK_GROUP)
+        {
+            JobCounter counter;
+            for (int i = 0; i < JOB_BENCHMARK_GROUP; ++i)
+                jobs.Run(jobs.CreateJob(&emptyJob), &counter);
+            jobs.Wait(counter);
+        }
+        return secondsSince(start) * 1e9 / numJobs;
+    }
+
+    // microseconds per ParallelFor call whose batches do nothing
+    inline double measureParallelForOverhead(JobSystem& jobs, int numCalls)
+    {
+        int count = jobs.NumThreads() * 4;
+        clock::time_point start = clock::now();
+        for (int call = 0; call < numCalls; ++call)
+            jobs.ParallelFor(count, 4, [](int, int) {});
+        return secondsSince(start) * 1e6 / numCalls;
+    }
+
+    // nanoseconds from one job of a dependency chain finishing to the next one finishing
+    inline double measureChainLatency(JobSystem& jobs, int numLinks, int numChains)
+    {
+        std::vector<JobCounter> counters(numLinks);
+        clock::time_point start = clock::now();
+        for (int chain = 0; chain < numChains; ++chain)
+        {
+            for (int link = 0; link < numLinks; ++link)
+                jobs.Run(jobs.CreateJob(&emptyJob), &counters[link], link > 0 ? &counters[link - 1] : nullptr);
+            jobs.Wait(counters[numLinks - 1]);
+        }
+        return secondsSince(start) * 1e9 / ((double)numLinks * numChains);
+    }
+
+    // seconds to compute the normal matrices of models, the best of several runs
+    inline double measureNormalMatrices(JobSystem& jobs, const std::vector<glm::mat4>& models, std::vector<glm::mat4>& normals)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 5; ++run)
+        {
+            clock::time_point start = clock::now();
+            jobs.ParallelFor((int)models.size(), JOB_BENCHMARK_BATCH, [&](int begin, int end)
+            {
+                for (int i = begin; i < end; ++i)
+                    normals[i] = glm::transpose(glm::inverse(models[i]));
+            });
+            best = std::min(best, secondsSince(start));
+        }
+        return best;
+    }
+}
+
+// runs the benchmarks and prints the results. Returns the exit code of the program.
+inline int RunJobBenchmark(const JobBenchmarkOptions& options)
+{
+    using namespace JobBenchmark;
+
+    int hardwareThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    int maxThreads = options.MaxThreads > 0 ? options.MaxThreads : std::min(hardwareThreads, JOB_MAX_WORKERS + 1);
+    printf("Job system benchmark: %d hardware threads, scaling up to %d threads\n\n", hardwareThreads, maxThreads);
+
+    // Scheduling overhead with every hardware thread
+    {
+        std::unique_ptr<JobSystem> jobs(new JobSystem());
+        jobs->Create(maxThreads - 1);
+        measureJobOverhead(*jobs, JOB_BENCHMARK_GROUP * 16); // warm-up
+
+        printf("Overhead (%d threads)\n", jobs->NumThreads());
+        printf("    empty job               %8.1f ns\n", measureJobOverhead(*jobs, JOB_BENCHMARK_GROUP * 512));
+        printf("    empty ParallelFor       %8.2f us\n", measureParallelForOverhead(*jobs, 20000));
+        printf("    dependency chain link   %8.1f ns\n\n", measureChainLatency(*jobs, 256, 200));
+        jobs->Destroy();
+    }
+
+    // Scaling of the per-object matrix work
+    std::vector<glm::mat4> models(JOB_BENCHMARK_MATRICES);
+    std::vector<glm::mat4> normals(JOB_BENCHMARK_MATRICES);
+    for (int i = 0; i < JOB_BENCHMARK_MATRICES; ++i)
+    {
+        glm::vec3 position((float)(i % 100), 0.0f, (float)(i / 100));
+        models[i] = glm::translate(position) * glm::rotate(i * 0.001f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::vec3(1.0f + (i % 7) * 0.1f));
+    }
+
+    printf("Scaling (%d normal matrices, %d per batch)\n", JOB_BENCHMARK_MATRICES, JOB_BENCHMARK_BATCH);
+    printf("    threads       ms   speedup   efficiency\n");
+    double singleThread = 0.0;
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+    {
+        std::unique_ptr<JobSystem> jobs(new JobSystem());
+        jobs->Create(threads - 1);
+        double seconds = measureNormalMatrices(*jobs, models, normals);
+        jobs->Destroy();
+
+        if (threads == 1)
+            singleThread = seconds;
+        double speedup = singleThread / seconds;
+        printf("    %7d %8.2f %9.2f %11.0f%%%s\n", threads, seconds * 1000.0, speedup, speedup / threads * 100.0,
+               threads > hardwareThreads ? "   (oversubscribed)" : "");
+
+        if (threads == maxThreads)
+            break;
+    }
+    return EXIT_SUCCESS;
+}
+#endif
@@ -0,0 +1,423 @@
+#pragma once
+/* Work-stealing job system.
+
+Every thread that runs jobs owns a slot with a fixed pool of jobs and a Chase-Lev deque:
+the owner pushes and pops at the bottom without locks while idle threads steal from the
+top of other slots. Create starts one worker per hardware thread besides the calling
+thread, which owns slot 0 and runs jobs whenever it waits. Other threads that want to
+submit jobs (for example a render thread) call RegisterThread first.
+
+A JobCounter counts the unfinished jobs of a group. Wait(counter) runs jobs (its own or
+stolen ones) until the counter reaches zero, so waiting never blocks a core. A job can be
+made to depend on a counter: it is only queued once that counter has reached zero.
+
+ParallelFor(count, batchSize, function) calls function(begin, end) on batches of the
+range [0, count) spread over every thread and returns when all of them are done. Called
+from a thread without a slot, it runs the whole range on that thread.
+
+A thread takes part in one job system at a time.
+
+Idle workers spin briefly and then sleep until a job is queued, so an idle program does
+not use CPU time.
+*/
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <cpu_trace.h>
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+// Jobs each slot can have in flight (a power of two)
+const int JOB_QUEUE_CAPACITY = 1024;
+
+// Upper limits of the worker threads and of the other threads that can register at once
+const int JOB_MAX_WORKERS = 64;
+const int JOB_MAX_EXTERNAL_THREADS = 4;
+
+// Failed attempts to find a job before an idle worker goes to sleep
+const int JOB_IDLE_SPINS = 256;
+
+struct JobCounter;
+
+struct Job
+{
+    void (*Function)(Job& job);
+    void* Data;
+    int Begin;              // range of a ParallelFor batch, free for other jobs to use
+    int End;
+    JobCounter* Counter;    // decremented when the job has run
+};
+
+struct JobCounter
+{
+    std::atomic<int> Pending;
+    std::atomic<int> Finishing;     // threads still touching the counter after their job ran
+    std::mutex Mutex;               // protects Waiting
+    std::vector<Job*> Waiting;      // jobs queued once Pending reaches zero
+
+    JobCounter() : Pending(0), Finishing(0) {}
+};
+
+class JobSystem
+{
+public:
+    JobSystem() : numWorkers(0), isRunning(false), numQueued(0), numSleeping(0)
+    {
+        for (int i = 0; i < MAX_SLOTS; ++i)
+            slots[i].IsUsed.store(false);
+    }
+
+    ~JobSystem()
+    {
+        Destroy();
+    }
+
+    // starts the workers. numWorkers < 0 uses one per hardware thread besides the calling thread, which gets slot 0.
+    void Create(int workers = -1)
+    {
+        if (workers < 0)
+            workers = (int)std::thread::hardware_concurrency() - 1;
+        numWorkers = std::max(0, std::min(workers, JOB_MAX_WORKERS));
+
+        claimSlot(0);
+        isRunning.store(true);
+        for (int i = 1; i <= numWorkers; ++i)
+        {
+            slots[i].IsUsed.store(true);
+            threads.push_back(std::thread(&JobSystem::workerMain, this, i));
+        }
+    }
+
+    // stops the workers once the queued jobs are done
+    void Destroy()
+    {
+        if (!isRunning.load())
+            return;
+
+        isRunning.store(false);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wakeUp.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+        threads.clear();
+
+        releaseSlot();
+        for (int i = 0; i < MAX_SLOTS; ++i)
+            slots[i].IsUsed.store(false);
+    }
+
+    // threads that run jobs: the workers and the thread that called Create
+    int NumThreads() const
+    {
+        return numWorkers + 1;
+    }
+
+    // gives the calling thread a slot so it can submit and wait for jobs. Returns false when every slot is taken.
+    bool RegisterThread()
+    {
+        for (int i = numWorkers + 1; i < MAX_SLOTS; ++i)
+        {
+            bool isUsed = false;
+            if (slots[i].IsUsed.compare_exchange_strong(isUsed, true))
+            {
+                claimSlot(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // releases the slot of the calling thread; its jobs must be finished
+    void UnregisterThread()
+    {
+        int slot = currentSlot();
+        if (slot > numWorkers)
+        {
+            releaseSlot();
+            slots[slot].IsUsed.store(false);
+        }
+    }
+
+    // returns a job from the pool of the calling thread, which needs a slot. It stays valid until it has run, as long as
+    // the thread does not have more than JOB_QUEUE_CAPACITY jobs in flight.
+    Job* CreateJob(void (*function)(Job& job), void* data = nullptr, int begin = 0, int end = 0)
+    {
+        Slot& slot = slots[currentSlot()];
+        Job* job = &slot.Jobs[slot.NextJob++ & (JOB_QUEUE_CAPACITY - 1)];
+        job->Function = function;
+        job->Data = data;
+        job->Begin = begin;
+        job->End = end;
+        job->Counter = nullptr;
+        return job;
+    }
+
+    // queues a job. counter (optional) is incremented now and decremented when the job has run;
+    // the job is only queued once dependency (optional) has reached zero.
+    void Run(Job* job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr)
+    {
+        job->Counter = counter;
+        if (counter)
+            counter->Pending.fetch_add(1);
+
+        if (dependency)
+        {
+            std::lock_guard<std::mutex> lock(dependency->Mutex);
+            if (dependency->Pending.load() > 0)
+            {
+                dependency->Waiting.push_back(job);
+                return;
+            }
+        }
+        enqueue(job);
+    }
+
+    // runs jobs until counter reaches zero; the counter can be destroyed afterwards
+    void Wait(JobCounter& counter)
+    {
+        while (counter.Pending.load() > 0 || counter.Finishing.load() > 0)
+        {
+            Job* job = findJob(currentSlot());
+            if (job)
+                execute(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // calls function(begin, end) on batches of at most batchSize items of [0, count) on every thread and waits for them
+    template <typename Function>
+    void ParallelFor(int count, int batchSize, const Function& function)
+    {
+        if (count <= 0)
+            return;
+
+        // Without a slot or workers, or with a single batch, the caller does everything
+        batchSize = std::max(1, batchSize);
+        if (currentSlot() < 0 || numWorkers == 0 || count <= batchSize)
+        {
+            function(0, count);
+            return;
+        }
+
+        // Keep the number of batches well within the job pool
+        int numBatches = (count + batchSize - 1) / batchSize;
+        const int maxBatches = JOB_QUEUE_CAPACITY / 4;
+        if (numBatches > maxBatches)
+        {
+            batchSize = (count + maxBatches - 1) / maxBatches;
+            numBatches = (count + batchSize - 1) / batchSize;
+        }
+
+        JobCounter counter;
+        for (int batch = 0; batch < numBatches; ++batch)
+        {
+            int begin = batch * batchSize;
+            Run(CreateJob(&invokeRange<Function>, (void*)&function, begin, std::min(count, begin + batchSize)), &counter);
+        }
+        Wait(counter);
+    }
+
+private:
+    static const int MAX_SLOTS = JOB_MAX_WORKERS + 1 + JOB_MAX_EXTERNAL_THREADS;
+
+    // Jobs and deque of one thread. Only the owner pushes and pops; other threads steal.
+    struct Slot
+    {
+        std::atomic<bool> IsUsed;
+        Job Jobs[JOB_QUEUE_CAPACITY];
+        unsigned int NextJob;
+        std::atomic<Job*> Queue[JOB_QUEUE_CAPACITY];
+        alignas(64) std::atomic<long long> Top;     // thieves take from here
+        alignas(64) std::atomic<long long> Bottom;  // the owner pushes and pops here
+
+        Slot() : NextJob(0), Top(0), Bottom(0) {}
+    };
+
+    int numWorkers;
+    std::vector<std::thread> threads;
+    std::atomic<bool> isRunning;
+    Slot slots[MAX_SLOTS];
+    // Sleeping: numQueued counts jobs in the deques, numSleeping the workers waiting on wakeUp
+    std::atomic<int> numQueued;
+    std::atomic<int> numSleeping;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+
+    template <typename Function>
+    static void invokeRange(Job& job)
+    {
+        (*(const Function*)job.Data)(job.Begin, job.End);
+    }
+
+    // slot index of the calling thread, -1 when it has none
+    static int& currentSlot()
+    {
+        static thread_local int slot = -1;
+        return slot;
+    }
+
+    // Top and Bottom are never reset: a thief may still be reading them while the slot changes hands
+    void claimSlot(int index)
+    {
+        currentSlot() = index;
+    }
+
+    void releaseSlot()
+    {
+        currentSlot() = -1;
+    }
+
+    // pushes a job on the calling thread's deque (runs it right away when the thread has no slot or the deque is full)
+    void enqueue(Job* job)
+    {
+        int index = currentSlot();
+        if (index < 0)
+        {
+            execute(job);
+            return;
+        }
+
+        Slot& slot = slots[index];
+        long long bottom = slot.Bottom.load(std::memory_order_relaxed);
+        if (bottom - slot.Top.load(std::memory_order_acquire) >= JOB_QUEUE_CAPACITY)
+        {
+            execute(job);
+            return;
+        }
+
+        slot.Queue[bottom & (JOB_QUEUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.Bottom.store(bottom + 1, std::memory_order_relaxed);
+
+        numQueued.fetch_add(1);
+        if (numSleeping.load() > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            wakeUp.notify_one();
+        }
+    }
+
+    // owner: takes the newest job of its deque
+    Job* pop(Slot& slot)
+    {
+        long long bottom = slot.Bottom.load(std::memory_order_relaxed) - 1;
+        slot.Bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long long top = slot.Top.load(std::memory_order_relaxed);
+
+        if (top > bottom)
+        {
+            slot.Bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job* job = slot.Queue[bottom & (JOB_QUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (top == bottom)
+        {
+            // Last job: race the thieves for it
+            if (!slot.Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                job = nullptr;
+            slot.Bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    // thief: takes the oldest job of another deque
+    Job* steal(Slot& slot)
+    {
+        long long top = slot.Top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long long bottom = slot.Bottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+            return nullptr;
+
+        Job* job = slot.Queue[top & (JOB_QUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!slot.Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return job;
+    }
+
+    // own deque first, then the other slots starting at a different one for every thread
+    Job* findJob(int index)
+    {
+        Job* job = index >= 0 ? pop(slots[index]) : nullptr;
+        for (int i = 1; !job && i < MAX_SLOTS; ++i)
+        {
+            Slot& victim = slots[(std::max(index, 0) + i) % MAX_SLOTS];
+            if (victim.IsUsed.load(std::memory_order_relaxed))
+                job = steal(victim);
+        }
+        if (job)
+            numQueued.fetch_sub(1);
+        return job;
+    }
+
+    // runs a job, then queues the jobs that were waiting for its counter
+    void execute(Job* job)
+    {
+        job->Function(*job);
+
+        JobCounter* counter = job->Counter;
+        if (!counter)
+            return;
+
+        // Finishing keeps Wait from returning (and the counter from going away) until the waiting jobs are taken
+        counter->Finishing.fetch_add(1);
+        std::vector<Job*> ready;
+        if (counter->Pending.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(counter->Mutex);
+            ready.swap(counter->Waiting);
+        }
+        counter->Finishing.fetch_sub(1);
+
+        for (Job* waiting : ready)
+            enqueue(waiting);
+    }
+
+    void workerMain(int index)
+    {
+        std::string name = "Worker " + std::to_string(index);
+        TRACE_THREAD_NAME(name.c_str());
+        claimSlot(index);
+
+        int numFailures = 0;
+        while (isRunning.load() || numQueued.load() > 0)
+        {
+            Job* job = findJob(index);
+            if (job)
+            {
+                execute(job);
+                numFailures = 0;
+                continue;
+            }
+
+            if (++numFailures < JOB_IDLE_SPINS)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // Sleep until a job is queued; numSleeping is raised before numQueued is checked so no wake-up is lost
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            numSleeping.fetch_add(1);
+            wakeUp.wait(lock, [this] { return numQueued.load() > 0 || !isRunning.load(); });
+            numSleeping.fetch_sub(1);
+            numFailures = 0;
+        }
+        releaseSlot();
+    }
+};
+#endif
@@ -0,0 +1,118 @@
+#pragma once
+/* Input-to-photon latency.
+
+The time of the first input that is not on screen yet travels with the scene snapshot to
+the frame that first shows it. Right after that frame is presented, OnPresent writes a
+GL_TIMESTAMP query. When the result arrives, the GPU time is converted to the CPU clock
+(both clocks are sampled together in Reset) and the latency is the time from the input
+to the moment the GPU finished the presented frame. Scan-out adds up to one refresh
+interval on top of that, which depends on the display and is not included.
+
+Samples holds the latencies in milliseconds since the last Reset.
+*/
+
+#ifndef LATENCY_TRACKER_H
+#define LATENCY_TRACKER_H
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <vector>
+
+// Presented frames with an input whose timestamps can be outstanding at once
+const int LATENCY_TRACKER_QUERIES = 8;
+
+class LatencyTracker
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    std::vector<float> Samples;
+    unsigned int NumDropped;    // inputs not measured because every query was still pending
+
+    LatencyTracker() : NumDropped(0), gpuAtCalibration(0)
+    {
+        for (int i = 0; i < LATENCY_TRACKER_QUERIES; ++i)
+        {
+            queries[i] = 0;
+            isPending[i] = false;
+        }
+    }
+
+    void Create()
+    {
+        glGenQueries(LATENCY_TRACKER_QUERIES, queries);
+        Reset();
+    }
+
+    void Destroy()
+    {
+        glDeleteQueries(LATENCY_TRACKER_QUERIES, queries);
+    }
+
+    // called right after a frame was presented with the time of the input it shows first (clock::time_point() when none).
+    // Later frames that still carry the same input are not timed again.
+    void OnPresent(clock::time_point inputTime)
+    {
+        Collect();
+        if (inputTime == clock::time_point() || inputTime <= lastInputTime)
+            return;
+        lastInputTime = inputTime;
+
+        for (int i = 0; i < LATENCY_TRACKER_QUERIES; ++i)
+        {
+            if (isPending[i])
+                continue;
+
+            glQueryCounter(queries[i], GL_TIMESTAMP);
+            inputTimes[i] = inputTime;
+            isPending[i] = true;
+            return;
+        }
+        NumDropped++;
+    }
+
+    // reads the timestamps that are available without waiting
+    void Collect()
+    {
+        for (int i = 0; i < LATENCY_TRACKER_QUERIES; ++i)
+        {
+            if (!isPending[i])
+                continue;
+
+            GLint isAvailable = GL_FALSE;
+            glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+            if (!isAvailable)
+                continue;
+
+            GLuint64 gpuTime = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &gpuTime);
+            isPending[i] = false;
+
+            clock::time_point finished = cpuAtCalibration + std::chrono::duration_cast<clock::duration>(
+                std::chrono::nanoseconds((long long)(gpuTime - gpuAtCalibration)));
+            Samples.push_back(std::chrono::duration<float, std::milli>(finished - inputTimes[i]).count());
+        }
+    }
+
+    // clears the samples and samples the GPU and CPU clocks again so they do not drift apart
+    void Reset()
+    {
+        Samples.clear();
+        NumDropped = 0;
+
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        cpuAtCalibration = clock::now();
+        gpuAtCalibration = (GLuint64)gpuNow;
+    }
+
+private:
+    GLuint queries[LATENCY_TRACKER_QUERIES];
+    bool isPending[LATENCY_TRACKER_QUERIES];
+    clock::time_point inputTimes[LATENCY_TRACKER_QUERIES];
+    clock::time_point lastInputTime;
+    clock::time_point cpuAtCalibration;
+    GLuint64 gpuAtCalibration;
+};
+#endif
@@ -0,0 +1,250 @@
+#pragma once
+/* Hierarchical-Z occlusion culling on the CPU.
+
+Large occluders are rasterized into a small software depth buffer, which is then
+reduced into a pyramid where every texel stores the farthest depth of the four texels
+below it. An object is tested by projecting its bounding box to the screen, picking the
+pyramid level where that rectangle covers at most 2x2 texels, and comparing the nearest
+depth of the box against the farthest depth stored there.
+*/
+
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Default resolution of the software depth buffer
+const int OCCLUSION_BUFFER_WIDTH = 256;
+const int OCCLUSION_BUFFER_HEIGHT = 160;
+
+class OcclusionCuller
+{
+public:
+    // Resolution of the finest level
+    int Width;
+    int Height;
+    // Depth pyramid (level 0 is the occluder depth buffer), depth in [0, 1] with 1 being the far plane
+    std::vector<std::vector<float>> Levels;
+    std::vector<int> LevelWidths;
+    std::vector<int> LevelHeights;
+    // Statistics for the current frame
+    int NumOccluders;
+    int NumTested;
+    int NumRejected;
+
+    OcclusionCuller(int width = OCCLUSION_BUFFER_WIDTH, int height = OCCLUSION_BUFFER_HEIGHT) : NumOccluders(0), NumTested(0), NumRejected(0)
+    {
+        Resize(width, height);
+    }
+
+    // allocates the depth buffer and every level of the pyramid
+    void Resize(int width, int height)
+    {
+        Width = width;
+        Height = height;
+        Levels.clear();
+        LevelWidths.clear();
+        LevelHeights.clear();
+
+        while (true)
+        {
+            LevelWidths.push_back(width);
+            LevelHeights.push_back(height);
+            Levels.push_back(std::vector<float>(width * height, 1.0f));
+            if (width == 1 && height == 1)
+                break;
+            width = std::max(1, (width + 1) / 2);
+            height = std::max(1, (height + 1) / 2);
+        }
+    }
+
+    // clears the occluder depth buffer and the statistics
+    void BeginFrame()
+    {
+        std::fill(Levels[0].begin(), Levels[0].end(), 1.0f);
+        NumOccluders = 0;
+        NumTested = 0;
+        NumRejected = 0;
+    }
+
+    // rasterizes the box [boundsMin, boundsMax] transformed by mvp as an occluder. The box must be fully solid.
+    void AddOccluderBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& mvp)
+    {
+        // corner i uses max.x when bit 0 is set, max.y for bit 1 and max.z for bit 2
+        static const int boxTriangles[12][3] = {
+            { 0, 2, 3 }, { 0, 3, 1 },   // -z
+            { 4, 5, 7 }, { 4, 7, 6 },   // +z
+            { 0, 1, 5 }, { 0, 5, 4 },   // -y
+            { 2, 6, 7 }, { 2, 7, 3 },   // +y
+            { 0, 4, 6 }, { 0, 6, 2 },   // -x
+            { 1, 3, 7 }, { 1, 7, 5 }    // +x
+        };
+
+        glm::vec3 screen[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            glm::vec4 clip = mvp * boxCorner(boundsMin, boundsMax, i);
+
+            // An occluder crossing the near plane is skipped rather than clipped, which is always safe
+            if (clip.w <= NEAR_W)
+                return;
+
+            screen[i] = toScreen(clip);
+        }
+
+        for (int i = 0; i < 12; ++i)
+            rasterizeTriangle(screen[boxTriangles[i][0]], screen[boxTriangles[i][1]], screen[boxTriangles[i][2]]);
+
+        NumOccluders++;
+    }
+
+    // reduces the occluder depth buffer into the max-depth pyramid. Call after the last occluder is added.
+    void BuildPyramid()
+    {
+        for (size_t level = 1; level < Levels.size(); ++level)
+        {
+            const std::vector<float>& src = Levels[level - 1];
+            std::vector<float>& dst = Levels[level];
+            int srcWidth = LevelWidths[level - 1];
+            int srcHeight = LevelHeights[level - 1];
+
+            for (int y = 0; y < LevelHeights[level]; ++y)
+            {
+                int y0 = std::min(2 * y, srcHeight - 1);
+                int y1 = std::min(2 * y + 1, srcHeight - 1);
+                for (int x = 0; x < LevelWidths[level]; ++x)
+                {
+                    int x0 = std::min(2 * x, srcWidth - 1);
+                    int x1 = std::min(2 * x + 1, srcWidth - 1);
+                    dst[y * LevelWidths[level] + x] = std::max(std::max(src[y0 * srcWidth + x0], src[y0 * srcWidth + x1]),
+                                                               std::max(src[y1 * srcWidth + x0], src[y1 * srcWidth + x1]));
+                }
+            }
+        }
+    }
+
+    // returns false when the box [boundsMin, boundsMax] transformed by mvp is hidden behind the occluders or off screen
+    bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& mvp)
+    {
+        NumTested++;
+
+        float minX = 1e30f, minY = 1e30f, minZ = 1e30f;
+        float maxX = -1e30f, maxY = -1e30f;
+        for (int i = 0; i < 8; ++i)
+        {
+            glm::vec4 clip = mvp * boxCorner(boundsMin, boundsMax, i);
+
+            // Boxes crossing the near plane can not be tested reliably
+            if (clip.w <= NEAR_W)
+                return true;
+
+            glm::vec3 p = toScreen(clip);
+            minX = std::min(minX, p.x);
+            minY = std::min(minY, p.y);
+            minZ = std::min(minZ, p.z);
+            maxX = std::max(maxX, p.x);
+            maxY = std::max(maxY, p.y);
+        }
+
+        if (maxX < 0.0f || maxY < 0.0f || minX > Width || minY > Height || minZ > 1.0f)
+        {
+            NumRejected++;
+            return false;
+        }
+
+        minX = std::max(minX, 0.0f);
+        minY = std::max(minY, 0.0f);
+        maxX = std::min(maxX, (float)Width - 1.0f);
+        maxY = std::min(maxY, (float)Height - 1.0f);
+
+        // Coarsest level at which the rectangle still touches no more than 2x2 texels
+        float size = std::max(maxX - minX, maxY - minY);
+        int level = size > 1.0f ? (int)std::ceil(std::log2(size)) : 0;
+        level = std::min(level, (int)Levels.size() - 1);
+
+        int x0 = (int)minX >> level;
+        int y0 = (int)minY >> level;
+        int x1 = std::min((int)maxX >> level, LevelWidths[level] - 1);
+        int y1 = std::min((int)maxY >> level, LevelHeights[level] - 1);
+
+        float farthest = 0.0f;
+        for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x)
+                farthest = std::max(farthest, Levels[level][y * LevelWidths[level] + x]);
+
+        if (minZ > farthest)
+        {
+            NumRejected++;
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    // smallest clip-space w accepted in front of the camera
+    static constexpr float NEAR_W = 1e-4f;
+
+    glm::vec4 boxCorner(const glm::vec3& boundsMin, const glm::vec3& boundsMax, int i) const
+    {
+        return glm::vec4((i & 1) ? boundsMax.x : boundsMin.x,
+                         (i & 2) ? boundsMax.y : boundsMin.y,
+                         (i & 4) ? boundsMax.z : boundsMin.z, 1.0f);
+    }
+
+    // converts clip coordinates to pixel coordinates of level 0 with depth in [0, 1]
+    glm::vec3 toScreen(const glm::vec4& clip) const
+    {
+        float invW = 1.0f / clip.w;
+        return glm::vec3((clip.x * invW * 0.5f + 0.5f) * Width,
+                         (clip.y * invW * 0.5f + 0.5f) * Height,
+                          clip.z * invW * 0.5f + 0.5f);
+    }
+
+    // writes the depth of a triangle into every pixel whose center it covers
+    void rasterizeTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (std::fabs(area) < 1e-8f)
+            return;
+
+        int x0 = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+        int y0 = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+        int x1 = std::min(Width - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+        int y1 = std::min(Height - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+
+        // Depth plane of the triangle. Each pixel stores the farthest depth the plane reaches inside it,
+        // so an object is never reported hidden by a sloped occluder that is only in front at the pixel center
+        float invArea = 1.0f / area;
+        float dzdx = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) * invArea;
+        float dzdy = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) * invArea;
+        float slope = 0.5f * (std::fabs(dzdx) + std::fabs(dzdy));
+
+        std::vector<float>& depth = Levels[0];
+        for (int y = y0; y <= y1; ++y)
+        {
+            float py = y + 0.5f;
+            for (int x = x0; x <= x1; ++x)
+            {
+                float px = x + 0.5f;
+
+                // Edge functions share the sign of the area when the pixel center is inside
+                float w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) * invArea;
+                float w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) * invArea;
+                float w2 = 1.0f - w0 - w1;
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+
+                float z = std::min(1.0f, w0 * a.z + w1 * b.z + w2 * c.z + slope);
+                float& stored = depth[y * Width + x];
+                if (z < stored)
+                    stored = z;
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,268 @@
+#pragma once
+/* Per-frame render statistics.
+
+The renderer goes through the counting wrappers below (UseProgram, BindVertexArray,
+BindTexture, DrawArrays, DrawElements, CountUniformUpload, CountBufferUpload) instead of
+calling OpenGL directly, so every frame knows how much work it submitted. BeginFrame and
+EndFrame bracket the frame: they measure the CPU time in between and write a pair of
+GL_TIMESTAMP queries for the GPU time, which is read back a few frames later.
+
+LastFrame holds the counters of the most recently finished frame. They can be read
+directly, written as JSON or as CSV rows, or drawn with DrawOverlay.
+*/
+
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <text_overlay.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Frames between writing the GPU timestamps of a frame and reading them back
+const int RENDER_STATS_QUERY_FRAMES = 4;
+
+// GPU time of one frame, identified by its FrameNumber
+struct GpuFrameTime
+{
+    unsigned int FrameNumber;
+    float Ms;
+};
+
+struct FrameCounters
+{
+    unsigned int DrawCalls;
+    unsigned int Triangles;
+    unsigned int Vertices;
+    unsigned int ProgramBinds;
+    unsigned int VaoBinds;
+    unsigned int TextureBinds;
+    unsigned int UniformUploads;
+    unsigned long long BufferBytes;     // bytes written to GPU buffers (uniform data included)
+    float CpuFrameMs;
+    float GpuFrameMs;                   // from a few frames ago, 0 until the first result arrives
+};
+
+class RenderStats
+{
+public:
+    FrameCounters CurrentFrame;         // being accumulated
+    FrameCounters LastFrame;            // most recently finished frame
+    unsigned int FrameNumber;
+    // When recording, every GPU time read back is also appended here (benchmarks consume and clear it)
+    bool IsRecordingGpuTimes;
+    std::vector<GpuFrameTime> GpuTimes;
+
+    RenderStats() : FrameNumber(0), IsRecordingGpuTimes(false), queryIndex(0), lastGpuMs(0.0f)
+    {
+        clear(CurrentFrame);
+        clear(LastFrame);
+        for (int i = 0; i < RENDER_STATS_QUERY_FRAMES; ++i)
+        {
+            queries[i][0] = queries[i][1] = 0;
+            isQueryPending[i] = false;
+            queryFrames[i] = 0;
+        }
+    }
+
+    // creates the timestamp queries of the GPU frame time
+    void Create()
+    {
+        glGenQueries(RENDER_STATS_QUERY_FRAMES * 2, &queries[0][0]);
+    }
+
+    void Destroy()
+    {
+        glDeleteQueries(RENDER_STATS_QUERY_FRAMES * 2, &queries[0][0]);
+    }
+
+    // clears the counters and starts timing a frame
+    void BeginFrame()
+    {
+        clear(CurrentFrame);
+        cpuBegin = clock::now();
+
+        // Reuse the oldest query pair; a result that never arrived is skipped
+        collectQuery(queryIndex);
+        glQueryCounter(queries[queryIndex][0], GL_TIMESTAMP);
+    }
+
+    // stops timing the frame and publishes its counters in LastFrame
+    void EndFrame()
+    {
+        glQueryCounter(queries[queryIndex][1], GL_TIMESTAMP);
+        isQueryPending[queryIndex] = true;
+        queryFrames[queryIndex] = FrameNumber + 1;
+        queryIndex = (queryIndex + 1) % RENDER_STATS_QUERY_FRAMES;
+
+        for (int i = 0; i < RENDER_STATS_QUERY_FRAMES; ++i)
+            collectQuery(i);
+
+        CurrentFrame.CpuFrameMs = std::chrono::duration<float, std::milli>(clock::now() - cpuBegin).count();
+        CurrentFrame.GpuFrameMs = lastGpuMs;
+        LastFrame = CurrentFrame;
+        FrameNumber++;
+    }
+
+    // waits for the GPU and reads back every outstanding frame time
+    void FinishGpuFrames()
+    {
+        glFinish();
+        for (int i = 0; i < RENDER_STATS_QUERY_FRAMES; ++i)
+            collectQuery((queryIndex + i) % RENDER_STATS_QUERY_FRAMES);
+    }
+
+    // Counting wrappers
+    void UseProgram(GLuint programId)
+    {
+        glUseProgram(programId);
+        CurrentFrame.ProgramBinds++;
+    }
+
+    void BindVertexArray(GLuint vao)
+    {
+        glBindVertexArray(vao);
+        CurrentFrame.VaoBinds++;
+    }
+
+    void BindTexture(GLenum target, GLuint textureId)
+    {
+        glBindTexture(target, textureId);
+        CurrentFrame.TextureBinds++;
+    }
+
+    void DrawArrays(GLenum mode, GLint first, GLsizei count)
+    {
+        glDrawArrays(mode, first, count);
+        countDraw(mode, count);
+    }
+
+    void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+    {
+        glDrawElements(mode, count, type, indices);
+        countDraw(mode, count);
+    }
+
+    // records uniform data written by the caller (a glUniform* call or a write to a uniform buffer)
+    void CountUniformUpload(size_t bytes)
+    {
+        CurrentFrame.UniformUploads++;
+        CurrentFrame.BufferBytes += bytes;
+    }
+
+    // records bytes written to any other GPU buffer
+    void CountBufferUpload(size_t bytes)
+    {
+        CurrentFrame.BufferBytes += bytes;
+    }
+
+    // returns the counters of the last frame as a JSON object
+    std::string ToJson() const
+    {
+        char json[512];
+        snprintf(json, sizeof(json),
+            "{\"frame\": %u, \"drawCalls\": %u, \"triangles\": %u, \"vertices\": %u, \"programBinds\": %u, \"vaoBinds\": %u, "
+            "\"textureBinds\": %u, \"uniformUploads\": %u, \"bufferBytes\": %llu, \"cpuFrameMs\": %.4f, \"gpuFrameMs\": %.4f}",
+            FrameNumber, LastFrame.DrawCalls, LastFrame.Triangles, LastFrame.Vertices, LastFrame.ProgramBinds, LastFrame.VaoBinds,
+            LastFrame.TextureBinds, LastFrame.UniformUploads, LastFrame.BufferBytes, LastFrame.CpuFrameMs, LastFrame.GpuFrameMs);
+        return json;
+    }
+
+    // writes the column names matching WriteCsvRow
+    static void WriteCsvHeader(FILE* file)
+    {
+        fprintf(file, "frame,draw_calls,triangles,vertices,program_binds,vao_binds,texture_binds,uniform_uploads,buffer_bytes,cpu_ms,gpu_ms\n");
+    }
+
+    // writes the counters of the last frame as one CSV row
+    void WriteCsvRow(FILE* file) const
+    {
+        fprintf(file, "%u,%u,%u,%u,%u,%u,%u,%u,%llu,%.4f,%.4f\n", FrameNumber, LastFrame.DrawCalls, LastFrame.Triangles, LastFrame.Vertices,
+            LastFrame.ProgramBinds, LastFrame.VaoBinds, LastFrame.TextureBinds, LastFrame.UniformUploads, LastFrame.BufferBytes,
+            LastFrame.CpuFrameMs, LastFrame.GpuFrameMs);
+    }
+
+    // queues the counters of the last frame on the text overlay with the top-right corner of the panel at (right, y)
+    void DrawOverlay(TextOverlay& overlay, float right, float y) const
+    {
+        const glm::vec4 background(0.0f, 0.0f, 0.0f, 0.6f);
+        const glm::vec4 header(0.4f, 0.9f, 1.0f, 1.0f);
+        const glm::vec4 text(1.0f, 1.0f, 1.0f, 1.0f);
+        const int NUM_LINES = 11;
+
+        char lines[NUM_LINES][64];
+        snprintf(lines[0], 64, "FRAME %u", FrameNumber);
+        snprintf(lines[1], 64, "CPU frame    %8.2f ms", LastFrame.CpuFrameMs);
+        snprintf(lines[2], 64, "GPU frame    %8.2f ms", LastFrame.GpuFrameMs);
+        snprintf(lines[3], 64, "Draw calls   %8u", LastFrame.DrawCalls);
+        snprintf(lines[4], 64, "Triangles    %8u", LastFrame.Triangles);
+        snprintf(lines[5], 64, "Vertices     %8u", LastFrame.Vertices);
+        snprintf(lines[6], 64, "Programs     %8u", LastFrame.ProgramBinds);
+        snprintf(lines[7], 64, "VAOs         %8u", LastFrame.VaoBinds);
+        snprintf(lines[8], 64, "Textures     %8u", LastFrame.TextureBinds);
+        snprintf(lines[9], 64, "Uniforms     %8u", LastFrame.UniformUploads);
+        snprintf(lines[10], 64, "Buffer bytes %8llu", LastFrame.BufferBytes);
+
+        float width = overlay.TextWidth(std::string(21, ' '));
+        float x = right - width;
+        overlay.AddRect(x - 4.0f, y - 4.0f, width + 8.0f, overlay.LineHeight() * NUM_LINES + 8.0f, background);
+        for (int i = 0; i < NUM_LINES; ++i)
+        {
+            overlay.AddText(x, y, lines[i], i == 0 ? header : text);
+            y += overlay.LineHeight();
+        }
+    }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    clock::time_point cpuBegin;
+    GLuint queries[RENDER_STATS_QUERY_FRAMES][2];   // begin and end timestamp of each frame
+    bool isQueryPending[RENDER_STATS_QUERY_FRAMES];
+    unsigned int queryFrames[RENDER_STATS_QUERY_FRAMES]; // FrameNumber of the frame each query pair measures
+    int queryIndex;
+    float lastGpuMs;
+
+    static void clear(FrameCounters& counters)
+    {
+        counters = FrameCounters();
+    }
+
+    void countDraw(GLenum mode, GLsizei count)
+    {
+        CurrentFrame.DrawCalls++;
+        CurrentFrame.Vertices += count;
+        if (mode == GL_TRIANGLES)
+            CurrentFrame.Triangles += count / 3;
+        else if (mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN)
+            CurrentFrame.Triangles += count > 2 ? count - 2 : 0;
+    }
+
+    // reads a finished frame's timestamps without waiting
+    void collectQuery(int index)
+    {
+        if (!isQueryPending[index])
+            return;
+
+        GLint isAvailable = GL_FALSE;
+        glGetQueryObjectiv(queries[index][1], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (!isAvailable)
+            return;
+
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(queries[index][0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(queries[index][1], GL_QUERY_RESULT, &end);
+        isQueryPending[index] = false;
+
+        lastGpuMs = end > begin ? (end - begin) / 1.0e6f : 0.0f;
+        if (IsRecordingGpuTimes)
+            GpuTimes.push_back({ queryFrames[index], lastGpuMs });
+    }
+};
+#endif
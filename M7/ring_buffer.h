@@ -0,0 +1,172 @@
+#pragma once
+/* Persistently mapped ring buffer for data that changes every frame.
+
+The buffer is created once with glBufferStorage and stays mapped for the lifetime of the
+program, so per-frame and per-draw data is written straight into GPU-visible memory with
+memcpy instead of going through glBufferData or glUniform* calls. The buffer is split into
+one region per frame in flight. Before a region is reused, the fence inserted at the end of
+the frame that last wrote it is waited on, so the CPU never overwrites data the GPU is still
+reading.
+*/
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <GL/glew.h>
+
+#include <cstring>
+
+// Number of frames that can be written while the GPU is still reading earlier ones
+const int RING_BUFFER_FRAMES = 3;
+
+class PersistentRingBuffer
+{
+public:
+    GLuint Buffer;
+    GLsizeiptr FrameSize;       // bytes available to each frame
+    GLint Alignment;            // offsets returned by Write are multiples of this
+    // Statistics
+    GLsizeiptr BytesWritten;    // bytes written during the current frame (including alignment padding)
+    unsigned int FrameStalls;   // 1 when BeginFrame had to wait for the GPU this frame
+    unsigned int TotalStalls;   // frames that waited for the GPU since the buffer was created
+    unsigned int TotalFrames;
+
+    PersistentRingBuffer() : Buffer(0), FrameSize(0), Alignment(1), BytesWritten(0), FrameStalls(0), TotalStalls(0), TotalFrames(0),
+        mappedData(nullptr), target(GL_UNIFORM_BUFFER), frameIndex(0), offset(0)
+    {
+        for (int i = 0; i < RING_BUFFER_FRAMES; ++i)
+            fences[i] = 0;
+    }
+
+    // creates and maps the buffer. target is the binding point the data is used with (for example GL_UNIFORM_BUFFER)
+    bool Create(GLenum bufferTarget, GLsizeiptr frameSize)
+    {
+        target = bufferTarget;
+
+        if (target == GL_UNIFORM_BUFFER)
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &Alignment);
+        else if (target == GL_SHADER_STORAGE_BUFFER)
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &Alignment);
+        if (Alignment < 1)
+            Alignment = 1;
+
+        FrameSize = AlignedSize(frameSize);
+
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glGenBuffers(1, &Buffer);
+        glBindBuffer(target, Buffer);
+        glBufferStorage(target, FrameSize * RING_BUFFER_FRAMES, nullptr, flags);
+        mappedData = (unsigned char*)glMapBufferRange(target, 0, FrameSize * RING_BUFFER_FRAMES, flags);
+        glBindBuffer(target, 0);
+
+        return mappedData != nullptr;
+    }
+
+    // unmaps and deletes the buffer
+    void Destroy()
+    {
+        for (int i = 0; i < RING_BUFFER_FRAMES; ++i)
+        {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+
+        if (Buffer)
+        {
+            glBindBuffer(target, Buffer);
+            glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+            glDeleteBuffers(1, &Buffer);
+        }
+        Buffer = 0;
+        mappedData = nullptr;
+    }
+
+    // moves to the next frame region, waiting for the GPU if it is still reading it
+    void BeginFrame()
+    {
+        frameIndex = (frameIndex + 1) % RING_BUFFER_FRAMES;
+        offset = 0;
+        BytesWritten = 0;
+        FrameStalls = 0;
+        TotalFrames++;
+
+        GLsync fence = fences[frameIndex];
+        if (!fence)
+            return;
+
+        // A zero timeout only polls; anything else means the CPU got RING_BUFFER_FRAMES ahead of the GPU
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            FrameStalls = 1;
+            TotalStalls++;
+            do
+            {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+            } while (result == GL_TIMEOUT_EXPIRED);
+        }
+
+        glDeleteSync(fence);
+        fences[frameIndex] = 0;
+    }
+
+    // copies size bytes into the current frame region and returns their offset in the buffer, or -1 when the region is full
+    GLintptr Write(const void* data, GLsizeiptr size)
+    {
+        GLintptr bufferOffset = Allocate(size);
+        if (bufferOffset < 0)
+            return -1;
+
+        memcpy(mappedData + bufferOffset, data, size);
+        return bufferOffset;
+    }
+
+    // reserves size bytes of the current frame region without writing them; returns their offset in the buffer (-1 when the region is full).
+    // The caller fills them through MappedPointer, possibly from several threads.
+    GLintptr Allocate(GLsizeiptr size)
+    {
+        GLsizeiptr alignedSize = AlignedSize(size);
+        if (offset + alignedSize > FrameSize)
+            return -1;
+
+        GLintptr bufferOffset = frameIndex * FrameSize + offset;
+        offset += alignedSize;
+        BytesWritten += alignedSize;
+        return bufferOffset;
+    }
+
+    // CPU address of an offset returned by Allocate
+    void* MappedPointer(GLintptr bufferOffset) const
+    {
+        return mappedData + bufferOffset;
+    }
+
+    // size rounded up to the offset alignment, the stride of consecutive blocks
+    GLsizeiptr AlignedSize(GLsizeiptr size) const
+    {
+        return (size + Alignment - 1) / Alignment * Alignment;
+    }
+
+    // binds size bytes at bufferOffset to the indexed binding point (for example a uniform block binding)
+    void BindRange(GLuint index, GLintptr bufferOffset, GLsizeiptr size) const
+    {
+        glBindBufferRange(target, index, Buffer, bufferOffset, size);
+    }
+
+    // marks the end of the commands that read the current frame region
+    void EndFrame()
+    {
+        fences[frameIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+private:
+    unsigned char* mappedData;
+    GLenum target;
+    GLsync fences[RING_BUFFER_FRAMES];
+    int frameIndex;
+    GLsizeiptr offset;          // bytes used in the current frame region
+};
+#endif
@@ -0,0 +1,283 @@
+#pragma once
+/* Synthetic stress scenes for renderer scaling tests.
+
+GenerateStressScene fills a cube in front of the camera with N instances (1 to
+STRESS_MAX_INSTANCES) of the primitives in meshes.h, each with a random primitive,
+rotation, scale, texture and material color. The density of the field stays the same
+as N grows. Everything comes from a small deterministic generator seeded by the caller,
+so a seed always produces the same scene on every platform.
+
+The instances are plain data; the renderer turns them into its own scene objects.
+ProcessMemoryBytes and GpuMemoryUsedBytes report the memory used at each step of a
+sweep over N.
+
+Command-line options:
+    --stress N              replace the desk with N generated instances
+    --stress-sweep LIST     comma-separated instance counts to measure in turn (for example 1,10,100,1000)
+    --seed S                generator seed (default 1)
+    --sweep-frames N        measured frames per count (default 60)
+    --sweep-report PATH     CSV results of the sweep (default stress_sweep.csv)
+*/
+
+#ifndef STRESS_SCENE_H
+#define STRESS_SCENE_H
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#endif
+
+// Largest number of generated instances
+const int STRESS_MAX_INSTANCES = 1000000;
+
+// Average distance between neighbouring instances
+const float STRESS_SPACING = 3.0f;
+
+// Primitives of meshes.h used by the generator
+enum Stress_Primitive {
+    STRESS_BOX,
+    STRESS_CONE,
+    STRESS_CYLINDER,
+    STRESS_TAPERED_CYLINDER,
+    STRESS_SPHERE,
+    STRESS_TORUS,
+    STRESS_PRISM,
+    STRESS_PYRAMID3,
+    STRESS_PYRAMID4,
+    STRESS_PRIMITIVE_COUNT
+};
+
+struct StressInstance
+{
+    Stress_Primitive Primitive;
+    glm::mat4 Model;
+    int TextureIndex;
+    glm::vec4 MaterialColor;
+};
+
+struct StressOptions
+{
+    int NumInstances;               // 0 when the desk scene is used
+    std::vector<int> SweepCounts;
+    unsigned int Seed;
+    int NumSweepFrames;
+    std::string SweepReportPath;
+
+    StressOptions() : NumInstances(0), Seed(1), NumSweepFrames(60), SweepReportPath("stress_sweep.csv") {}
+
+    bool IsSweep() const { return !SweepCounts.empty(); }
+
+    // reads the stress options and removes them from argv so other parsers do not see them. Returns false when an option is invalid.
+    bool Parse(int& argc, char* argv[])
+    {
+        int kept = 1;
+        for (int i = 1; i < argc; ++i)
+        {
+            const char* option = argv[i];
+            bool isStressOption = strcmp(option, "--stress") == 0 || strcmp(option, "--stress-sweep") == 0 || strcmp(option, "--seed") == 0 ||
+                                  strcmp(option, "--sweep-frames") == 0 || strcmp(option, "--sweep-report") == 0;
+            if (!isStressOption)
+            {
+                argv[kept++] = argv[i];
+                continue;
+            }
+
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "Missing value for %s\n", option);
+                return false;
+            }
+            const char* value = argv[++i];
+
+            if (strcmp(option, "--stress") == 0)
+            {
+                NumInstances = atoi(value);
+                if (NumInstances < 1 || NumInstances > STRESS_MAX_INSTANCES)
+                {
+                    fprintf(stderr, "--stress expects 1 to %d instances\n", STRESS_MAX_INSTANCES);
+                    return false;
+                }
+            }
+            else if (strcmp(option, "--stress-sweep") == 0)
+            {
+                SweepCounts.clear();
+                for (const char* text = value; *text; )
+                {
+                    int count = atoi(text);
+                    if (count < 1 || count > STRESS_MAX_INSTANCES)
+                    {
+                        fprintf(stderr, "--stress-sweep counts must be between 1 and %d\n", STRESS_MAX_INSTANCES);
+                        return false;
+                    }
+                    SweepCounts.push_back(count);
+                    const char* comma = strchr(text, ',');
+                    text = comma ? comma + 1 : text + strlen(text);
+                }
+            }
+            else if (strcmp(option, "--seed") == 0)
+                Seed = (unsigned int)strtoul(value, nullptr, 10);
+            else if (strcmp(option, "--sweep-frames") == 0)
+                NumSweepFrames = std::max(1, atoi(value));
+            else
+                SweepReportPath = value;
+        }
+        argc = kept;
+        return true;
+    }
+};
+
+// Small deterministic generator (PCG32); std distributions differ between standard libraries
+class StressRandom
+{
+public:
+    StressRandom(unsigned int seed) : state(0)
+    {
+        Next();
+        state += seed;
+        Next();
+    }
+
+    unsigned int Next()
+    {
+        unsigned long long old = state;
+        state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+        unsigned int shifted = (unsigned int)(((old >> 18) ^ old) >> 27);
+        unsigned int rotation = (unsigned int)(old >> 59);
+        return (shifted >> rotation) | (shifted << ((32 - rotation) & 31));
+    }
+
+    // uniform in [low, high)
+    float Range(float low, float high)
+    {
+        return low + (high - low) * ((Next() >> 8) * (1.0f / 16777216.0f));
+    }
+
+private:
+    unsigned long long state;
+};
+
+// display name of a primitive
+inline const char* StressPrimitiveName(Stress_Primitive primitive)
+{
+    static const char* names[STRESS_PRIMITIVE_COUNT] = {
+        "Box", "Cone", "Cylinder", "Tapered cylinder", "Sphere", "Torus", "Prism", "Pyramid 3", "Pyramid 4"
+    };
+    return names[primitive];
+}
+
+// local-space bounding box of a primitive, measured from the vertices in meshes.cpp
+inline void StressPrimitiveBounds(Stress_Primitive primitive, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+    switch (primitive)
+    {
+    case STRESS_CONE:
+    case STRESS_CYLINDER:
+    case STRESS_TAPERED_CYLINDER:
+        boundsMin = glm::vec3(-1.0f, 0.0f, -1.0f);
+        boundsMax = glm::vec3(1.0f, 1.0f, 1.0f);
+        break;
+    case STRESS_SPHERE:
+        boundsMin = glm::vec3(-1.0f);
+        boundsMax = glm::vec3(1.0f);
+        break;
+    case STRESS_TORUS:
+        boundsMin = glm::vec3(-1.1f);
+        boundsMax = glm::vec3(1.1f);
+        break;
+    default:
+        boundsMin = glm::vec3(-0.5f);
+        boundsMax = glm::vec3(0.5f);
+        break;
+    }
+}
+
+// edge length of the cube filled by count instances
+inline float StressSceneSide(int count)
+{
+    return STRESS_SPACING * std::cbrt((float)count);
+}
+
+// fills a cube in front of the origin (towards -z) with count instances
+inline std::vector<StressInstance> GenerateStressScene(int count, unsigned int seed, int numTextures)
+{
+    StressRandom random(seed);
+    std::vector<StressInstance> instances(count);
+
+    float side = StressSceneSide(count);
+    for (StressInstance& instance : instances)
+    {
+        instance.Primitive = (Stress_Primitive)(random.Next() % STRESS_PRIMITIVE_COUNT);
+
+        glm::vec3 position(random.Range(-0.5f, 0.5f) * side, random.Range(-0.5f, 0.5f) * side, -random.Range(0.0f, 1.0f) * side);
+        glm::vec3 axis(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f));
+        if (glm::dot(axis, axis) < 1e-6f)
+            axis = glm::vec3(0.0f, 1.0f, 0.0f);
+        float angle = random.Range(0.0f, 6.2831853f);
+        float scale = random.Range(0.3f, 1.5f);
+        instance.Model = glm::translate(position) * glm::rotate(angle, glm::normalize(axis)) * glm::scale(glm::vec3(scale));
+
+        instance.TextureIndex = numTextures > 0 ? (int)(random.Next() % numTextures) : 0;
+        instance.MaterialColor = glm::vec4(random.Range(0.4f, 1.0f), random.Range(0.4f, 1.0f), random.Range(0.4f, 1.0f), 1.0f);
+    }
+    return instances;
+}
+
+// resident memory of the process in bytes, 0 when unknown
+inline size_t ProcessMemoryBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.WorkingSetSize;
+    return 0;
+#else
+    size_t pages = 0, residentPages = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    if (fscanf(file, "%zu %zu", &pages, &residentPages) != 2)
+        residentPages = 0;
+    fclose(file);
+    return residentPages * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// video memory in use according to GL_NVX_gpu_memory_info, -1 when the driver does not report it
+inline long long GpuMemoryUsedBytes()
+{
+    const GLenum GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX = 0x9048;
+    const GLenum GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX = 0x9049;
+
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (GLint i = 0; i < numExtensions; ++i)
+    {
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_NVX_gpu_memory_info") != 0)
+            continue;
+
+        GLint totalKb = 0, availableKb = 0;
+        glGetIntegerv(GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &totalKb);
+        glGetIntegerv(GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &availableKb);
+        return (long long)(totalKb - availableKb) * 1024;
+    }
+    return -1;
+}
+#endif
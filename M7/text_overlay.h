@@ -0,0 +1,277 @@
+#pragma once
+/* Batched bitmap text for in-app overlays.
+
+A 5x7 pixel font for the printable ASCII characters from space to '`' is packed into a
+single-channel atlas texture at startup (lowercase letters are drawn with the uppercase
+glyphs). Text and solid rectangles are appended to one vertex array in window pixel
+coordinates, with the origin in the top-left corner, and Flush() draws everything queued
+since the last flush with one draw call.
+*/
+
+#ifndef TEXT_OVERLAY_H
+#define TEXT_OVERLAY_H
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+
+// Glyph size in font pixels and the size of an atlas cell (one pixel of padding keeps glyphs from bleeding)
+const int GLYPH_WIDTH = 5;
+const int GLYPH_HEIGHT = 7;
+const int GLYPH_CELL = 8;
+
+// First character in the font and the number of glyphs (space to '`')
+const int FIRST_GLYPH = 32;
+const int NUM_GLYPHS = 65;
+
+// Rows of each glyph, top to bottom. Bit 4 is the leftmost pixel.
+const unsigned char GLYPH_ROWS[NUM_GLYPHS][GLYPH_HEIGHT] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // '!'
+    { 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '"'
+    { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A }, // '#'
+    { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 }, // '$'
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // '%'
+    { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D }, // '&'
+    { 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 }, // '\''
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // '('
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // ')'
+    { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 }, // '*'
+    { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // '+'
+    { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ','
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // '-'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // '.'
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // '/'
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // '0'
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // '1'
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // '2'
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // '3'
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // '4'
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // '5'
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // '6'
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // '7'
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // '8'
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // '9'
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // ':'
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 }, // ';'
+    { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // '<'
+    { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // '='
+    { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // '>'
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // '?'
+    { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E }, // '@'
+    { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // 'A'
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // 'B'
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // 'C'
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // 'D'
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // 'E'
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // 'F'
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // 'G'
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // 'H'
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 'I'
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // 'J'
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // 'K'
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // 'L'
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // 'M'
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // 'N'
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // 'O'
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // 'P'
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // 'Q'
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // 'R'
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // 'S'
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // 'T'
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // 'U'
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // 'V'
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // 'W'
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // 'X'
+    { 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 }, // 'Y'
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // 'Z'
+    { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E }, // '['
+    { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // '\\'
+    { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E }, // ']'
+    { 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 }, // '^'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }, // '_'
+    { 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '`'
+};
+
+class TextOverlay
+{
+public:
+    // Size of one font pixel on screen
+    float Scale;
+
+    TextOverlay() : Scale(2.0f), programId(0), vao(0), vbo(0), atlasTexture(0), screenWidth(1), screenHeight(1), vboCapacity(0) {}
+
+    // builds the glyph atlas and the vertex buffer. programId is the compiled text shader.
+    void Create(GLuint textProgramId)
+    {
+        programId = textProgramId;
+
+        // Atlas: one row of cells, plus a fully lit cell at the end used for rectangles
+        const int atlasWidth = (NUM_GLYPHS + 1) * GLYPH_CELL;
+        std::vector<unsigned char> pixels(atlasWidth * GLYPH_CELL, 0);
+        for (int glyph = 0; glyph < NUM_GLYPHS; ++glyph)
+            for (int row = 0; row < GLYPH_HEIGHT; ++row)
+                for (int column = 0; column < GLYPH_WIDTH; ++column)
+                    if (GLYPH_ROWS[glyph][row] & (0x10 >> column))
+                        pixels[row * atlasWidth + glyph * GLYPH_CELL + column] = 255;
+        for (int row = 0; row < GLYPH_CELL; ++row)
+            for (int column = 0; column < GLYPH_CELL; ++column)
+                pixels[row * atlasWidth + NUM_GLYPHS * GLYPH_CELL + column] = 255;
+
+        glGenTextures(1, &atlasTexture);
+        glBindTexture(GL_TEXTURE_2D, atlasTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasWidth, GLYPH_CELL, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // Vertex layout: position (2 floats, pixels), texture coordinate (2 floats), color (4 floats)
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+        GLint stride = sizeof(float) * FLOATS_PER_VERTEX;
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, 0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 2));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 4));
+        glEnableVertexAttribArray(2);
+
+        glBindVertexArray(0);
+    }
+
+    // releases the atlas and the vertex buffer
+    void Destroy()
+    {
+        glDeleteTextures(1, &atlasTexture);
+        glDeleteBuffers(1, &vbo);
+        glDeleteVertexArrays(1, &vao);
+        atlasTexture = vbo = vao = 0;
+    }
+
+    // sets the window size in pixels that positions are relative to
+    void SetScreenSize(int width, int height)
+    {
+        screenWidth = width > 0 ? width : 1;
+        screenHeight = height > 0 ? height : 1;
+    }
+
+    // width in pixels of a line of text
+    float TextWidth(const std::string& text) const
+    {
+        return text.size() * (GLYPH_WIDTH + 1) * Scale;
+    }
+
+    // height in pixels of a line of text, including the spacing between lines
+    float LineHeight() const
+    {
+        return (GLYPH_HEIGHT + 3) * Scale;
+    }
+
+    // queues a line of text with its top-left corner at (x, y)
+    void AddText(float x, float y, const std::string& text, const glm::vec4& color)
+    {
+        for (char character : text)
+        {
+            int code = (unsigned char)character;
+            if (code >= 'a' && code <= 'z')
+                code -= 'a' - 'A';
+            if (code < FIRST_GLYPH || code >= FIRST_GLYPH + NUM_GLYPHS)
+                code = '?';
+
+            if (code != ' ')
+                addQuad(x, y, GLYPH_WIDTH * Scale, GLYPH_HEIGHT * Scale, code - FIRST_GLYPH, GLYPH_WIDTH, GLYPH_HEIGHT, color);
+            x += (GLYPH_WIDTH + 1) * Scale;
+        }
+    }
+
+    // queues a solid rectangle with its top-left corner at (x, y)
+    void AddRect(float x, float y, float width, float height, const glm::vec4& color)
+    {
+        // Sample only the middle of the lit cell so filtering never reaches a neighbour
+        addQuad(x, y, width, height, NUM_GLYPHS, GLYPH_CELL / 2, GLYPH_CELL / 2, color, GLYPH_CELL / 4);
+    }
+
+    // draws everything queued since the last flush with one draw call
+    void Flush()
+    {
+        if (vertices.empty())
+            return;
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        GLsizeiptr size = sizeof(float) * vertices.size();
+        if (size > vboCapacity)
+        {
+            vboCapacity = size * 2;
+            glBufferData(GL_ARRAY_BUFFER, vboCapacity, nullptr, GL_STREAM_DRAW);
+        }
+        else
+        {
+            glBufferData(GL_ARRAY_BUFFER, vboCapacity, nullptr, GL_STREAM_DRAW); // orphan the previous contents
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices.data());
+
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        glUseProgram(programId);
+        glUniform2f(glGetUniformLocation(programId, "screenSize"), (float)screenWidth, (float)screenHeight);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, atlasTexture);
+        glBindVertexArray(vao);
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(vertices.size() / FLOATS_PER_VERTEX));
+
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+
+        vertices.clear();
+    }
+
+private:
+    static const int FLOATS_PER_VERTEX = 8;
+
+    GLuint programId;
+    GLuint vao;
+    GLuint vbo;
+    GLuint atlasTexture;
+    int screenWidth;
+    int screenHeight;
+    GLsizeiptr vboCapacity;
+    std::vector<float> vertices;
+
+    // appends two triangles covering (x, y, width, height) that sample a region of an atlas cell
+    void addQuad(float x, float y, float width, float height, int cell, int texelsWide, int texelsHigh, const glm::vec4& color, int texelOffset = 0)
+    {
+        const float atlasWidth = (float)((NUM_GLYPHS + 1) * GLYPH_CELL);
+        float u0 = (cell * GLYPH_CELL + texelOffset) / atlasWidth;
+        float u1 = (cell * GLYPH_CELL + texelOffset + texelsWide) / atlasWidth;
+        float v0 = (float)texelOffset / GLYPH_CELL;
+        float v1 = (float)(texelOffset + texelsHigh) / GLYPH_CELL;
+
+        const float corners[6][4] = {
+            { x, y, u0, v0 }, { x + width, y, u1, v0 }, { x + width, y + height, u1, v1 },
+            { x, y, u0, v0 }, { x + width, y + height, u1, v1 }, { x, y + height, u0, v1 }
+        };
+        for (int i = 0; i < 6; ++i)
+        {
+            vertices.insert(vertices.end(), corners[i], corners[i] + 4);
+            vertices.push_back(color.r);
+            vertices.push_back(color.g);
+            vertices.push_back(color.b);
+            vertices.push_back(color.a);
+        }
+    }
+};
+#endif
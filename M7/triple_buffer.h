@@ -0,0 +1,70 @@
+#pragma once
+/* Lock-free triple buffer for handing the latest value from one producer thread to one
+consumer thread.
+
+The producer fills Back() and calls Publish(), which swaps its slot with the shared
+middle slot. The consumer calls Update(), which swaps its Front() slot with the middle
+slot when a newer value was published. Neither side ever waits for the other: the
+producer can publish faster than the consumer reads (values in between are dropped) and
+the consumer can read the same Front() again while nothing new arrives.
+
+The middle index carries a flag telling whether it holds a value the consumer has not
+taken yet. Each side owns its own index, so only the middle one is atomic.
+*/
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : back(0), middle(1), front(2) {}
+
+    // producer: the slot to fill before calling Publish
+    T& Back()
+    {
+        return slots[back];
+    }
+
+    // producer: makes the back slot the latest value and takes the previous middle slot as the new back slot
+    void Publish()
+    {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // either side: true when a value was published that the consumer has not taken yet
+    bool HasNewer() const
+    {
+        return (middle.load(std::memory_order_acquire) & FRESH) != 0;
+    }
+
+    // consumer: takes the latest published value if there is one. Returns false when Front() is unchanged.
+    bool Update()
+    {
+        if (!HasNewer())
+            return false;
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    // consumer: the latest value taken by Update
+    const T& Front() const
+    {
+        return slots[front];
+    }
+
+private:
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4;
+
+    T slots[3];
+    // Each index on its own cache line so the two threads do not share one
+    alignas(64) int back;
+    alignas(64) std::atomic<int> middle;
+    alignas(64) int front;
+};
+#endif
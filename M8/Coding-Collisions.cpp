@@ -1,5 +1,15 @@
+#include <GL/glew.h>
 #include <glfw3.h>
 #include "linmath.h"
+#include "broadphase.h"
+#include "circle_store.h"
+#include "worker_pool.h"
+#include "instanced_renderer.h"
+#include "fixed_timestep.h"
+#include "swept_collision.h"
+#include "brick_field.h"
+#include "collision_world.h"
+#include "world_recorder.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <conio.h>
@@ -7,79 +17,28 @@
 #include <vector>
 #include <windows.h>
 #include <time.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 
 const float DEG2RAD = 3.14159 / 180;
 
-void processInput(GLFWwindow* window);
-
-enum BRICKTYPE { REFLECTIVE, DESTRUCTABLE };
-enum ONOFF { ON, OFF };
-
-
-class Brick
-{
-public:
-	float red, green, blue;
-	float x, y, width;
-	BRICKTYPE brick_type;
-	ONOFF onoff;
-	int brick_strength;
-
-	Brick(BRICKTYPE bt, float xx, float yy, float ww, int strength)
-	{
-		brick_type = bt; 
-		x = xx; 
-		y = yy; 
-		width = ww; 
-		brick_strength = strength;;
-		red = 1;
-		green = 1;
-		blue = 1;
-		onoff = ON;
-	};
-
-	void drawBrick()
-	{
-		if (onoff == ON)
-		{
-			// as the brick's strength is reduced the color of each brick is changed
-			double halfside = width / 2;
-			if (brick_strength == 4000) {
-				red = 0;
-				green = 1; // green color to indicate strong
-				blue = 0;
-			}
-			else if (brick_strength == 3000) {
-				red = 1; // a yellow color to indicate medium strength
-				green = 1;
-				blue = 0;
-			}
-			else if (brick_strength == 2000) {
-				red = 1; // a red color to indicate weak strength
-				green = 0;
-				blue = 0;
-			}
-
-			glColor3d(red, green, blue);
-			glBegin(GL_POLYGON);
-
-			glVertex2d(x + halfside, y + halfside);
-			glVertex2d(x + halfside, y - halfside);
-			glVertex2d(x - halfside, y - halfside);
-			glVertex2d(x - halfside, y + halfside);
-
-			glEnd();
-		}
-	}
-
-	void ReduceStrength() {
-		brick_strength -= 200;
-	}
-};
-
+// a circle that moved further in one step jumped in a collision and is drawn where it is instead of in between
+const float MAX_INTERPOLATED_MOVE = 0.1f;
 
+void processInput(GLFWwindow* window);
+int RunBroadphaseBenchmark();
+int RunSoaBenchmark();
+int RunParallelBenchmark();
+int RunSweptBenchmark();
+int RunHeadless(int steps, double stepSeconds, bool isSwept, const char* recordPath);
+void WaitForNextFrame(double frameTime);
+
+// One circle per object with a direction code; the game now keeps its circles in a CircleStore.
+// Kept as the array-of-structures baseline of the benchmarks.
 class Circle
 {
 public:
@@ -193,18 +152,6 @@ public:
 		}
 	}
 
-	// draws the circle
-	void DrawCircle()
-	{	
-		glColor3f(red, green, blue);
-		glBegin(GL_POLYGON);
-		for (int i = 0; i < 360; i++) {
-			float degInRad = i * DEG2RAD;
-			glVertex2f((cos(degInRad) * radius) + x, (sin(degInRad) * radius) + y);
-		}
-		glEnd();		
-	}
-
 	// Checks if circles collide. If a collision occurs the size of the circles that collide are reduced
 	// Also, when a collision occurs the color of the circles are changed to a random color
 	void CheckCircleCollision(Circle& cir)
@@ -240,35 +187,167 @@ public:
 	}
 };
 
-// creates the vector of circles called world
-vector<Circle> world;
+// the circles and bricks of the game
+CollisionWorld world;
 
-int main(void) {
-	srand(time(NULL));
+// threads of the physics step; the results do not depend on their number
+WorkerPool workers;
+
+// the last steps of the game, to go back with the backspace key and to save with --record (see world_recorder.h)
+WorldRecorder recorder;
+bool wasRewindPressed = false;
+
+// simulated seconds a press of the backspace key goes back
+const double REWIND_SECONDS = 2.0;
+
+// instanced quads for the circles and bricks
+InstancedRenderer renderer;
+
+
+// position between the one before the last step and the current one; alpha is the share of a step since the last step
+float InterpolatePosition(float previous, float current, float alpha)
+{
+	if (fabs(current - previous) > MAX_INTERPOLATED_MOVE)
+		return current;
+	return previous + (current - previous) * alpha;
+}
+
+// streams the circles and the bricks that are on to the renderer and draws each kind with one instanced draw call.
+// The circles are drawn alpha of a step past their previous positions.
+void DrawWorld(const CircleStore& circles, BrickField& field, WorkerPool& pool, float alpha)
+{
+	ShapeInstance* circleInstances = renderer.Map(SHAPE_CIRCLE, circles.Size());
+	pool.ParallelFor(circles.Size(), 1, [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+		{
+			ShapeInstance& instance = circleInstances[i];
+			instance.x = InterpolatePosition(circles.previousX[i], circles.x[i], alpha);
+			instance.y = InterpolatePosition(circles.previousY[i], circles.y[i], alpha);
+			instance.size = circles.radius[i];
+			instance.red = circles.red[i];
+			instance.green = circles.green[i];
+			instance.blue = circles.blue[i];
+		}
+	});
+
+	ShapeInstance* brickInstances = renderer.Map(SHAPE_SQUARE, field.NumBricksOn());
+	for (Brick& brk : field.Bricks)
+	{
+		if (brk.onoff != ON)
+			continue;
+		brk.UpdateColor();
+		ShapeInstance instance = { brk.x, brk.y, brk.width / 2, brk.red, brk.green, brk.blue };
+		*brickInstances++ = instance;
+	}
+
+	renderer.Draw();
+}
+
+// checks every pair of array-of-structures circles that can touch; the grid replaces testing each circle against all the others
+void CheckCircleCollisions(vector<Circle>& circles, UniformGrid& circleGrid)
+{
+	circleGrid.Build((int)circles.size(), [&](int i, float& x, float& y, float& radius) {
+		x = circles[i].x;
+		y = circles[i].y;
+		radius = circles[i].radius;
+	});
+	circleGrid.ForEachPair([&](int i, int l) {
+		circles[i].CheckCircleCollision(circles[l]);
+	});
+}
+
+int main(int argc, char* argv[]) {
+	// --broadphase-benchmark times the collision step from 1k to 1M circles and exits without opening a window
+	if (argc > 1 && strcmp(argv[1], "--broadphase-benchmark") == 0)
+		return RunBroadphaseBenchmark();
+	// --soa-benchmark compares the circles updated per second of the structure-of-arrays store and the Circle objects
+	if (argc > 1 && strcmp(argv[1], "--soa-benchmark") == 0)
+		return RunSoaBenchmark();
+	// --parallel-benchmark times the physics step with 1 to 32 threads and checks that they all give the same circles
+	if (argc > 1 && strcmp(argv[1], "--parallel-benchmark") == 0)
+		return RunParallelBenchmark();
+	// --swept-benchmark compares the collisions found and missed and the step time of the discrete and swept tests at several rates
+	if (argc > 1 && strcmp(argv[1], "--swept-benchmark") == 0)
+		return RunSweptBenchmark();
+
+	// --seed S makes a run reproducible (the same key presses give the same circles); --threads N sets the physics threads;
+	// --circles N starts with N circles spread over the screen; --physics-hz N sets the physics steps per second (240) and
+	// --max-substeps N the steps a frame can take to catch up (8); --render-hz N limits the frame rate instead of vsync;
+	// --headless-steps N runs N physics steps as fast as possible without a window and exits; --swept 0 tests the collisions
+	// at the start of each step only instead of along the circles' paths; --level FILE loads the bricks from a level file
+	// (see brick_field.h) instead of the nine default bricks; --sleep 0 keeps every circle awake instead of taking the resting
+	// ones out of the physics (see sleep_islands.h); --record FILE writes the last steps to a file on exit, to restore them in
+	// the headless benchmark
+	world.Circles.Seed = time(NULL);
+	int numThreads = 0;
+	int numStartCircles = 0;
+	FixedTimestep timestep;
+	double renderRate = 0;
+	int headlessSteps = 0;
+	bool isSwept = true;
+	const char* levelPath = NULL;
+	const char* recordPath = NULL;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--seed") == 0)
+			world.Circles.Seed = strtoull(argv[i + 1], NULL, 10);
+		else if (strcmp(argv[i], "--threads") == 0)
+			numThreads = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--circles") == 0)
+			numStartCircles = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--physics-hz") == 0 && atof(argv[i + 1]) > 0)
+			timestep.SetRate(atof(argv[i + 1]));
+		else if (strcmp(argv[i], "--max-substeps") == 0)
+			timestep.MaxSubsteps = max(1, atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--render-hz") == 0)
+			renderRate = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--headless-steps") == 0)
+			headlessSteps = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--swept") == 0)
+			isSwept = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "--level") == 0)
+			levelPath = argv[i + 1];
+		else if (strcmp(argv[i], "--sleep") == 0)
+			world.Islands.IsEnabled = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "--record") == 0)
+			recordPath = argv[i + 1];
+	}
+
+	if (!LoadLevel(world, levelPath))
+		exit(EXIT_FAILURE);
+	workers.Create(numThreads);
+	SpawnCircles(world, numStartCircles);
+	if (headlessSteps > 0)
+		return RunHeadless(headlessSteps, timestep.StepSeconds, isSwept, recordPath);
 
 	if (!glfwInit()) {
 		exit(EXIT_FAILURE);
 	}
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
 	GLFWwindow* window = glfwCreateWindow(1280, 800, "Justin Starr CS-330 Module 8 Coding Collisions", NULL, NULL);
 	if (!window) {
 		glfwTerminate();
 		exit(EXIT_FAILURE);
 	}
 	glfwMakeContextCurrent(window);
-	glfwSwapInterval(1);
-
-	// each brick starts off green and change color as they are collided with. When the bricks lose all of their health, they are destroyed
-	Brick brick1(DESTRUCTABLE, 0.0, 0.0, 0.2, 4000); 
-	Brick brick2(DESTRUCTABLE, 0.0, 0.2, 0.2, 4000); 
-	Brick brick3(DESTRUCTABLE, -0.2, 0.0, 0.2, 4000); 
-	Brick brick4(DESTRUCTABLE, 0.2, 0, 0.2, 4000); 
-	Brick brick5(DESTRUCTABLE, 0.0, -0.2, 0.2, 4000); 
-	Brick brick6(DESTRUCTABLE, -0.2, -0.2, 0.2, 4000); 
-	Brick brick7(DESTRUCTABLE, 0.2, -0.2, 0.2, 4000); 
-	Brick brick8(DESTRUCTABLE, -0.4, -0.2, 0.2, 4000); 
-	Brick brick9(DESTRUCTABLE, 0.4, -0.2, 0.2, 4000);
+	glfwSwapInterval(renderRate > 0 ? 0 : 1);
+
+	// GLEW loads the core-profile functions
+	glewExperimental = GL_TRUE;
+	if (glewInit() != GLEW_OK || !renderer.Create()) {
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
+
+	double reportTime = glfwGetTime();
+	double frameTime = reportTime;
+	int frameCount = 0;
+	int stepCount = 0;
 
 	while (!glfwWindowShouldClose(window)) {
 		//Setup View
@@ -282,52 +361,41 @@ int main(void) {
 		// calls the function to process any input from the user
 		processInput(window);
 
-		//Movement
-		for (int i = 0; i < world.size(); i++)
+		// collisions and movement: the fixed steps that fit in the time since the last frame
+		double now = glfwGetTime();
+		int steps = timestep.Advance(now - frameTime);
+		frameTime = now;
+		for (int step = 0; step < steps; step++)
 		{
-			// checks collisions with bricks
-			world[i].CheckCollision(&brick1);
-			world[i].CheckCollision(&brick2);
-			world[i].CheckCollision(&brick3);
-			world[i].CheckCollision(&brick4);
-			world[i].CheckCollision(&brick5);
-			world[i].CheckCollision(&brick6);
-			world[i].CheckCollision(&brick7);
-			world[i].CheckCollision(&brick8);
-			world[i].CheckCollision(&brick9);
-
-			// checks circle collisions
-			Circle& currentCircle = world[i];
-
-			if (i + 1 < world.size()) {
-				for (int l = i + 1; l < world.size(); l++) {
-					Circle& otherCircle = world[l];
-					currentCircle.CheckCircleCollision(otherCircle);
-				}
-			}
-
-			// moves the circle
-			world[i].MoveOneStep(currentCircle);
-			// draws the circle
-			world[i].DrawCircle();
-
+			recorder.Record(world, (float)timestep.StepSeconds, isSwept);
+			StepWorld(world, workers, (float)timestep.StepSeconds, isSwept);
 		}
+		stepCount += steps;
 
-		// draws the bricks
-		brick1.drawBrick();
-		brick2.drawBrick();
-		brick3.drawBrick();
-		brick4.drawBrick();
-		brick5.drawBrick();
-		brick6.drawBrick();
-		brick7.drawBrick();
-		brick8.drawBrick();
-		brick9.drawBrick();
+		// draws the circles and bricks between the last two physics steps
+		DrawWorld(world.Circles, world.Bricks, workers, timestep.Alpha());
 
 		glfwSwapBuffers(window);
+		if (renderRate > 0)
+			WaitForNextFrame(frameTime + 1.0 / renderRate);
+
+		// reports the frame time every few seconds
+		frameCount++;
+		now = glfwGetTime();
+		if (now - reportTime >= 5.0) {
+			printf("%d circles (%d awake): %.2f ms per frame, %.0f physics steps per second\n", world.Circles.Size(), world.Islands.NumAwake,
+				1000.0 * (now - reportTime) / frameCount, stepCount / (now - reportTime));
+			reportTime = now;
+			frameCount = 0;
+			stepCount = 0;
+		}
 		glfwPollEvents();
 	}
 
+	if (recordPath)
+		recorder.Save(recordPath);
+	renderer.Destroy();
+	workers.Destroy();
 	glfwDestroyWindow(window);
 	glfwTerminate;
 	exit(EXIT_SUCCESS);
@@ -344,14 +412,305 @@ void processInput(GLFWwindow* window)
 	if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
 	{
 		double r, g, b;
-		int randDirection = (rand() % 8) + 1;
-		int randX = (rand() % 2);
-		int randY = (rand() % 2);
-		r = rand() / 10000;
-		g = rand() / 10000;
-		b = rand() / 10000;
+		float vx, vy;
+		DirectionVelocity((world.NextSpawnRandom() % 8) + 1, CIRCLE_SPEED, vx, vy);
+		int randX = (world.NextSpawnRandom() % 2);
+		int randY = (world.NextSpawnRandom() % 2);
+		r = GetRandomColor(world.NextSpawnRandom());
+		g = GetRandomColor(world.NextSpawnRandom());
+		b = GetRandomColor(world.NextSpawnRandom());
 		// creates a new circle ans positions it randomly and set with a random direction and random color
-		Circle B(randX, randY, 02, randDirection, 0.05, r, g, b);
-		world.push_back(B);
+		world.Circles.Add(randX, randY, vx, vy, 0.05, r, g, b);
 	}
-}
\ No newline at end of file
+
+	// for the backspace key: back REWIND_SECONDS of simulated time, once per press
+	bool isRewindPressed = glfwGetKey(window, GLFW_KEY_BACKSPACE) == GLFW_PRESS;
+	if (isRewindPressed && !wasRewindPressed && !recorder.IsEmpty())
+		recorder.Restore(world, workers, recorder.StepBefore(REWIND_SECONDS));
+	wasRewindPressed = isRewindPressed;
+}
+
+// sleeps until shortly before a frame time given by glfwGetTime, then waits out the rest, which the sleep is too coarse for
+void WaitForNextFrame(double frameTime)
+{
+	double wait = frameTime - glfwGetTime();
+	if (wait > 0.002)
+		this_thread::sleep_for(chrono::duration<double>(wait - 0.002));
+	while (glfwGetTime() < frameTime)
+		this_thread::yield();
+}
+
+// adds count circles at random positions, with radii that keep the share of the screen they cover the same for every count
+void SpawnBenchmarkCircles(vector<Circle>& circles, int count)
+{
+	const float coverage = 0.2f; // share of the 2 x 2 screen covered by circles
+	float radius = sqrt(coverage * 4 / (3.14159f * count));
+
+	circles.clear();
+	circles.reserve(count);
+	for (int i = 0; i < count; i++)
+	{
+		float x = (rand() / (float)RAND_MAX) * 2 - 1;
+		float y = (rand() / (float)RAND_MAX) * 2 - 1;
+		circles.push_back(Circle(x, y, radius, (rand() % 8) + 1, radius, 1, 1, 1));
+	}
+}
+
+// milliseconds per collision and movement step of count circles, with the grid or by testing every pair
+double TimeCollisionSteps(int count, bool isGridUsed, int steps)
+{
+	vector<Circle> circles;
+	UniformGrid circleGrid;
+	srand(1);
+	SpawnBenchmarkCircles(circles, count);
+
+	auto start = chrono::steady_clock::now();
+	for (int step = 0; step < steps; step++)
+	{
+		if (isGridUsed)
+			CheckCircleCollisions(circles, circleGrid);
+		else
+		{
+			for (int i = 0; i < (int)circles.size(); i++)
+				for (int l = i + 1; l < (int)circles.size(); l++)
+					circles[i].CheckCircleCollision(circles[l]);
+		}
+
+		for (int i = 0; i < (int)circles.size(); i++)
+			circles[i].MoveOneStep(circles[i]);
+	}
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / steps;
+}
+
+// prints the step time of the grid and of the all-pairs test from 1k to 1M circles
+int RunBroadphaseBenchmark()
+{
+	const int counts[] = { 1000, 10000, 100000, 1000000 };
+	const int bruteForceLimit = 10000; // testing every pair of more circles takes minutes
+
+	printf("circles      grid ms   ns/circle   all pairs ms\n");
+	for (int count : counts)
+	{
+		int steps = max(3, 3000000 / count);
+		double gridMs = TimeCollisionSteps(count, true, steps);
+		printf("%7d   %10.3f   %9.1f", count, gridMs, gridMs * 1e6 / count);
+		if (count <= bruteForceLimit)
+			printf("   %12.3f\n", TimeCollisionSteps(count, false, max(1, steps / 100)));
+		else
+			printf("              -\n");
+	}
+	return EXIT_SUCCESS;
+}
+
+// the circles of SpawnBenchmarkCircles in a structure-of-arrays store
+void CopyToStore(const vector<Circle>& circles, CircleStore& store)
+{
+	store.Clear();
+	store.Reserve((int)circles.size());
+	for (const Circle& circle : circles)
+	{
+		float vx, vy;
+		DirectionVelocity(circle.direction, circle.speed * REFERENCE_RATE, vx, vy);
+		store.Add(circle.x, circle.y, vx, vy, circle.radius, circle.red, circle.green, circle.blue);
+	}
+}
+
+// prints the circles updated per second by a collision and movement step of the Circle objects and of the store
+int RunSoaBenchmark()
+{
+	const int counts[] = { 1000, 10000, 100000, 1000000 };
+
+	printf("%s kernels, %d circles per instruction\n", CIRCLE_SIMD_NAME, CIRCLE_SIMD_WIDTH);
+	printf("circles   objects M/s   arrays M/s   speedup\n");
+	for (int count : counts)
+	{
+		int steps = max(3, 3000000 / count);
+		vector<Circle> circles;
+		srand(1);
+		SpawnBenchmarkCircles(circles, count);
+
+		CircleStore store;
+		UniformGrid circleGrid;
+		WorkerPool singleThread;
+		CopyToStore(circles, store);
+
+		auto start = chrono::steady_clock::now();
+		for (int step = 0; step < steps; step++)
+		{
+			CheckCircleCollisions(circles, circleGrid);
+			for (int i = 0; i < (int)circles.size(); i++)
+				circles[i].MoveOneStep(circles[i]);
+		}
+		double objectSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		start = chrono::steady_clock::now();
+		for (int step = 0; step < steps; step++)
+		{
+			CheckCircleCollisions(store, circleGrid, singleThread, store.Size());
+			MoveCircles(store, 1 / REFERENCE_RATE);
+		}
+		double arraySeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		double objectRate = (double)count * steps / objectSeconds / 1e6;
+		double arrayRate = (double)count * steps / arraySeconds / 1e6;
+		printf("%7d   %11.1f   %10.1f   %6.2fx\n", count, objectRate, arrayRate, arrayRate / objectRate);
+	}
+	return EXIT_SUCCESS;
+}
+
+// prints the physics step time with 1 to 32 threads and fails when any thread count gives different circles
+int RunParallelBenchmark()
+{
+	const int count = 200000;
+	// fewer steps than COMPACT_INTERVAL: this many circles halve each other below MIN_CIRCLE_RADIUS within a second and the
+	// first removal after that would leave nothing to compare
+	const int steps = COMPACT_INTERVAL - 1;
+	const int threadCounts[] = { 1, 2, 4, 8, 16, 32 };
+
+	vector<Circle> circles;
+	srand(1);
+	SpawnBenchmarkCircles(circles, count);
+
+	printf("%d circles, %d steps, %d hardware threads\n", count, steps, (int)thread::hardware_concurrency());
+	printf("threads   ms/step   speedup   hash\n");
+	double singleThreadMs = 0;
+	unsigned long long singleThreadHash = 0;
+	bool isDeterministic = true;
+	for (int threads : threadCounts)
+	{
+		CollisionWorld benchmarkWorld;
+		benchmarkWorld.Circles.Seed = 1;
+		CopyToStore(circles, benchmarkWorld.Circles);
+		LoadLevel(benchmarkWorld, NULL);
+		WorkerPool pool;
+		pool.Create(threads);
+
+		auto start = chrono::steady_clock::now();
+		for (int step = 0; step < steps; step++)
+			StepWorld(benchmarkWorld, pool, 1 / REFERENCE_RATE, true);
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / steps;
+		pool.Destroy();
+
+		unsigned long long hash = HashCircles(benchmarkWorld.Circles);
+		if (threads == 1)
+		{
+			singleThreadMs = ms;
+			singleThreadHash = hash;
+		}
+		isDeterministic = isDeterministic && hash == singleThreadHash;
+		printf("%7d   %7.3f   %6.2fx   %016llx%s\n", threads, ms, singleThreadMs / ms, hash, hash == singleThreadHash ? "" : "   DIFFERENT");
+	}
+	return isDeterministic ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// runs steps physics steps of the world without a window, as fast as the threads allow, and prints the steps per second.
+// With a record path the steps are recorded and written to it.
+int RunHeadless(int steps, double stepSeconds, bool isSwept, const char* recordPath)
+{
+	auto start = chrono::steady_clock::now();
+	for (int step = 0; step < steps; step++)
+	{
+		if (recordPath)
+			recorder.Record(world, (float)stepSeconds, isSwept);
+		StepWorld(world, workers, (float)stepSeconds, isSwept);
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	printf("%d circles (%d awake), %d bricks, %d steps of %.2f ms on %d threads: %.1f steps per second (%.1fx real time), hash %016llx\n",
+		world.Circles.Size(), world.Islands.NumAwake, (int)world.Bricks.Bricks.size(), steps, stepSeconds * 1000.0, workers.NumThreads(), steps / seconds, steps * stepSeconds / seconds,
+		HashCircles(world.Circles));
+	workers.Destroy();
+	if (recordPath && !recorder.Save(recordPath))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+// bricks of the swept benchmark: a 4 x 4 field of reflective bricks that are narrower than the distance the benchmark's circles
+// move in a 60 Hz step
+vector<Brick> CreateBenchmarkBricks()
+{
+	vector<Brick> bricks;
+	for (int row = 0; row < 4; row++)
+		for (int column = 0; column < 4; column++)
+			bricks.push_back(Brick(REFLECTIVE, -0.6f + 0.4f * column, -0.6f + 0.4f * row, 0.015f, 4000));
+	return bricks;
+}
+
+// circles that went through a brick in the last step without hitting it: they hit no brick, did not jump in a circle collision,
+// and their straight path from the previous position crossed a brick they are not inside now. Tests every brick, without the index.
+int CountTunnelledBricks(const CollisionWorld& benchmarkWorld)
+{
+	const CircleStore& circles = benchmarkWorld.Circles;
+	int tunnelled = 0;
+	for (int i = 0; i < circles.Size(); i++)
+	{
+		float dx = circles.x[i] - circles.previousX[i], dy = circles.y[i] - circles.previousY[i];
+		if (benchmarkWorld.BrickHits[i] || fabs(dx) > MAX_INTERPOLATED_MOVE || fabs(dy) > MAX_INTERPOLATED_MOVE)
+			continue;
+		for (const Brick& brk : benchmarkWorld.Bricks.Bricks)
+		{
+			if (brk.onoff != ON)
+				continue;
+			float minX, minY, maxX, maxY;
+			brk.GetBox(minX, minY, maxX, maxY);
+			if (SweptBoxTime(circles.previousX[i], circles.previousY[i], dx, dy, minX, minY, maxX, maxY) >= 0 && !IsInsideBrick(circles, i, brk))
+			{
+				tunnelled++;
+				break;
+			}
+		}
+	}
+	return tunnelled;
+}
+
+// runs the same fast circles for two simulated seconds with the discrete and the swept tests at several physics rates and prints
+// the step time and the collisions found and missed per simulated second. The discrete test at 960 Hz is the reference for
+// the number of collisions.
+int RunSweptBenchmark()
+{
+	const int count = 10000;
+	const float speedScale = 5; // 3 units per second, 0.05 per 60 Hz step against bricks 0.03 wide
+	const double simulatedSeconds = 2;
+	struct Run { double rate; bool isSwept; };
+	const Run runs[] = { { 960, false }, { 240, false }, { 120, false }, { 60, false }, { 30, false },
+		{ 240, true }, { 120, true }, { 60, true }, { 30, true } };
+
+	WorkerPool pool;
+	pool.Create(0);
+	printf("%d circles at %.1f units per second, %d threads\n", count, CIRCLE_SPEED * speedScale, pool.NumThreads());
+	printf("test        Hz   ms/step   ms per sim s   circle pairs/s   brick hits/s   tunnelled/s\n");
+	for (const Run& run : runs)
+	{
+		CollisionWorld benchmarkWorld;
+		CircleStore& store = benchmarkWorld.Circles;
+		store.Seed = 1;
+		SpawnCircles(benchmarkWorld, count);
+		for (int i = 0; i < store.Size(); i++)
+		{
+			store.vx[i] *= speedScale;
+			store.vy[i] *= speedScale;
+		}
+		benchmarkWorld.Bricks.Bricks = CreateBenchmarkBricks();
+		benchmarkWorld.Bricks.Build();
+		// CountTunnelledBricks reads the brick hits by circle index, which putting circles to sleep would reorder
+		benchmarkWorld.Islands.IsEnabled = false;
+
+		int steps = (int)(simulatedSeconds * run.rate);
+		float seconds = (float)(1 / run.rate);
+		long long circlePairs = 0, hits = 0, tunnelled = 0;
+		double stepMs = 0;
+		for (int step = 0; step < steps; step++)
+		{
+			auto start = chrono::steady_clock::now();
+			StepContacts contacts = StepWorld(benchmarkWorld, pool, seconds, run.isSwept);
+			stepMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			circlePairs += contacts.circlePairs;
+			hits += contacts.brickHits;
+			tunnelled += CountTunnelledBricks(benchmarkWorld);
+		}
+		printf("%-8s %5.0f   %7.3f   %12.1f   %14.0f   %12.0f   %11.0f\n", run.isSwept ? "swept" : "discrete", run.rate,
+			stepMs / steps, stepMs / simulatedSeconds, circlePairs / simulatedSeconds, hits / simulatedSeconds, tunnelled / simulatedSeconds);
+	}
+	pool.Destroy();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,335 @@
+#pragma once
+/* Bricks loaded from a level file and indexed by a grid for the circle tests.
+
+The bricks are kept in one array (Bricks) and a uniform grid over them lists, for every
+cell, the bricks whose box overlaps it. A circle only tests the bricks of the cell that
+holds its center (ForEachBrickAt), or of the cells its path crosses in a step
+(ForEachBrickNear), instead of every brick. The bricks do not move, so the index is built
+once; a brick that is turned off is taken out of the cells it overlaps (Remove) without
+touching the others.
+
+Level files are text, one brick or row of bricks per line, with # comments:
+
+    brick <type> <x> <y> <width> <strength>
+    grid <type> <columns> <rows> <x> <y> <spacing> <width> <strength>
+
+where type is reflective or destructable, (x, y) is the center of the brick (of the
+bottom-left brick for grid), and width is half the side of the box in which a circle's
+center hits the brick. grid places columns x rows bricks spacing apart, so a single line
+can make a level of 100k bricks.
+*/
+
+#ifndef BRICK_FIELD_H
+#define BRICK_FIELD_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+enum BRICKTYPE { REFLECTIVE, DESTRUCTABLE };
+enum ONOFF { ON, OFF };
+
+// Largest number of index cells along either axis
+const int BRICK_MAX_CELLS_PER_AXIS = 2048;
+
+class Brick
+{
+public:
+	float red, green, blue;
+	float x, y, width;
+	BRICKTYPE brick_type;
+	ONOFF onoff;
+	int brick_strength;
+
+	Brick(BRICKTYPE bt, float xx, float yy, float ww, int strength)
+	{
+		brick_type = bt;
+		x = xx;
+		y = yy;
+		width = ww;
+		brick_strength = strength;;
+		red = 1;
+		green = 1;
+		blue = 1;
+		onoff = ON;
+	};
+
+	// as the brick's strength is reduced the color of each brick is changed
+	void UpdateColor()
+	{
+		if (brick_strength == 4000) {
+			red = 0;
+			green = 1; // green color to indicate strong
+			blue = 0;
+		}
+		else if (brick_strength == 3000) {
+			red = 1; // a yellow color to indicate medium strength
+			green = 1;
+			blue = 0;
+		}
+		else if (brick_strength == 2000) {
+			red = 1; // a red color to indicate weak strength
+			green = 0;
+			blue = 0;
+		}
+	}
+
+	void ReduceStrength() {
+		brick_strength -= 200;
+	}
+
+	// the box in which a circle's center hits the brick
+	void GetBox(float& minX, float& minY, float& maxX, float& maxY) const
+	{
+		minX = x - width;
+		minY = y - width;
+		maxX = x + width;
+		maxY = y + width;
+	}
+};
+
+class BrickField
+{
+public:
+	std::vector<Brick> Bricks;
+	float MinX, MinY;           // corner of cell (0, 0)
+	float CellSize;
+	int NumCellsX, NumCellsY;
+	std::vector<int> CellStart; // the bricks of cell c are Items[CellStart[c]] to Items[CellStart[c] + CellCount[c] - 1]
+	std::vector<int> CellCount; // bricks of each cell that are still on
+	std::vector<int> Items;     // brick indices grouped by cell
+
+	BrickField() : MinX(0), MinY(0), CellSize(1), NumCellsX(0), NumCellsY(0), numBricksOn(0) {}
+
+	// reads the bricks of a level file and indexes them. Returns false (after printing the problem) when the file is missing or malformed.
+	bool Load(const char* path)
+	{
+		FILE* file = fopen(path, "r");
+		if (!file)
+		{
+			fprintf(stderr, "Failed to open the level %s\n", path);
+			return false;
+		}
+
+		Bricks.clear();
+		char line[256];
+		int lineNumber = 0;
+		bool isValid = true;
+		while (isValid && fgets(line, sizeof(line), file))
+		{
+			lineNumber++;
+			const char* text = line + strspn(line, " \t\r\n");
+			if (*text == '\0' || *text == '#')
+				continue;
+
+			char type[16];
+			float x, y, spacing, width;
+			int columns, rows, strength;
+			BRICKTYPE brickType;
+			if (sscanf(text, "brick %15s %f %f %f %d", type, &x, &y, &width, &strength) == 5)
+			{
+				columns = 1;
+				rows = 1;
+				spacing = 0;
+			}
+			else if (sscanf(text, "grid %15s %d %d %f %f %f %f %d", type, &columns, &rows, &x, &y, &spacing, &width, &strength) != 8)
+			{
+				fprintf(stderr, "%s:%d: expected 'brick type x y width strength' or 'grid type columns rows x y spacing width strength'\n", path, lineNumber);
+				isValid = false;
+				continue;
+			}
+
+			if (!parseType(type, brickType))
+			{
+				fprintf(stderr, "%s:%d: unknown brick type '%s' (reflective or destructable)\n", path, lineNumber, type);
+				isValid = false;
+			}
+			else if (columns < 1 || rows < 1 || width <= 0)
+			{
+				fprintf(stderr, "%s:%d: the columns, rows and width must be positive\n", path, lineNumber);
+				isValid = false;
+			}
+			else
+			{
+				for (int row = 0; row < rows; row++)
+					for (int column = 0; column < columns; column++)
+						Bricks.push_back(Brick(brickType, x + column * spacing, y + row * spacing, width, strength));
+			}
+		}
+		fclose(file);
+
+		if (isValid && Bricks.empty())
+		{
+			fprintf(stderr, "%s: no bricks\n", path);
+			isValid = false;
+		}
+		if (isValid)
+			Build();
+		return isValid;
+	}
+
+	// indexes the bricks that are on; called after Bricks changes
+	void Build()
+	{
+		// Bounds of the boxes and the average box size
+		float maxX = 0, maxY = 0, sizeSum = 0;
+		MinX = MinY = 0;
+		bool isFirst = true;
+		numBricksOn = 0;
+		for (const Brick& brk : Bricks)
+		{
+			if (brk.onoff != ON)
+				continue;
+			float minX, minY, boxMaxX, boxMaxY;
+			brk.GetBox(minX, minY, boxMaxX, boxMaxY);
+			if (isFirst)
+			{
+				MinX = minX;
+				MinY = minY;
+				maxX = boxMaxX;
+				maxY = boxMaxY;
+				isFirst = false;
+			}
+			MinX = std::min(MinX, minX);
+			MinY = std::min(MinY, minY);
+			maxX = std::max(maxX, boxMaxX);
+			maxY = std::max(maxY, boxMaxY);
+			sizeSum += 2 * brk.width;
+			numBricksOn++;
+		}
+
+		// Cells about as wide as a brick, so each brick overlaps a few cells
+		float extent = std::max(maxX - MinX, maxY - MinY);
+		CellSize = std::max(numBricksOn > 0 ? sizeSum / numBricksOn : 1.0f, extent / (BRICK_MAX_CELLS_PER_AXIS - 1));
+		NumCellsX = numBricksOn > 0 ? std::min(BRICK_MAX_CELLS_PER_AXIS, (int)((maxX - MinX) / CellSize) + 1) : 0;
+		NumCellsY = numBricksOn > 0 ? std::min(BRICK_MAX_CELLS_PER_AXIS, (int)((maxY - MinY) / CellSize) + 1) : 0;
+
+		// Counting sort of the (brick, cell) pairs: bricks per cell, prefix sum, then scatter
+		int numCells = NumCellsX * NumCellsY;
+		CellStart.assign(numCells + 1, 0);
+		forEachCoveredCell([&](int, int cell) { CellStart[cell + 1]++; });
+		for (int c = 0; c < numCells; c++)
+			CellStart[c + 1] += CellStart[c];
+		Items.resize(CellStart[numCells]);
+		CellCount.assign(numCells, 0);
+		forEachCoveredCell([&](int k, int cell) { Items[CellStart[cell] + CellCount[cell]++] = k; });
+	}
+
+	// takes brick k, just turned off, out of the cells it overlaps
+	void Remove(int k)
+	{
+		int firstX, firstY, lastX, lastY;
+		if (!cellRange(Bricks[k], firstX, firstY, lastX, lastY))
+			return;
+		for (int cy = firstY; cy <= lastY; cy++)
+			for (int cx = firstX; cx <= lastX; cx++)
+			{
+				int cell = cy * NumCellsX + cx;
+				int* items = Items.data() + CellStart[cell];
+				int* last = items + CellCount[cell];
+				int* found = std::find(items, last, k);
+				if (found == last)
+					continue;
+				// keep the cell's bricks in index order so the hits are applied in the same order as before
+				std::copy(found + 1, last, found);
+				CellCount[cell]--;
+			}
+		numBricksOn--;
+	}
+
+	// writes the bricks to a snapshot archive or reads them back and indexes them (see world_recorder.h)
+	template <typename Archive>
+	void Serialize(Archive& archive)
+	{
+		int count = (int)Bricks.size();
+		archive.Length(count, sizeof(Brick));
+		if (Archive::IsReading)
+			Bricks.assign(count, Brick(REFLECTIVE, 0, 0, 0, 0));
+		for (Brick& brk : Bricks)
+			archive.Value(brk);
+		if (Archive::IsReading)
+			Build();
+	}
+
+	int NumBricksOn() const
+	{
+		return numBricksOn;
+	}
+
+	// calls visit(k) for every brick that is on in the cell of a point, in index order; nothing outside the field
+	template <typename Visit>
+	void ForEachBrickAt(float x, float y, const Visit& visit) const
+	{
+		int cx = (int)std::floor((x - MinX) / CellSize), cy = (int)std::floor((y - MinY) / CellSize);
+		if (cx < 0 || cy < 0 || cx >= NumCellsX || cy >= NumCellsY)
+			return;
+		int cell = cy * NumCellsX + cx;
+		for (int item = CellStart[cell]; item < CellStart[cell] + CellCount[cell]; item++)
+			visit(Items[item]);
+	}
+
+	// calls visit(k) for the bricks that are on in the cells a box overlaps; a brick that overlaps several of them is visited once per cell
+	template <typename Visit>
+	void ForEachBrickNear(float minX, float minY, float maxX, float maxY, const Visit& visit) const
+	{
+		int firstX, firstY, lastX, lastY;
+		if (!boxCellRange(minX, minY, maxX, maxY, firstX, firstY, lastX, lastY))
+			return;
+		for (int cy = firstY; cy <= lastY; cy++)
+			for (int cx = firstX; cx <= lastX; cx++)
+			{
+				int cell = cy * NumCellsX + cx;
+				for (int item = CellStart[cell]; item < CellStart[cell] + CellCount[cell]; item++)
+					visit(Items[item]);
+			}
+	}
+
+private:
+	int numBricksOn;
+
+	static bool parseType(const char* name, BRICKTYPE& type)
+	{
+		if (strcmp(name, "reflective") == 0)
+			type = REFLECTIVE;
+		else if (strcmp(name, "destructable") == 0)
+			type = DESTRUCTABLE;
+		else
+			return false;
+		return true;
+	}
+
+	// cells overlapped by a box, clamped to the field. Returns false when the box is outside it.
+	bool boxCellRange(float minX, float minY, float maxX, float maxY, int& firstX, int& firstY, int& lastX, int& lastY) const
+	{
+		firstX = std::max(0, (int)std::floor((minX - MinX) / CellSize));
+		firstY = std::max(0, (int)std::floor((minY - MinY) / CellSize));
+		lastX = std::min(NumCellsX - 1, (int)std::floor((maxX - MinX) / CellSize));
+		lastY = std::min(NumCellsY - 1, (int)std::floor((maxY - MinY) / CellSize));
+		return firstX <= lastX && firstY <= lastY;
+	}
+
+	bool cellRange(const Brick& brk, int& firstX, int& firstY, int& lastX, int& lastY) const
+	{
+		float minX, minY, maxX, maxY;
+		brk.GetBox(minX, minY, maxX, maxY);
+		return boxCellRange(minX, minY, maxX, maxY, firstX, firstY, lastX, lastY);
+	}
+
+	// calls visit(k, cell) for every brick that is on and every cell it overlaps, in brick order
+	template <typename Visit>
+	void forEachCoveredCell(const Visit& visit) const
+	{
+		for (int k = 0; k < (int)Bricks.size(); k++)
+		{
+			int firstX, firstY, lastX, lastY;
+			if (Bricks[k].onoff != ON || !cellRange(Bricks[k], firstX, firstY, lastX, lastY))
+				continue;
+			for (int cy = firstY; cy <= lastY; cy++)
+				for (int cx = firstX; cx <= lastX; cx++)
+					visit(k, cy * NumCellsX + cx);
+		}
+	}
+};
+#endif
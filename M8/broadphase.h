@@ -0,0 +1,196 @@
+#pragma once
+/* Uniform-grid broadphase for the circle collisions.
+
+Build puts every circle in the square cell that holds its center. The cells are at least
+as wide as the largest circle, so two circles can only touch when their cells are the same
+or neighbours. The grid is rebuilt every step with a counting sort into flat arrays: one
+pass counts the circles per cell, a prefix sum turns the counts into CellStart, and a
+second pass writes the circle indices into Items grouped by cell. Nothing is allocated
+once the arrays have grown to the largest circle count.
+
+ForEachCellPair and ForEachPair then visit each candidate pair once by looking at the
+circle's own cell and four of its eight neighbours (the other four visit it in turn). The cost of a step grows
+with the number of circles, not with its square, as long as the circles per cell stay
+bounded.
+*/
+
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Largest number of cells along either axis
+const int GRID_MAX_CELLS_PER_AXIS = 4096;
+
+// Colors of ForEachCellPairOfColor: cells of one color never visit the same circles
+const int GRID_NUM_COLORS = 6;
+
+class UniformGrid
+{
+public:
+	float MinX, MinY;           // corner of cell (0, 0)
+	float CellSize;
+	int NumCellsX, NumCellsY;
+	std::vector<int> CellStart; // Items[CellStart[c]] to Items[CellStart[c + 1] - 1] are the circles in cell c
+	std::vector<int> Items;     // circle indices sorted by cell
+	std::vector<int> ItemCell;  // cell of each circle
+
+	UniformGrid() : MinX(0), MinY(0), CellSize(1), NumCellsX(1), NumCellsY(1) {}
+
+	// sorts count circles into cells. circle(i, x, y, radius) returns the center and radius of circle i.
+	template <typename GetCircle>
+	void Build(int count, const GetCircle& circle)
+	{
+		// Bounds of the centers and the largest radius
+		float minX = 0, minY = 0, maxX = 0, maxY = 0, maxRadius = 0;
+		for (int i = 0; i < count; i++)
+		{
+			float x, y, radius;
+			circle(i, x, y, radius);
+			if (i == 0)
+			{
+				minX = maxX = x;
+				minY = maxY = y;
+			}
+			minX = std::min(minX, x);
+			maxX = std::max(maxX, x);
+			minY = std::min(minY, y);
+			maxY = std::max(maxY, y);
+			maxRadius = std::max(maxRadius, radius);
+		}
+
+		// Cells as wide as the largest circle, but no more than about four cells per circle
+		float extent = std::max(maxX - minX, maxY - minY);
+		int maxCellsPerAxis = std::min(GRID_MAX_CELLS_PER_AXIS, 2 * (int)std::sqrt((float)count) + 1);
+		CellSize = std::max(2 * maxRadius, extent / maxCellsPerAxis);
+		if (CellSize <= 0)
+			CellSize = 1;
+		MinX = minX;
+		MinY = minY;
+		NumCellsX = std::min(maxCellsPerAxis, (int)((maxX - minX) / CellSize) + 1);
+		NumCellsY = std::min(maxCellsPerAxis, (int)((maxY - minY) / CellSize) + 1);
+
+		// Counting sort: circles per cell, prefix sum, then scatter
+		int numCells = NumCellsX * NumCellsY;
+		CellStart.assign(numCells + 1, 0);
+		ItemCell.resize(count);
+		Items.resize(count);
+		for (int i = 0; i < count; i++)
+		{
+			float x, y, radius;
+			circle(i, x, y, radius);
+			int cell = CellOf(x, y);
+			ItemCell[i] = cell;
+			CellStart[cell + 1]++;
+		}
+		for (int c = 0; c < numCells; c++)
+			CellStart[c + 1] += CellStart[c];
+
+		std::vector<int>& next = scratch;
+		next.assign(CellStart.begin(), CellStart.end() - 1);
+		for (int i = 0; i < count; i++)
+			Items[next[ItemCell[i]]++] = i;
+	}
+
+	// cell of a point, clamped to the grid
+	int CellOf(float x, float y) const
+	{
+		int cx = std::max(0, std::min(NumCellsX - 1, (int)((x - MinX) / CellSize)));
+		int cy = std::max(0, std::min(NumCellsY - 1, (int)((y - MinY) / CellSize)));
+		return cy * NumCellsX + cx;
+	}
+
+	// calls visit(item) for the Items of the cells a box overlaps and of the cells around them: with cells as wide as the largest
+	// circle, every circle that can reach into the box
+	template <typename Visit>
+	void ForEachItemNear(float minX, float minY, float maxX, float maxY, const Visit& visit) const
+	{
+		int firstX = std::max(0, (int)std::floor((minX - MinX) / CellSize) - 1);
+		int firstY = std::max(0, (int)std::floor((minY - MinY) / CellSize) - 1);
+		int lastX = std::min(NumCellsX - 1, (int)std::floor((maxX - MinX) / CellSize) + 1);
+		int lastY = std::min(NumCellsY - 1, (int)std::floor((maxY - MinY) / CellSize) + 1);
+		for (int cy = firstY; cy <= lastY; cy++)
+			for (int cx = firstX; cx <= lastX; cx++)
+			{
+				int cell = cy * NumCellsX + cx;
+				for (int item = CellStart[cell]; item < CellStart[cell + 1]; item++)
+					visit(Items[item]);
+			}
+	}
+
+	// calls visit(begin, end, otherBegin, otherEnd) once for every non-empty cell with itself and with each of its neighbours
+	// that has circles, where the ranges index Items. Ranges of the same cell are equal.
+	template <typename Visit>
+	void ForEachCellPair(const Visit& visit) const
+	{
+		for (int cy = 0; cy < NumCellsY; cy++)
+			for (int cx = 0; cx < NumCellsX; cx++)
+				visitCell(cx, cy, visit);
+	}
+
+	// cells of a color (0 to GRID_NUM_COLORS - 1)
+	int NumCellsOfColor(int color) const
+	{
+		return numColumnsOfColor(color) * std::max(0, (NumCellsY - color / 3 + 1) / 2);
+	}
+
+	// ForEachCellPair for the cells first to last - 1 of a color. The cells of a color are three columns and two rows
+	// apart, so the circles they visit (in their own cell and the right, up-left, up and up-right ones) never overlap
+	// and the cells of one color can be handled in any order or at the same time.
+	template <typename Visit>
+	void ForEachCellPairOfColor(int color, int first, int last, const Visit& visit) const
+	{
+		int columns = numColumnsOfColor(color);
+		for (int j = first; j < last; j++)
+			visitCell(color % 3 + 3 * (j % columns), color / 3 + 2 * (j / columns), visit);
+	}
+
+	// calls visit(i, j) once for every pair of circles in the same or neighbouring cells
+	template <typename Visit>
+	void ForEachPair(const Visit& visit) const
+	{
+		ForEachCellPair([&](int begin, int end, int otherBegin, int otherEnd) {
+			bool isSameCell = begin == otherBegin;
+			for (int a = begin; a < end; a++)
+				for (int b = isSameCell ? a + 1 : otherBegin; b < otherEnd; b++)
+					visit(Items[a], Items[b]);
+		});
+	}
+
+private:
+	std::vector<int> scratch; // write position of each cell during the scatter
+
+	int numColumnsOfColor(int color) const
+	{
+		return std::max(0, (NumCellsX - color % 3 + 2) / 3);
+	}
+
+	// visit of ForEachCellPair for one cell
+	template <typename Visit>
+	void visitCell(int cx, int cy, const Visit& visit) const
+	{
+		// Right, up-left, up and up-right; the other neighbours visit this cell
+		const int offsetX[4] = { 1, -1, 0, 1 };
+		const int offsetY[4] = { 0, 1, 1, 1 };
+
+		int cell = cy * NumCellsX + cx;
+		int begin = CellStart[cell], end = CellStart[cell + 1];
+		if (begin == end)
+			return;
+
+		visit(begin, end, begin, end);
+		for (int n = 0; n < 4; n++)
+		{
+			int nx = cx + offsetX[n], ny = cy + offsetY[n];
+			if (nx < 0 || nx >= NumCellsX || ny >= NumCellsY)
+				continue;
+
+			int neighbour = ny * NumCellsX + nx;
+			if (CellStart[neighbour] != CellStart[neighbour + 1])
+				visit(begin, end, CellStart[neighbour], CellStart[neighbour + 1]);
+		}
+	}
+};
+#endif
@@ -0,0 +1,561 @@
+#pragma once
+/* Structure-of-arrays storage of the circles.
+
+Each property of the circles has its own array (x, y, vx, vy, radius and the color
+channels), so the movement and the distance tests read only the arrays they need and
+process several circles per instruction. The velocity (vx, vy) replaces the old
+direction codes 1-8: a code becomes a vector with a component of -speed, 0 or +speed
+on each axis (DirectionVelocity). Velocities are in screen units per second and a step
+moves the circles by velocity * seconds, so the simulation runs at the same speed for any
+step length; previousX and previousY keep the positions before the last step so the
+circles can be drawn between two steps.
+
+The arrays stay dense: the circles are reordered every step and removed circles are
+squeezed out by Compact, so code that keeps a circle across steps holds a CircleHandle
+instead of an index. A handle names a slot whose index is updated whenever the circle
+moves in the arrays, and whose generation changes when the circle is removed, so an old
+handle never finds the circle that reuses its slot. Freed slots are reused before new
+ones are made, and the arrays only grow when more circles are alive than ever before, so
+the memory stays bounded however long the circles keep being spawned and removed.
+
+Every circle draws its random numbers from its own counter-based generator: the n-th
+number of a circle is a hash of the seed, the circle's id and n (CounterRandom), so it
+does not depend on which thread asks for it or on what other circles did before.
+
+The kernels are written with SSE2 (four circles at a time) or AVX2 (eight) intrinsics,
+chosen at compile time, with a scalar loop for the remaining circles and for other
+processors:
+
+    MoveCircles                 moves every circle by its velocity times the step; a circle that reached a
+                                side of the screen does not move on that axis this step and
+                                bounces back with its speed on that axis reduced
+    ForEachTouchingPair         tests the circles of each grid cell against the circles of
+                                the same and neighbouring cells and calls back for the pairs
+                                that overlap
+
+ForEachTouchingPair expects the store in cell order (SortByCell after UniformGrid::Build),
+so the circles of a cell are consecutive in every array.
+*/
+
+#ifndef CIRCLE_STORE_H
+#define CIRCLE_STORE_H
+
+#include "broadphase.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CIRCLE_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CIRCLE_SIMD_SSE2
+#endif
+
+// Frames per second the old per-frame speeds were made for (the 60 Hz vsync of the window)
+const float REFERENCE_RATE = 60.0f;
+
+// Speed lost on an axis each time a circle bounces off a side of the screen, in units per second
+const float WALL_SPEED_LOSS = 0.002f * REFERENCE_RATE;
+
+// n-th random number of a stream (SplitMix64 finalizer over the seed, the stream and the counter)
+inline unsigned int CounterRandom(unsigned long long seed, unsigned int stream, unsigned int counter)
+{
+	unsigned long long z = seed + 0x9E3779B97F4A7C15ULL * ((((unsigned long long)stream << 32) | counter) + 1);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return (unsigned int)((z ^ (z >> 31)) >> 32);
+}
+
+// Stable reference to a circle: stays valid while the circles are reordered and stops matching once the circle is removed
+struct CircleHandle
+{
+	unsigned int Slot;
+	unsigned int Generation;
+};
+
+class CircleStore
+{
+public:
+	std::vector<float> x, y;
+	std::vector<float> previousX, previousY; // position before the last step
+	std::vector<float> vx, vy;               // units per second
+	std::vector<float> radius;
+	std::vector<float> red, green, blue;
+	std::vector<unsigned int> id;       // random stream of each circle, kept when the circles are reordered
+	std::vector<unsigned int> draws;    // random numbers each circle has used
+	std::vector<unsigned int> slot;     // handle slot of each circle
+	std::vector<unsigned int> calmSteps; // steps each circle has been slow without touching anything (see sleep_islands.h)
+	std::vector<unsigned int> island;   // sleeping island of each circle
+	unsigned long long Seed;
+	unsigned long long Steps;           // physics steps taken, counted by the step function
+
+	CircleStore() : Seed(1), Steps(0), nextId(0) {}
+
+	int Size() const
+	{
+		return (int)x.size();
+	}
+
+	void Clear()
+	{
+		for (std::vector<float>* column : columns())
+			column->clear();
+		for (std::vector<unsigned int>* column : keyColumns())
+			column->clear();
+		slotIndex.clear();
+		slotGeneration.clear();
+		freeSlots.clear();
+		nextId = 0;
+		Steps = 0;
+	}
+
+	void Reserve(int count)
+	{
+		for (std::vector<float>* column : columns())
+			column->reserve(count);
+		for (std::vector<unsigned int>* column : keyColumns())
+			column->reserve(count);
+	}
+
+	// next random number of circle i
+	unsigned int NextRandom(int i)
+	{
+		return CounterRandom(Seed, id[i], draws[i]++);
+	}
+
+	// adds count circles at the end of the arrays, growing them once, and calls init(i) to set the position, velocity, radius and
+	// color of each new circle i. Returns the index of the first new circle.
+	template <typename Init>
+	int AddCircles(int count, const Init& init)
+	{
+		int first = Size();
+		if (count <= 0)
+			return first;
+		if (first + count > (int)x.capacity())
+			Reserve(std::max(first + count, 2 * (int)x.capacity()));
+
+		for (std::vector<float>* column : columns())
+			column->resize(first + count);
+		for (std::vector<unsigned int>* column : keyColumns())
+			column->resize(first + count);
+		for (int i = first; i < first + count; i++)
+		{
+			id[i] = nextId++;
+			draws[i] = 0;
+			slot[i] = allocateSlot(i);
+			calmSteps[i] = 0;
+			island[i] = 0;
+			init(i);
+			previousX[i] = x[i];
+			previousY[i] = y[i];
+		}
+		return first;
+	}
+
+	// adds a circle and returns its handle
+	CircleHandle Add(float xx, float yy, float vxx, float vyy, float rad, float r, float g, float b)
+	{
+		int i = AddCircles(1, [&](int k) {
+			x[k] = xx;
+			y[k] = yy;
+			vx[k] = vxx;
+			vy[k] = vyy;
+			radius[k] = rad;
+			red[k] = r;
+			green[k] = g;
+			blue[k] = b;
+		});
+		return Handle(i);
+	}
+
+	// handle of circle i
+	CircleHandle Handle(int i) const
+	{
+		CircleHandle handle = { slot[i], slotGeneration[slot[i]] };
+		return handle;
+	}
+
+	// current index of a circle, or -1 when it has been removed
+	int IndexOf(CircleHandle handle) const
+	{
+		if (handle.Slot >= slotIndex.size() || slotGeneration[handle.Slot] != handle.Generation)
+			return -1;
+		return slotIndex[handle.Slot];
+	}
+
+	// removes a circle at the next Compact; until then it stays in the arrays with no radius
+	void Remove(CircleHandle handle)
+	{
+		int i = IndexOf(handle);
+		if (i >= 0)
+			radius[i] = 0;
+	}
+
+	// removes the circles smaller than minRadius (and the removed ones), keeping the order of the others, and frees their
+	// handles. Returns the number of circles removed.
+	int Compact(float minRadius)
+	{
+		keptScratch.clear();
+		for (int i = 0; i < Size(); i++)
+		{
+			if (radius[i] >= minRadius)
+				keptScratch.push_back(i);
+			else
+			{
+				slotGeneration[slot[i]]++;
+				freeSlots.push_back(slot[i]);
+			}
+		}
+
+		// kept circle k moves down from keptScratch[k] >= k, so the arrays are compacted in place
+		int removed = Size() - (int)keptScratch.size();
+		if (removed == 0)
+			return 0;
+		for (std::vector<float>* column : columns())
+			compact(*column, keptScratch);
+		for (std::vector<unsigned int>* column : keyColumns())
+			compact(*column, keptScratch);
+		for (int i = 0; i < Size(); i++)
+			slotIndex[slot[i]] = i;
+		return removed;
+	}
+
+	// keeps the positions of circles [begin, end) as the previous ones before a step changes them
+	void SavePositions(int begin, int end)
+	{
+		std::copy(x.begin() + begin, x.begin() + end, previousX.begin() + begin);
+		std::copy(y.begin() + begin, y.begin() + end, previousY.begin() + begin);
+	}
+
+	// writes the circles to a snapshot archive or reads them back (see world_recorder.h). The previous positions are not kept: a
+	// restored circle is drawn where it is until the next step.
+	template <typename Archive>
+	void Serialize(Archive& archive)
+	{
+		archive.Value(Seed);
+		archive.Value(Steps);
+		archive.Value(nextId);
+		for (std::vector<float>* column : columns())
+			if (column != &previousX && column != &previousY)
+				archive.Column(*column);
+		for (std::vector<unsigned int>* column : keyColumns())
+			archive.Column(*column);
+		archive.Column(slotGeneration);
+		archive.Column(freeSlots);
+		if (!Archive::IsReading)
+			return;
+
+		bool isValid = archive.IsValid;
+		for (std::vector<float>* column : columns())
+			isValid = isValid && (column == &previousX || column == &previousY || column->size() == x.size());
+		for (std::vector<unsigned int>* column : keyColumns())
+			isValid = isValid && column->size() == x.size();
+		for (int i = 0; isValid && i < Size(); i++)
+			isValid = slot[i] < slotGeneration.size();
+		if (!isValid)
+		{
+			archive.IsValid = false;
+			return;
+		}
+		previousX = x;
+		previousY = y;
+		slotIndex.assign(slotGeneration.size(), 0);
+		for (int i = 0; i < Size(); i++)
+			slotIndex[slot[i]] = i;
+	}
+
+	// builds the grid of the first count circles and reorders them by cell; afterwards the circles of cell c are CellStart[c] to
+	// CellStart[c + 1] - 1. padding is added to every radius, to find the circles that can touch while moving that far.
+	void SortByCell(UniformGrid& grid, float padding, int count)
+	{
+		grid.Build(count, [this, padding](int i, float& cx, float& cy, float& cr) {
+			cx = x[i];
+			cy = y[i];
+			cr = radius[i] + padding;
+		});
+
+		Reorder(grid.Items);
+		for (int i = 0; i < count; i++)
+			grid.Items[i] = i;
+	}
+
+	// moves circle order[i] to index i for the first order.size() circles; order is a permutation of them
+	void Reorder(const std::vector<int>& order)
+	{
+		for (std::vector<float>* column : columns())
+			reorder(*column, order, scratch);
+		for (std::vector<unsigned int>* column : keyColumns())
+			reorder(*column, order, idScratch);
+		for (int i = 0; i < (int)order.size(); i++)
+			slotIndex[slot[i]] = i;
+	}
+
+private:
+	std::vector<float> scratch;
+	std::vector<unsigned int> idScratch;
+	std::vector<int> keptScratch;
+	unsigned int nextId;
+	std::vector<int> slotIndex;                 // index of the circle of each handle slot
+	std::vector<unsigned int> slotGeneration;   // changes each time the circle of a slot is removed
+	std::vector<unsigned int> freeSlots;        // slots of removed circles, reused first
+
+	unsigned int allocateSlot(int index)
+	{
+		unsigned int s;
+		if (!freeSlots.empty())
+		{
+			s = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			s = (unsigned int)slotIndex.size();
+			slotIndex.push_back(0);
+			slotGeneration.push_back(0);
+		}
+		slotIndex[s] = index;
+		return s;
+	}
+
+	template <typename T>
+	static void reorder(std::vector<T>& column, const std::vector<int>& order, std::vector<T>& reordered)
+	{
+		reordered.resize(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			reordered[i] = column[order[i]];
+		if (order.size() == column.size())
+			column.swap(reordered);
+		else
+			std::copy(reordered.begin(), reordered.end(), column.begin());
+	}
+
+	template <typename T>
+	static void compact(std::vector<T>& column, const std::vector<int>& kept)
+	{
+		for (size_t k = 0; k < kept.size(); k++)
+			column[k] = column[kept[k]];
+		column.resize(kept.size());
+	}
+
+	std::vector<std::vector<float>*> columns()
+	{
+		return { &x, &y, &previousX, &previousY, &vx, &vy, &radius, &red, &green, &blue };
+	}
+
+	std::vector<std::vector<unsigned int>*> keyColumns()
+	{
+		return { &id, &draws, &slot, &calmSteps, &island };
+	}
+};
+
+// velocity of an old direction code: 1=up 2=right 3=down 4=left 5=up right 6=up left 7=down right 8=down left (up is -y)
+inline void DirectionVelocity(int direction, float speed, float& vx, float& vy)
+{
+	vx = 0;
+	vy = 0;
+	if (direction == 1 || direction == 5 || direction == 6)
+		vy = -speed;
+	if (direction == 2 || direction == 5 || direction == 7)
+		vx = speed;
+	if (direction == 3 || direction == 7 || direction == 8)
+		vy = speed;
+	if (direction == 4 || direction == 6 || direction == 8)
+		vx = -speed;
+}
+
+// speed of a velocity in the sense of the direction codes: the distance moved along each axis it moves on
+inline float CircleSpeed(float vx, float vy)
+{
+	return std::max(std::fabs(vx), std::fabs(vy));
+}
+
+// reverses a velocity component and takes WALL_SPEED_LOSS off it (never below zero)
+inline float BounceVelocity(float v)
+{
+	float speed = std::max(std::fabs(v) - WALL_SPEED_LOSS, 0.0f);
+	return v > 0 ? -speed : speed;
+}
+
+// one axis of MoveCircles without SIMD
+inline void moveAxis(float& position, float& velocity, float radius, float seconds)
+{
+	bool isAtSide = (velocity > 0 && position >= 1 - radius) || (velocity < 0 && position <= -1 + radius);
+	if (isAtSide)
+		velocity = BounceVelocity(velocity);
+	else
+		position += velocity * seconds;
+}
+
+#if defined(CIRCLE_SIMD_AVX2)
+const int CIRCLE_SIMD_WIDTH = 8;
+const char* const CIRCLE_SIMD_NAME = "AVX2";
+#elif defined(CIRCLE_SIMD_SSE2)
+const int CIRCLE_SIMD_WIDTH = 4;
+const char* const CIRCLE_SIMD_NAME = "SSE2";
+#else
+const int CIRCLE_SIMD_WIDTH = 1;
+const char* const CIRCLE_SIMD_NAME = "scalar";
+#endif
+
+#if defined(CIRCLE_SIMD_AVX2)
+// one axis of MoveCircles for eight circles
+inline void moveAxis8(float* position, float* velocity, const float* radius, float seconds)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+	__m256 p = _mm256_loadu_ps(position);
+	__m256 v = _mm256_loadu_ps(velocity);
+	__m256 r = _mm256_loadu_ps(radius);
+
+	__m256 atHigh = _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GT_OQ), _mm256_cmp_ps(p, _mm256_sub_ps(one, r), _CMP_GE_OQ));
+	__m256 atLow = _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_LT_OQ), _mm256_cmp_ps(p, _mm256_sub_ps(r, one), _CMP_LE_OQ));
+	__m256 isAtSide = _mm256_or_ps(atHigh, atLow);
+
+	// bounced: the reduced speed with the opposite sign of v
+	__m256 speed = _mm256_max_ps(_mm256_sub_ps(_mm256_andnot_ps(signBit, v), _mm256_set1_ps(WALL_SPEED_LOSS)), zero);
+	__m256 bounced = _mm256_or_ps(speed, _mm256_andnot_ps(v, signBit));
+
+	__m256 moved = _mm256_add_ps(p, _mm256_mul_ps(v, _mm256_set1_ps(seconds)));
+	_mm256_storeu_ps(position, _mm256_blendv_ps(moved, p, isAtSide));
+	_mm256_storeu_ps(velocity, _mm256_blendv_ps(v, bounced, isAtSide));
+}
+#elif defined(CIRCLE_SIMD_SSE2)
+// one axis of MoveCircles for four circles
+inline void moveAxis4(float* position, float* velocity, const float* radius, float seconds)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	__m128 p = _mm_loadu_ps(position);
+	__m128 v = _mm_loadu_ps(velocity);
+	__m128 r = _mm_loadu_ps(radius);
+
+	__m128 atHigh = _mm_and_ps(_mm_cmpgt_ps(v, zero), _mm_cmpge_ps(p, _mm_sub_ps(one, r)));
+	__m128 atLow = _mm_and_ps(_mm_cmplt_ps(v, zero), _mm_cmple_ps(p, _mm_sub_ps(r, one)));
+	__m128 isAtSide = _mm_or_ps(atHigh, atLow);
+
+	// bounced: the reduced speed with the opposite sign of v
+	__m128 speed = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(signBit, v), _mm_set1_ps(WALL_SPEED_LOSS)), zero);
+	__m128 bounced = _mm_or_ps(speed, _mm_andnot_ps(v, signBit));
+
+	// SSE2 has no blend: select with and/andnot/or
+	__m128 moved = _mm_add_ps(p, _mm_mul_ps(v, _mm_set1_ps(seconds)));
+	_mm_storeu_ps(position, _mm_or_ps(_mm_and_ps(isAtSide, p), _mm_andnot_ps(isAtSide, moved)));
+	_mm_storeu_ps(velocity, _mm_or_ps(_mm_and_ps(isAtSide, bounced), _mm_andnot_ps(isAtSide, v)));
+}
+#endif
+
+// moves circles [begin, end) one step of the given seconds and bounces the ones at the sides of the screen
+inline void MoveCircles(CircleStore& circles, int begin, int end, float seconds)
+{
+	int count = end;
+	int i = begin;
+#if defined(CIRCLE_SIMD_AVX2)
+	for (; i + 8 <= count; i += 8)
+	{
+		moveAxis8(&circles.x[i], &circles.vx[i], &circles.radius[i], seconds);
+		moveAxis8(&circles.y[i], &circles.vy[i], &circles.radius[i], seconds);
+	}
+#elif defined(CIRCLE_SIMD_SSE2)
+	for (; i + 4 <= count; i += 4)
+	{
+		moveAxis4(&circles.x[i], &circles.vx[i], &circles.radius[i], seconds);
+		moveAxis4(&circles.y[i], &circles.vy[i], &circles.radius[i], seconds);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		moveAxis(circles.x[i], circles.vx[i], circles.radius[i], seconds);
+		moveAxis(circles.y[i], circles.vy[i], circles.radius[i], seconds);
+	}
+}
+
+// moves every circle one step
+inline void MoveCircles(CircleStore& circles, float seconds)
+{
+	MoveCircles(circles, 0, circles.Size(), seconds);
+}
+
+// bit i set when circle first + i of [first, end) overlaps circle a, for up to CIRCLE_SIMD_WIDTH circles
+inline unsigned int overlapMask(const CircleStore& circles, int a, int first, int end)
+{
+	float ax = circles.x[a], ay = circles.y[a], ar = circles.radius[a];
+#if defined(CIRCLE_SIMD_AVX2)
+	if (first + 8 <= end)
+	{
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&circles.x[first]), _mm256_set1_ps(ax));
+		__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&circles.y[first]), _mm256_set1_ps(ay));
+		__m256 reach = _mm256_add_ps(_mm256_loadu_ps(&circles.radius[first]), _mm256_set1_ps(ar));
+		__m256 distanceSquared = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(distanceSquared, _mm256_mul_ps(reach, reach), _CMP_LT_OQ));
+	}
+#elif defined(CIRCLE_SIMD_SSE2)
+	if (first + 4 <= end)
+	{
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(&circles.x[first]), _mm_set1_ps(ax));
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(&circles.y[first]), _mm_set1_ps(ay));
+		__m128 reach = _mm_add_ps(_mm_loadu_ps(&circles.radius[first]), _mm_set1_ps(ar));
+		__m128 distanceSquared = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		return (unsigned int)_mm_movemask_ps(_mm_cmplt_ps(distanceSquared, _mm_mul_ps(reach, reach)));
+	}
+#endif
+	unsigned int mask = 0;
+	for (int b = first; b < end && b < first + CIRCLE_SIMD_WIDTH; b++)
+	{
+		float dx = circles.x[b] - ax, dy = circles.y[b] - ay, reach = circles.radius[b] + ar;
+		if (dx * dx + dy * dy < reach * reach)
+			mask |= 1u << (b - first);
+	}
+	return mask;
+}
+
+// tests circle a against the circles [first, end) and calls touching(a, b) for each overlap found.
+// The overlaps of a block are found before touching is called for them, so touching has to test
+// again when it can move or shrink the circles.
+template <typename Touching>
+inline void testAgainstRange(CircleStore& circles, int a, int first, int end, const Touching& touching)
+{
+	for (int b = first; b < end; b += CIRCLE_SIMD_WIDTH)
+	{
+		unsigned int mask = overlapMask(circles, a, b, end);
+		for (int bit = 0; mask != 0; bit++, mask >>= 1)
+			if (mask & 1)
+				touching(a, b + bit);
+	}
+}
+
+// the cell pairs of ForEachCellPair tested with testAgainstRange
+template <typename Touching>
+struct touchingCellPairs
+{
+	CircleStore& circles;
+	const Touching& touching;
+
+	void operator()(int begin, int end, int otherBegin, int otherEnd) const
+	{
+		bool isSameCell = begin == otherBegin;
+		for (int a = begin; a < end; a++)
+			testAgainstRange(circles, a, isSameCell ? a + 1 : otherBegin, otherEnd, touching);
+	}
+};
+
+// calls touching(a, b) for the pairs of overlapping circles found through the grid; the store must be sorted by cell
+template <typename Touching>
+inline void ForEachTouchingPair(CircleStore& circles, const UniformGrid& grid, const Touching& touching)
+{
+	grid.ForEachCellPair(touchingCellPairs<Touching>{ circles, touching });
+}
+
+// ForEachTouchingPair for the cells first to last - 1 of a grid color; several threads can each take some cells of the same color
+template <typename Touching>
+inline void ForEachTouchingPairOfColor(CircleStore& circles, const UniformGrid& grid, int color, int first, int last, const Touching& touching)
+{
+	grid.ForEachCellPairOfColor(color, first, last, touchingCellPairs<Touching>{ circles, touching });
+}
+#endif
@@ -0,0 +1,235 @@
+/* Headless benchmark of the Coding Collisions physics.
+
+Runs the simulation of collision_world.h without a window: N circles spawned from a seed,
+M bricks, K fixed steps, and prints the throughput, the circle pairs tested and found, and
+the peak memory as JSON, so every physics change gets a number that can be reproduced.
+Builds on Linux without GL:
+
+    g++ -O2 -std=c++17 -mavx2 -pthread collision_benchmark.cpp -o collision_benchmark
+
+Command-line options:
+    --circles N         circles spawned at the start (default 100000)
+    --bricks M          bricks in a grid over the middle of the screen (default 9, the game's level)
+    --level PATH        bricks of a level file instead (see brick_field.h)
+    --steps K           physics steps (default 600)
+    --seed S            seed of the circles (default 1)
+    --threads T         physics threads, 0 for one per hardware thread (default 0)
+    --physics-hz H      physics steps per simulated second (default 240)
+    --swept 0|1         swept or discrete collision tests (default 1)
+    --sleep 0|1         resting circles sleep and leave the step (default 1)
+    --record PATH       record the steps and write the recording to a file (see world_recorder.h)
+    --keyframes K       steps between two keyframes of the recording (default 240)
+    --replay PATH       start from a step of a recording instead of spawning circles; the circles, bricks, level, seed and
+                        sleep options are the recording's
+    --replay-step N     step of the recording to start from (default its last)
+    --report PATH       also write the JSON to a file
+*/
+
+#include "world_recorder.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <sys/resource.h>
+
+using namespace std;
+
+// count destructable bricks in a square grid over the middle of the screen, each a third of the spacing wide
+vector<Brick> CreateBrickGrid(int count)
+{
+	vector<Brick> bricks;
+	int columns = max(1, (int)ceil(sqrt((double)count)));
+	float spacing = 1.6f / columns;
+	for (int k = 0; k < count; k++)
+		bricks.push_back(Brick(DESTRUCTABLE, -0.8f + (k % columns + 0.5f) * spacing, -0.8f + (k / columns + 0.5f) * spacing, spacing / 6, 4000));
+	return bricks;
+}
+
+// largest resident memory of the process so far, in kilobytes
+long PeakMemoryKb()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+int main(int argc, char* argv[])
+{
+	int numCircles = 100000;
+	int numBricks = -1;
+	const char* levelPath = NULL;
+	int steps = 600;
+	unsigned long long seed = 1;
+	int numThreads = 0;
+	double physicsRate = 240;
+	bool isSwept = true;
+	bool isSleepEnabled = true;
+	const char* recordPath = NULL;
+	int keyframeInterval = 240;
+	const char* replayPath = NULL;
+	long long replayStep = -1;
+	const char* reportPath = NULL;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--circles") == 0)
+			numCircles = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--bricks") == 0)
+			numBricks = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--level") == 0)
+			levelPath = argv[i + 1];
+		else if (strcmp(argv[i], "--steps") == 0)
+			steps = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--seed") == 0)
+			seed = strtoull(argv[i + 1], NULL, 10);
+		else if (strcmp(argv[i], "--threads") == 0)
+			numThreads = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--physics-hz") == 0)
+			physicsRate = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--swept") == 0)
+			isSwept = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "--sleep") == 0)
+			isSleepEnabled = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "--record") == 0)
+			recordPath = argv[i + 1];
+		else if (strcmp(argv[i], "--keyframes") == 0)
+			keyframeInterval = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--replay") == 0)
+			replayPath = argv[i + 1];
+		else if (strcmp(argv[i], "--replay-step") == 0)
+			replayStep = atoll(argv[i + 1]);
+		else if (strcmp(argv[i], "--report") == 0)
+			reportPath = argv[i + 1];
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (numCircles < 0 || steps < 1 || physicsRate <= 0 || keyframeInterval < 1)
+	{
+		fprintf(stderr, "The circles must not be negative and the steps, physics rate and keyframe interval must be positive\n");
+		return EXIT_FAILURE;
+	}
+
+	CollisionWorld world;
+	WorkerPool pool;
+	pool.Create(numThreads);
+	if (replayPath)
+	{
+		// the recording's step, replayed from the keyframe before it
+		WorldRecorder replay;
+		if (!replay.Load(replayPath))
+			return EXIT_FAILURE;
+		if (replay.IsEmpty())
+		{
+			fprintf(stderr, "%s has no steps\n", replayPath);
+			return EXIT_FAILURE;
+		}
+		unsigned long long restoredStep = replayStep < 0 ? replay.LastStep() : (unsigned long long)replayStep;
+		if (!replay.Restore(world, pool, restoredStep))
+		{
+			fprintf(stderr, "%s: steps %llu to %llu can be restored\n", replayPath, replay.FirstStep(), replay.LastStep());
+			return EXIT_FAILURE;
+		}
+		numCircles = world.Circles.Size();
+		seed = world.Circles.Seed;
+		isSleepEnabled = world.Islands.IsEnabled;
+	}
+	else
+	{
+		world.Circles.Seed = seed;
+		world.Islands.IsEnabled = isSleepEnabled;
+		if (numBricks >= 0 && !levelPath)
+		{
+			world.Bricks.Bricks = CreateBrickGrid(numBricks);
+			world.Bricks.Build();
+		}
+		else if (!LoadLevel(world, levelPath))
+			return EXIT_FAILURE;
+		SpawnCircles(world, numCircles);
+	}
+	int startBricks = (int)world.Bricks.Bricks.size();
+	unsigned long long startStep = world.Circles.Steps;
+	float stepSeconds = (float)(1 / physicsRate);
+	WorldRecorder recorder;
+	recorder.KeyframeInterval = keyframeInterval;
+
+	// only the steps and the recording are timed; the candidate pairs are counted from the grid each step left behind
+	long long pairsTested = 0, pairsFound = 0, brickHits = 0, awakeCircleSteps = 0;
+	double seconds = 0, recordSeconds = 0;
+	for (int step = 0; step < steps; step++)
+	{
+		auto start = chrono::steady_clock::now();
+		if (recordPath)
+		{
+			recorder.Record(world, stepSeconds, isSwept);
+			auto recorded = chrono::steady_clock::now();
+			recordSeconds += chrono::duration<double>(recorded - start).count();
+			start = recorded;
+		}
+		StepContacts contacts = StepWorld(world, pool, stepSeconds, isSwept);
+		seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		awakeCircleSteps += world.Islands.NumAwake + world.Islands.NumSlept; // the circles the step handled, including the ones it put to sleep
+		pairsTested += CountCandidatePairs(world.Grid);
+		pairsFound += contacts.circlePairs;
+		brickHits += contacts.brickHits;
+	}
+	int threadsUsed = pool.NumThreads();
+	pool.Destroy();
+	if (recordPath && !recorder.Save(recordPath))
+		return EXIT_FAILURE;
+
+	char json[2048];
+	snprintf(json, sizeof(json),
+		"{\n"
+		"  \"circles\": %d,\n"
+		"  \"bricks\": %d,\n"
+		"  \"steps\": %d,\n"
+		"  \"start_step\": %llu,\n"
+		"  \"seed\": %llu,\n"
+		"  \"threads\": %d,\n"
+		"  \"physics_hz\": %.2f,\n"
+		"  \"swept\": %s,\n"
+		"  \"sleep\": %s,\n"
+		"  \"simd\": \"%s\",\n"
+		"  \"seconds\": %.6f,\n"
+		"  \"steps_per_second\": %.3f,\n"
+		"  \"circle_steps_per_second\": %.1f,\n"
+		"  \"awake_circle_steps\": %lld,\n"
+		"  \"pairs_tested\": %lld,\n"
+		"  \"pairs_found\": %lld,\n"
+		"  \"brick_hits\": %lld,\n"
+		"  \"final_circles\": %d,\n"
+		"  \"final_awake_circles\": %d,\n"
+		"  \"final_bricks\": %d,\n"
+		"  \"record_seconds\": %.6f,\n"
+		"  \"record_share\": %.6f,\n"
+		"  \"record_keyframes\": %d,\n"
+		"  \"record_bytes\": %zu,\n"
+		"  \"hash\": \"%016llx\",\n"
+		"  \"peak_memory_kb\": %ld\n"
+		"}\n",
+		numCircles, startBricks, steps, startStep, seed, threadsUsed, physicsRate, isSwept ? "true" : "false", isSleepEnabled ? "true" : "false",
+		CIRCLE_SIMD_NAME,
+		seconds, steps / seconds, (double)numCircles * steps / seconds, awakeCircleSteps,
+		pairsTested, pairsFound, brickHits,
+		world.Circles.Size(), world.Islands.NumAwake, world.Bricks.NumBricksOn(),
+		recordSeconds, recordSeconds / seconds, recorder.NumKeyframes(), recorder.NumBytes(), HashCircles(world.Circles), PeakMemoryKb());
+	fputs(json, stdout);
+
+	if (reportPath)
+	{
+		FILE* file = fopen(reportPath, "w");
+		if (!file)
+		{
+			fprintf(stderr, "Failed to write %s\n", reportPath);
+			return EXIT_FAILURE;
+		}
+		fputs(json, file);
+		fclose(file);
+	}
+	return EXIT_SUCCESS;
+}
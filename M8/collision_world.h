@@ -0,0 +1,425 @@
+#pragma once
+/* The Coding Collisions simulation without the window: circles, bricks and the physics step.
+
+A CollisionWorld holds everything a run needs to be repeated exactly: the circles (with
+the seed and the per-circle random counters), the bricks, and the spawner's random
+counter. StepWorld advances it by one fixed step, spread over the threads of a
+WorkerPool, with the same result for any number of threads:
+
+    1. every COMPACT_INTERVAL steps, the circles halved below MIN_CIRCLE_RADIUS are removed
+    2. the new circles and the sleeping islands an awake circle can reach wake up (sleep_islands.h)
+    3. the awake circles are sorted by grid cell and the pairs that touch collide (discrete or swept)
+    4. the awake circles that reach a brick hit it, in circle order since the bricks are shared
+    5. the awake circles move, bouncing off the sides of the screen
+    6. the islands of circles that have been calm long enough go to sleep
+
+Only standard C++ is used here, so the game (Coding-Collisions.cpp) and the headless
+benchmark (collision_benchmark.cpp) build the same simulation.
+*/
+
+#ifndef COLLISION_WORLD_H
+#define COLLISION_WORLD_H
+
+#include "broadphase.h"
+#include "circle_store.h"
+#include "swept_collision.h"
+#include "brick_field.h"
+#include "sleep_islands.h"
+#include "worker_pool.h"
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+
+// speed of a new circle in units per second, the old 0.01 per frame at 60 frames per second
+const float CIRCLE_SPEED = 0.01f * REFERENCE_RATE;
+
+// circles halved below this radius are a small fraction of a pixel and are removed
+const float MIN_CIRCLE_RADIUS = 0.0001f;
+
+// physics steps between two removals of the circles that became too small
+const int COMPACT_INTERVAL = 60;
+
+// random stream of the spawner; the circles use their ids as streams
+const unsigned int SPAWN_STREAM = 0xFFFFFFFF;
+
+// collisions found by a physics step
+struct StepContacts
+{
+	int circlePairs;
+	int brickHits;
+};
+
+class CollisionWorld
+{
+public:
+	CircleStore Circles;
+	BrickField Bricks;
+	SleepIslands Islands;       // which circles are awake; the step only handles those
+	UniformGrid Grid;           // grid of the circle centers, rebuilt every step so only circles in neighboring cells are tested against each other
+	unsigned int SpawnDraws;    // random numbers the spawner has used
+
+	// Scratch of StepWorld
+	std::vector<unsigned char> BrickHits;   // circles that reached a brick in the last step
+	std::vector<int> BricksAtCircle;        // bricks under the center of a circle whose hits are being applied
+	std::vector<int> FirstBrickHit;         // with swept collisions, the first brick each hitting circle enters
+	std::vector<float> BrickHitTime;        // and the share of the step at which it enters it
+
+	CollisionWorld() : SpawnDraws(0) {}
+
+	// writes the state of the world to a snapshot archive or reads it back (see world_recorder.h); the grid and the scratch
+	// arrays are rebuilt by the next step
+	template <typename Archive>
+	void Serialize(Archive& archive)
+	{
+		Circles.Serialize(archive);
+		Bricks.Serialize(archive);
+		Islands.Serialize(archive);
+		archive.Value(SpawnDraws);
+		if (Archive::IsReading && (Islands.NumAwake < 0 || Islands.NumAsleep < 0 || Islands.NumAwake + Islands.NumAsleep > Circles.Size()))
+			archive.IsValid = false;
+	}
+
+	// next random number of the spawner
+	unsigned int NextSpawnRandom()
+	{
+		return CounterRandom(Circles.Seed, SPAWN_STREAM, SpawnDraws++);
+	}
+};
+
+// returns a velocity in a random one of the eight directions, drawn from circle i's random numbers
+inline void GetRandomVelocity(CircleStore& circles, int i, float speed, float& vx, float& vy)
+{
+	DirectionVelocity((circles.NextRandom(i) % 8) + 1, speed, vx, vy);
+}
+
+// the values of rand() / 10000 with the 15-bit rand() the colors were made with
+inline float GetRandomColor(unsigned int random)
+{
+	return (float)((random & 0x7FFF) / 10000);
+}
+
+// each brick starts off green and change color as they are collided with. When the bricks lose all of their health, they are destroyed.
+// The level of level_default.txt, used when no level file is given.
+inline std::vector<Brick> CreateBricks()
+{
+	std::vector<Brick> bricks;
+	bricks.push_back(Brick(DESTRUCTABLE, 0.0, 0.0, 0.2, 4000));
+	bricks.push_back(Brick(DESTRUCTABLE, 0.0, 0.2, 0.2, 4000));
+	bricks.push_back(Brick(DESTRUCTABLE, -0.2, 0.0, 0.2, 4000));
+	bricks.push_back(Brick(DESTRUCTABLE, 0.2, 0, 0.2, 4000));
+	bricks.push_back(Brick(DESTRUCTABLE, 0.0, -0.2, 0.2, 4000));
+	bricks.push_back(Brick(DESTRUCTABLE, -0.2, -0.2, 0.2, 4000));
+	bricks.push_back(Brick(DESTRUCTABLE, 0.2, -0.2, 0.2, 4000));
+	bricks.push_back(Brick(DESTRUCTABLE, -0.4, -0.2, 0.2, 4000));
+	bricks.push_back(Brick(DESTRUCTABLE, 0.4, -0.2, 0.2, 4000));
+	return bricks;
+}
+
+// loads the bricks of a level file into the world, or the bricks of CreateBricks when path is NULL. Returns false when the file cannot be used.
+inline bool LoadLevel(CollisionWorld& world, const char* path)
+{
+	if (path)
+		return world.Bricks.Load(path);
+	world.Bricks.Bricks = CreateBricks();
+	world.Bricks.Build();
+	return true;
+}
+
+// true when the center of circle i is inside a brick
+inline bool IsInsideBrick(const CircleStore& circles, int i, const Brick& brk)
+{
+	float x = circles.x[i], y = circles.y[i];
+	return (x > brk.x - brk.width && x <= brk.x + brk.width) && (y > brk.y - brk.width && y <= brk.y + brk.width);
+}
+
+// bounces circle i off a brick in a random direction and weakens the brick
+inline void HitBrick(CircleStore& circles, int i, Brick* brk)
+{
+	float& x = circles.x[i];
+	float& y = circles.y[i];
+	float speed = CircleSpeed(circles.vx[i], circles.vy[i]);
+	circles.calmSteps[i] = 0;
+	if (brk->brick_type == REFLECTIVE)
+	{
+		GetRandomVelocity(circles, i, speed, circles.vx[i], circles.vy[i]);
+		brk->ReduceStrength();
+		x = x + 0.03;
+		y = y + 0.04;
+	}
+	else if (brk->brick_type == DESTRUCTABLE)
+	{
+		if (brk->brick_strength > 0) {
+			brk->ReduceStrength();
+			GetRandomVelocity(circles, i, speed, circles.vx[i], circles.vy[i]);
+		}
+		else {
+			brk->onoff = OFF; // turns the brick off when the brick's strength is equal to zero
+		}
+	}
+}
+
+// HitBrick when the center of circle i is inside the brick
+inline void CheckBrickCollision(CircleStore& circles, int i, Brick* brk)
+{
+	if (IsInsideBrick(circles, i, *brk))
+		HitBrick(circles, i, brk);
+}
+
+// the size of circles a and b, circleDist apart, is reduced and the color of b is changed to a random color
+inline void CollideCircles(CircleStore& circles, int a, int b, float circleDist)
+{
+	const int circle[2] = { a, b };
+	for (int i : circle)
+	{
+		circles.x[i] *= -1;
+		circles.y[i] *= -1;
+		circles.x[i] += circles.x[i] * (circles.radius[i] - (circleDist / 2));
+		circles.y[i] += circles.y[i] * (circles.radius[i] - (circleDist / 2));
+		circles.radius[i] = circles.radius[i] / 2;
+		circles.calmSteps[i] = 0;
+	}
+
+	circles.red[b] = GetRandomColor(circles.NextRandom(b));
+	circles.green[b] = GetRandomColor(circles.NextRandom(b));
+	circles.blue[b] = GetRandomColor(circles.NextRandom(b));
+}
+
+// If circles a and b collide the size of both is reduced and the color of b is changed to a random color. Returns true when they collide.
+inline bool ResolveCircleCollision(CircleStore& circles, int a, int b)
+{
+	float circleDist = std::sqrt((circles.x[b] - circles.x[a]) * (circles.x[b] - circles.x[a]) + (circles.y[b] - circles.y[a]) * (circles.y[b] - circles.y[a]));
+	if (circleDist >= circles.radius[a] + circles.radius[b])
+		return false;
+
+	CollideCircles(circles, a, b, circleDist);
+	return true;
+}
+
+// collides circles a and b where they touch, at share t of a step of the given seconds. They are moved there, collided, and
+// moved back along their velocity by the same time, so the movement of the step takes them on for the rest of the step.
+inline void ResolveSweptCollision(CircleStore& circles, int a, int b, float t, float seconds)
+{
+	const int circle[2] = { a, b };
+	for (int i : circle)
+	{
+		circles.x[i] += circles.vx[i] * seconds * t;
+		circles.y[i] += circles.vy[i] * seconds * t;
+	}
+	CollideCircles(circles, a, b, circles.radius[a] + circles.radius[b]);
+	for (int i : circle)
+	{
+		circles.x[i] -= circles.vx[i] * seconds * t;
+		circles.y[i] -= circles.vy[i] * seconds * t;
+	}
+}
+
+// sorts the first count circles by grid cell and resolves every pair of them that overlaps. The cells are handled one color
+// after the other; the cells of a color touch different circles, so the threads share them out without locks and the result
+// is the same for any number of threads. Returns the number of pairs that collided.
+inline int CheckCircleCollisions(CircleStore& circles, UniformGrid& circleGrid, WorkerPool& pool, int count)
+{
+	std::atomic<int> contacts(0);
+	circles.SortByCell(circleGrid, 0, count);
+	for (int color = 0; color < GRID_NUM_COLORS; color++)
+	{
+		pool.ParallelFor(circleGrid.NumCellsOfColor(color), 1, [&](int first, int last) {
+			int found = 0;
+			ForEachTouchingPairOfColor(circles, circleGrid, color, first, last, [&](int a, int b) {
+				found += ResolveCircleCollision(circles, a, b);
+			});
+			contacts += found;
+		});
+	}
+	return contacts;
+}
+
+// CheckCircleCollisions with the swept test: every pair whose paths meet during a step of the given seconds collides where
+// they first touch, however far they move in the step
+inline int CheckSweptCircleCollisions(CircleStore& circles, UniformGrid& circleGrid, WorkerPool& pool, float seconds, int count)
+{
+	std::atomic<int> contacts(0);
+	circles.SortByCell(circleGrid, MaxStepDistance(circles, seconds, count), count);
+	for (int color = 0; color < GRID_NUM_COLORS; color++)
+	{
+		pool.ParallelFor(circleGrid.NumCellsOfColor(color), 1, [&](int first, int last) {
+			int found = 0;
+			ForEachSweptPairOfColor(circles, circleGrid, color, first, last, seconds, [&](int a, int b, float t) {
+				ResolveSweptCollision(circles, a, b, t, seconds);
+				found++;
+			});
+			contacts += found;
+		});
+	}
+	return contacts;
+}
+
+// one physics step of the given seconds: circle collisions, brick collisions, then movement of the awake circles, spread over
+// the pool's threads. The discrete tests only see the positions at the start of the step; the swept ones (isSwept) the whole
+// path of the step.
+inline StepContacts StepWorld(CollisionWorld& world, WorkerPool& pool, float seconds, bool isSwept)
+{
+	CircleStore& circles = world.Circles;
+	UniformGrid& circleGrid = world.Grid;
+	BrickField& field = world.Bricks;
+	std::vector<unsigned char>& brickHits = world.BrickHits;
+	std::vector<int>& firstBrickHit = world.FirstBrickHit;
+	std::vector<float>& brickHitTime = world.BrickHitTime;
+	SleepIslands& islands = world.Islands;
+	StepContacts contacts = { 0, 0 };
+	if (circles.Steps % COMPACT_INTERVAL == 0)
+		islands.Compact(circles, MIN_CIRCLE_RADIUS);
+	circles.Steps++;
+
+	islands.WakeAdded(circles);
+	islands.WakeReached(circles, pool, isSwept ? MaxStepDistance(circles, seconds, islands.NumAwake) : 0);
+	int numAwake = islands.NumAwake;
+
+	pool.ParallelFor(numAwake, 1, [&](int begin, int end) {
+		circles.SavePositions(begin, end);
+	});
+
+	if (isSwept)
+		contacts.circlePairs = CheckSweptCircleCollisions(circles, circleGrid, pool, seconds, numAwake);
+	else
+		contacts.circlePairs = CheckCircleCollisions(circles, circleGrid, pool, numAwake);
+
+	// The bricks are shared by all circles: find the circles inside a brick in parallel, then apply the hits in circle order.
+	// Each circle only tests the bricks the field's index lists near it, and a brick that is turned off leaves the index.
+	brickHits.resize(circles.Size());
+	if (isSwept)
+	{
+		// the first brick the center enters during the step; it is hit there and the circle goes on from there with its new velocity
+		firstBrickHit.resize(circles.Size());
+		brickHitTime.resize(circles.Size());
+		pool.ParallelFor(numAwake, 1, [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+			{
+				brickHits[i] = 0;
+				brickHitTime[i] = 2;
+				float x = circles.x[i], y = circles.y[i];
+				float dx = circles.vx[i] * seconds, dy = circles.vy[i] * seconds;
+				field.ForEachBrickNear(std::min(x, x + dx), std::min(y, y + dy), std::max(x, x + dx), std::max(y, y + dy), [&](int k) {
+					float minX, minY, maxX, maxY;
+					field.Bricks[k].GetBox(minX, minY, maxX, maxY);
+					float t = SweptBoxTime(x, y, dx, dy, minX, minY, maxX, maxY);
+					// the lowest brick index wins a tie, whatever order the cells list the bricks in
+					if (t >= 0 && (t < brickHitTime[i] || (t == brickHitTime[i] && k < firstBrickHit[i])))
+					{
+						brickHits[i] = 1;
+						brickHitTime[i] = t;
+						firstBrickHit[i] = k;
+					}
+				});
+			}
+		});
+		for (int i = 0; i < numAwake; i++)
+		{
+			if (!brickHits[i])
+				continue;
+			float t = brickHitTime[i];
+			circles.x[i] += circles.vx[i] * seconds * t;
+			circles.y[i] += circles.vy[i] * seconds * t;
+			Brick& brk = field.Bricks[firstBrickHit[i]];
+			bool wasOn = brk.onoff == ON;
+			HitBrick(circles, i, &brk);
+			if (wasOn && brk.onoff == OFF)
+				field.Remove(firstBrickHit[i]);
+			circles.x[i] -= circles.vx[i] * seconds * t;
+			circles.y[i] -= circles.vy[i] * seconds * t;
+			contacts.brickHits++;
+		}
+	}
+	else
+	{
+		pool.ParallelFor(numAwake, 1, [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+			{
+				brickHits[i] = 0;
+				field.ForEachBrickAt(circles.x[i], circles.y[i], [&](int k) {
+					if (IsInsideBrick(circles, i, field.Bricks[k]))
+						brickHits[i] = 1;
+				});
+			}
+		});
+		for (int i = 0; i < numAwake; i++)
+		{
+			if (!brickHits[i])
+				continue;
+			world.BricksAtCircle.clear();
+			field.ForEachBrickAt(circles.x[i], circles.y[i], [&](int k) {
+				world.BricksAtCircle.push_back(k);
+			});
+			for (int k : world.BricksAtCircle)
+			{
+				Brick& brk = field.Bricks[k];
+				bool wasOn = brk.onoff == ON;
+				CheckBrickCollision(circles, i, &brk);
+				if (wasOn && brk.onoff == OFF)
+					field.Remove(k);
+			}
+			contacts.brickHits++;
+		}
+	}
+
+	//Movement
+	pool.ParallelFor(numAwake, CIRCLE_SIMD_WIDTH, [&](int begin, int end) {
+		MoveCircles(circles, begin, end, seconds);
+	});
+
+	islands.Sleep(circles, seconds);
+	return contacts;
+}
+
+// adds count circles at random positions from the spawner's random stream, with radii that keep the share of the
+// screen they cover the same for every count
+inline void SpawnCircles(CollisionWorld& world, int count)
+{
+	CircleStore& circles = world.Circles;
+	if (count <= 0)
+		return;
+
+	const float coverage = 0.2f; // share of the 2 x 2 screen covered by circles
+	float radius = std::sqrt(coverage * 4 / (3.14159f * count));
+
+	circles.AddCircles(count, [&](int i) {
+		circles.x[i] = (world.NextSpawnRandom() >> 8) * (2.0f / 16777216.0f) - 1;
+		circles.y[i] = (world.NextSpawnRandom() >> 8) * (2.0f / 16777216.0f) - 1;
+		DirectionVelocity((world.NextSpawnRandom() % 8) + 1, CIRCLE_SPEED, circles.vx[i], circles.vy[i]);
+		circles.radius[i] = radius;
+		circles.red[i] = GetRandomColor(world.NextSpawnRandom());
+		circles.green[i] = GetRandomColor(world.NextSpawnRandom());
+		circles.blue[i] = GetRandomColor(world.NextSpawnRandom());
+	});
+}
+
+// hash of every bit of the circles, equal only when two runs produced exactly the same circles
+inline unsigned long long HashCircles(const CircleStore& circles)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	auto add = [&](const void* data, size_t size) {
+		for (size_t k = 0; k < size; k++)
+			hash = (hash ^ ((const unsigned char*)data)[k]) * 1099511628211ULL;
+	};
+	for (int i = 0; i < circles.Size(); i++)
+	{
+		const float values[] = { circles.x[i], circles.y[i], circles.vx[i], circles.vy[i], circles.radius[i], circles.red[i], circles.green[i], circles.blue[i] };
+		add(values, sizeof(values));
+		add(&circles.id[i], sizeof(unsigned int));
+		add(&circles.draws[i], sizeof(unsigned int));
+	}
+	return hash;
+}
+
+// pairs of circles the last step tested: every pair in the same or neighbouring cells of the grid it sorted them into
+inline long long CountCandidatePairs(const UniformGrid& circleGrid)
+{
+	long long pairs = 0;
+	circleGrid.ForEachCellPair([&](int begin, int end, int otherBegin, int otherEnd) {
+		long long count = end - begin;
+		pairs += begin == otherBegin ? count * (count - 1) / 2 : count * (otherEnd - otherBegin);
+	});
+	return pairs;
+}
+#endif
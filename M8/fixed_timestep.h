@@ -0,0 +1,58 @@
+#pragma once
+/* Fixed-timestep accumulator that decouples the physics rate from the frame rate.
+
+Every frame adds the time it took to the accumulator, and the physics takes as many steps
+of exactly StepSeconds as fit in it, so the simulation advances by the real time whatever
+the display rate and the steps always have the same length (which keeps the results the
+same on every machine). The time left over, less than one step, gives the share of a step
+between the last physics state and the moment the frame shows (Alpha), used to draw the
+circles between their last two positions.
+
+A frame takes at most MaxSubsteps steps. When the physics cannot keep up, the time that
+would need more steps is dropped: the simulation slows down instead of taking ever more
+steps per frame.
+*/
+
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+#include <cmath>
+
+class FixedTimestep
+{
+public:
+	double StepSeconds;  // length of a physics step
+	int MaxSubsteps;     // physics steps a frame can take
+
+	FixedTimestep() : StepSeconds(1.0 / 240), MaxSubsteps(8), accumulator(0) {}
+
+	void SetRate(double stepsPerSecond)
+	{
+		StepSeconds = 1.0 / stepsPerSecond;
+	}
+
+	// adds the time of a frame and returns the physics steps to take for it
+	int Advance(double frameSeconds)
+	{
+		accumulator += frameSeconds;
+		int steps = 0;
+		while (accumulator >= StepSeconds && steps < MaxSubsteps)
+		{
+			accumulator -= StepSeconds;
+			steps++;
+		}
+		if (accumulator >= StepSeconds)
+			accumulator = std::fmod(accumulator, StepSeconds);
+		return steps;
+	}
+
+	// share of a step, 0 to 1, from the last physics state to now
+	float Alpha() const
+	{
+		return (float)(accumulator / StepSeconds);
+	}
+
+private:
+	double accumulator;  // time not simulated yet
+};
+#endif
@@ -0,0 +1,219 @@
+#pragma once
+/* Instanced core-profile drawing of the circles and bricks.
+
+Every circle and brick is one instance of a unit quad: the vertex shader places the quad
+from the instance's center and size and the fragment shader keeps the pixels inside the
+shape, a circle from its distance to the center (with a one-pixel smooth edge) or the
+whole square for a brick. All circles are drawn with one glDrawArraysInstanced call and
+all bricks with another, whatever their number.
+
+The instances are streamed every frame: Map orphans the instance buffer (so the driver
+gives a fresh block instead of waiting for the GPU to finish with the last frame's) and
+returns a pointer the caller fills, from any number of threads, before Draw unmaps it.
+*/
+
+#ifndef INSTANCED_RENDERER_H
+#define INSTANCED_RENDERER_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdio>
+
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+
+// One circle or brick: center, radius or half side, and color
+struct ShapeInstance
+{
+	float x, y;
+	float size;
+	float red, green, blue;
+};
+
+enum SHAPE { SHAPE_CIRCLE, SHAPE_SQUARE, SHAPE_COUNT };
+
+class InstancedRenderer
+{
+public:
+	InstancedRenderer() : program(0), quadBuffer(0), shapeLocation(-1)
+	{
+		for (int s = 0; s < SHAPE_COUNT; s++)
+		{
+			instanceVaos[s] = 0;
+			instanceBuffers[s] = 0;
+			capacity[s] = 0;
+			count[s] = 0;
+		}
+	}
+
+	// compiles the shaders and creates the quad and instance buffers. Returns false when the shaders do not build.
+	bool Create()
+	{
+		const GLchar* vertexSource = GLSL(330,
+			layout(location = 0) in vec2 corner;         // corner of the unit quad, -1 to 1
+			layout(location = 1) in vec3 instanceShape;  // center x, center y, radius or half side
+			layout(location = 2) in vec3 instanceColor;
+
+			out vec2 local;
+			out vec3 color;
+
+			void main()
+			{
+				local = corner;
+				color = clamp(instanceColor, 0.0, 1.0); // the random colors go up to 3 like the old glColor values, which were clamped
+				gl_Position = vec4(instanceShape.xy + corner * instanceShape.z, 0.0, 1.0);
+			}
+		);
+
+		const GLchar* fragmentSource = GLSL(330,
+			in vec2 local;
+			in vec3 color;
+
+			uniform int uShape; // 0 circle, 1 square
+
+			out vec4 fragmentColor;
+
+			void main()
+			{
+				float alpha = 1.0;
+				if (uShape == 0)
+				{
+					// distance to the edge in pixels gives a one-pixel smooth edge at any size
+					float radial = length(local);
+					float pixel = fwidth(radial);
+					alpha = 1.0 - smoothstep(1.0 - pixel, 1.0, radial);
+					if (alpha <= 0.0)
+						discard;
+				}
+				fragmentColor = vec4(color * alpha, 1.0);
+			}
+		);
+
+		program = glCreateProgram();
+		GLuint vertexShader = compile(GL_VERTEX_SHADER, vertexSource);
+		GLuint fragmentShader = compile(GL_FRAGMENT_SHADER, fragmentSource);
+		if (!vertexShader || !fragmentShader)
+			return false;
+		glAttachShader(program, vertexShader);
+		glAttachShader(program, fragmentShader);
+		glLinkProgram(program);
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+
+		GLint isLinked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+		if (!isLinked)
+		{
+			char infoLog[512];
+			glGetProgramInfoLog(program, sizeof(infoLog), NULL, infoLog);
+			printf("Shape program failed to link:\n%s\n", infoLog);
+			return false;
+		}
+		shapeLocation = glGetUniformLocation(program, "uShape");
+
+		// unit quad as a triangle strip
+		const GLfloat corners[] = { -1, -1, 1, -1, -1, 1, 1, 1 };
+		glGenBuffers(1, &quadBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+		// one vertex array per shape, each with its own instance buffer
+		glGenVertexArrays(SHAPE_COUNT, instanceVaos);
+		glGenBuffers(SHAPE_COUNT, instanceBuffers);
+		for (int s = 0; s < SHAPE_COUNT; s++)
+		{
+			glBindVertexArray(instanceVaos[s]);
+
+			glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBuffers[s]);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (void*)offsetof(ShapeInstance, x));
+			glVertexAttribDivisor(1, 1);
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (void*)offsetof(ShapeInstance, red));
+			glVertexAttribDivisor(2, 1);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return true;
+	}
+
+	void Destroy()
+	{
+		glDeleteVertexArrays(SHAPE_COUNT, instanceVaos);
+		glDeleteBuffers(SHAPE_COUNT, instanceBuffers);
+		glDeleteBuffers(1, &quadBuffer);
+		glDeleteProgram(program);
+	}
+
+	// returns room for numInstances instances of a shape to fill before the next Draw
+	ShapeInstance* Map(SHAPE shape, int numInstances)
+	{
+		count[shape] = numInstances;
+		if (numInstances == 0)
+			return NULL;
+
+		// orphan the buffer, growing it when the instances do not fit
+		if (numInstances > capacity[shape])
+			capacity[shape] = numInstances + numInstances / 2;
+		GLsizeiptr size = (GLsizeiptr)capacity[shape] * sizeof(ShapeInstance);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffers[shape]);
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+		void* instances = glMapBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr)numInstances * sizeof(ShapeInstance),
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return (ShapeInstance*)instances;
+	}
+
+	// draws the instances mapped this frame: the circles, then the bricks on top of them
+	void Draw()
+	{
+		glUseProgram(program);
+		for (int shape = 0; shape < SHAPE_COUNT; shape++)
+		{
+			if (count[shape] == 0)
+				continue;
+
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBuffers[shape]);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+
+			glUniform1i(shapeLocation, shape);
+			glBindVertexArray(instanceVaos[shape]);
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count[shape]);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+private:
+	GLuint program;
+	GLuint quadBuffer;
+	GLuint instanceVaos[SHAPE_COUNT];
+	GLuint instanceBuffers[SHAPE_COUNT];
+	int capacity[SHAPE_COUNT];  // instances the buffers hold
+	int count[SHAPE_COUNT];     // instances mapped this frame
+	GLint shapeLocation;
+
+	GLuint compile(GLenum type, const GLchar* source)
+	{
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+
+		GLint isCompiled = 0;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+		if (!isCompiled)
+		{
+			char infoLog[512];
+			glGetShaderInfoLog(shader, sizeof(infoLog), NULL, infoLog);
+			printf("Shape shader failed to compile:\n%s\n", infoLog);
+			glDeleteShader(shader);
+			return 0;
+		}
+		return shader;
+	}
+};
+#endif
@@ -0,0 +1,378 @@
+#pragma once
+/* Sleeping circles and simulation islands.
+
+In a long game most circles end up resting: every bounce off a side of the screen takes
+WALL_SPEED_LOSS off their speed until they stop, and a circle that does not move only
+changes when something hits it. SleepIslands takes such circles out of the step.
+
+The store is kept in three ranges:
+
+    [0, NumAwake)                       awake circles, the only ones the step sorts, tests and moves
+    [NumAwake, NumAwake + NumAsleep)    sleeping circles, with no velocity, indexed by a grid of their own
+    [NumAwake + NumAsleep, Size())      circles added since the last step, woken at the start of the next
+
+A circle is calm while it is slower than SLEEP_SPEED on both axes and nothing hits it
+(the collisions reset its calmSteps). Circles calm for SLEEP_SECONDS go to sleep together
+with the calm circles near them, closer than ISLAND_REACH times the sum of their radii:
+such a group is an island. An island stays awake while one of its circles is near an awake
+circle that is not calm, and joins the sleeping islands it is near.
+
+At the start of a step every awake circle looks up, in the sleepers' grid, the sleeping
+circles it can reach in the step (its radius plus the distance it can move), and their
+islands wake up whole before the collisions, so the step tests them like any other circle.
+A circle that a collision moves onto a sleeping one wakes it at the next step.
+
+The step then costs in proportion to the awake circles. Waking and putting circles to sleep
+reorder the store and rebuild the sleepers' grid, which costs in proportion to all of them,
+but only happens when the circles settle or are disturbed. With IsEnabled false every
+circle stays awake and the steps are the same as without SleepIslands.
+*/
+
+#ifndef SLEEP_ISLANDS_H
+#define SLEEP_ISLANDS_H
+
+#include "broadphase.h"
+#include "circle_store.h"
+#include "worker_pool.h"
+
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+
+// speed below which a circle is calm, on each axis; less than one bounce takes off, so a circle the sides have stopped is calm
+const float SLEEP_SPEED = 0.5f * WALL_SPEED_LOSS;
+
+// time a circle has to stay calm before it can sleep
+const float SLEEP_SECONDS = 0.5f;
+
+// circles closer than this many times the sum of their radii are in the same island
+const float ISLAND_REACH = 2.0f;
+
+// label of no island
+const unsigned int NO_ISLAND = 0xFFFFFFFF;
+
+class SleepIslands
+{
+public:
+	bool IsEnabled;
+	int NumAwake;
+	int NumAsleep;
+	int NumWoken;               // circles woken at the start of the last step
+	int NumSlept;               // circles put to sleep at the end of the last step
+	UniformGrid SleeperGrid;    // the sleeping circles; item k is circle NumAwake + k
+
+	SleepIslands() : IsEnabled(true), NumAwake(0), NumAsleep(0), NumWoken(0), NumSlept(0), nextIsland(0), isGridDirty(true) {}
+
+	void Clear()
+	{
+		NumAwake = NumAsleep = NumWoken = NumSlept = 0;
+		nextIsland = 0;
+		isGridDirty = true;
+	}
+
+	// writes the ranges to a snapshot archive or reads them back; the sleepers' grid is rebuilt at the next step
+	template <typename Archive>
+	void Serialize(Archive& archive)
+	{
+		archive.Value(IsEnabled);
+		archive.Value(NumAwake);
+		archive.Value(NumAsleep);
+		archive.Value(nextIsland);
+		if (Archive::IsReading)
+		{
+			NumWoken = NumSlept = 0;
+			isGridDirty = true;
+		}
+	}
+
+	// CircleStore::Compact keeping the three ranges. Returns the number of circles removed.
+	int Compact(CircleStore& circles, float minRadius)
+	{
+		int keptAwake = 0, keptAsleep = 0;
+		for (int i = 0; i < NumAwake; i++)
+			keptAwake += circles.radius[i] >= minRadius;
+		for (int i = NumAwake; i < NumAwake + NumAsleep; i++)
+			keptAsleep += circles.radius[i] >= minRadius;
+		int removed = circles.Compact(minRadius);
+		if (removed > 0)
+		{
+			NumAwake = keptAwake;
+			NumAsleep = keptAsleep;
+			isGridDirty = true;
+		}
+		return removed;
+	}
+
+	// wakes the circles added since the last step, or every circle when sleeping is off
+	void WakeAdded(CircleStore& circles)
+	{
+		NumWoken = 0;
+		if (!IsEnabled)
+		{
+			NumAwake = circles.Size();
+			NumAsleep = 0;
+			return;
+		}
+
+		// the added circles move in front of the sleeping ones
+		int sleepEnd = NumAwake + NumAsleep;
+		if (sleepEnd == circles.Size())
+			return;
+		order.clear();
+		for (int i = 0; i < NumAwake; i++)
+			order.push_back(i);
+		for (int i = sleepEnd; i < circles.Size(); i++)
+			order.push_back(i);
+		for (int i = NumAwake; i < sleepEnd; i++)
+			order.push_back(i);
+		circles.Reorder(order);
+		NumAwake += circles.Size() - sleepEnd;
+		isGridDirty = true;
+	}
+
+	// wakes the islands of the sleeping circles an awake circle can reach: closer than the sum of their radii and padding
+	void WakeReached(CircleStore& circles, WorkerPool& pool, float padding)
+	{
+		if (NumAsleep == 0)
+			return;
+		if (isGridDirty)
+			buildGrid(circles);
+
+		// each thread gathers the islands of its circles, then they are merged in order
+		std::mutex mutex;
+		islands.clear();
+		pool.ParallelFor(NumAwake, 1, [&](int begin, int end) {
+			std::vector<unsigned int> found;
+			for (int a = begin; a < end; a++)
+			{
+				float x = circles.x[a], y = circles.y[a], reach = circles.radius[a] + padding;
+				SleeperGrid.ForEachItemNear(x - reach, y - reach, x + reach, y + reach, [&](int item) {
+					int s = NumAwake + item;
+					float dx = circles.x[s] - x, dy = circles.y[s] - y, distance = reach + circles.radius[s];
+					if (dx * dx + dy * dy < distance * distance)
+						found.push_back(circles.island[s]);
+				});
+			}
+			if (!found.empty())
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				islands.insert(islands.end(), found.begin(), found.end());
+			}
+		});
+		if (islands.empty())
+			return;
+		std::sort(islands.begin(), islands.end());
+		islands.erase(std::unique(islands.begin(), islands.end()), islands.end());
+
+		// the woken circles go after the awake ones, the others stay asleep in the same order
+		int sleepEnd = NumAwake + NumAsleep;
+		order.clear();
+		for (int i = 0; i < NumAwake; i++)
+			order.push_back(i);
+		for (int i = NumAwake; i < sleepEnd; i++)
+			if (isIn(islands, circles.island[i]))
+				order.push_back(i);
+		NumWoken = (int)order.size() - NumAwake;
+		for (int i = NumAwake; i < sleepEnd; i++)
+			if (!isIn(islands, circles.island[i]))
+				order.push_back(i);
+		circles.Reorder(order);
+		for (int i = NumAwake; i < NumAwake + NumWoken; i++)
+			circles.calmSteps[i] = 0;
+		NumAwake += NumWoken;
+		NumAsleep -= NumWoken;
+		buildGrid(circles);
+	}
+
+	// counts the calm steps of the awake circles after a step of the given seconds and puts the calm islands to sleep
+	void Sleep(CircleStore& circles, float seconds)
+	{
+		NumSlept = 0;
+		if (!IsEnabled)
+			return;
+		// one pass over the awake circles, lighter than a ParallelFor hand-off
+		unsigned int calmNeeded = (unsigned int)std::max(1.0f, std::ceil(SLEEP_SECONDS / seconds));
+		candidates.clear();
+		for (int i = 0; i < NumAwake; i++)
+		{
+			bool isCalm = std::fabs(circles.vx[i]) < SLEEP_SPEED && std::fabs(circles.vy[i]) < SLEEP_SPEED;
+			circles.calmSteps[i] = isCalm ? std::min(circles.calmSteps[i] + 1, calmNeeded) : 0;
+			if (circles.calmSteps[i] >= calmNeeded)
+				candidates.push_back(i);
+		}
+		if (candidates.empty())
+			return;
+		if (isGridDirty)
+			buildGrid(circles);
+
+		// union-find over the candidates (nodes 0 to C - 1) and the sleeping islands they are near (nodes C and up)
+		int numCandidates = (int)candidates.size();
+		candidateOf.assign(NumAwake, -1);
+		for (int c = 0; c < numCandidates; c++)
+			candidateOf[candidates[c]] = c;
+		parent.resize(numCandidates);
+		for (int c = 0; c < numCandidates; c++)
+			parent[c] = c;
+		isBlocked.assign(numCandidates, 0);
+		sleeperLinks.clear();
+
+		awakeGrid.Build(NumAwake, [&](int i, float& cx, float& cy, float& cr) {
+			cx = circles.x[i];
+			cy = circles.y[i];
+			cr = circles.radius[i] * ISLAND_REACH;
+		});
+		for (int c = 0; c < numCandidates; c++)
+		{
+			int i = candidates[c];
+			float x = circles.x[i], y = circles.y[i], reach = circles.radius[i] * ISLAND_REACH;
+			awakeGrid.ForEachItemNear(x - reach, y - reach, x + reach, y + reach, [&](int j) {
+				if (j == i || !isNear(circles, i, j))
+					return;
+				if (candidateOf[j] >= 0)
+					join(c, candidateOf[j]);
+				else
+					isBlocked[c] = 1;
+			});
+			SleeperGrid.ForEachItemNear(x - reach, y - reach, x + reach, y + reach, [&](int item) {
+				int s = NumAwake + item;
+				if (isNear(circles, i, s))
+					sleeperLinks.push_back(std::make_pair(c, circles.island[s]));
+			});
+		}
+		nearIslands.clear();
+		for (const std::pair<int, unsigned int>& link : sleeperLinks)
+			nearIslands.push_back(link.second);
+		std::sort(nearIslands.begin(), nearIslands.end());
+		nearIslands.erase(std::unique(nearIslands.begin(), nearIslands.end()), nearIslands.end());
+		for (int k = 0; k < (int)nearIslands.size(); k++)
+			parent.push_back(numCandidates + k);
+		for (const std::pair<int, unsigned int>& link : sleeperLinks)
+			join(link.first, numCandidates + (int)(std::lower_bound(nearIslands.begin(), nearIslands.end(), link.second) - nearIslands.begin()));
+
+		// an island sleeps when none of its circles is blocked; it takes the smallest label of the sleeping islands it joins
+		int numNodes = (int)parent.size();
+		rootLabel.assign(numNodes, NO_ISLAND);
+		rootBlocked.assign(numNodes, 0);
+		for (int c = 0; c < numCandidates; c++)
+			rootBlocked[find(c)] |= isBlocked[c];
+		for (int n = numCandidates; n < numNodes; n++)
+		{
+			unsigned int& label = rootLabel[find(n)];
+			label = std::min(label, nearIslands[n - numCandidates]);
+		}
+		for (int c = 0; c < numCandidates; c++)
+			if (!rootBlocked[find(c)] && rootLabel[find(c)] == NO_ISLAND)
+				rootLabel[find(c)] = nextIsland++;
+
+		// sleeping islands merged into another take its label
+		merged.clear();
+		for (int n = numCandidates; n < numNodes; n++)
+			if (!rootBlocked[find(n)] && rootLabel[find(n)] != nearIslands[n - numCandidates])
+				merged.push_back(std::make_pair(nearIslands[n - numCandidates], rootLabel[find(n)]));
+		std::sort(merged.begin(), merged.end());
+
+		// the circles that stay awake, the sleeping ones, then the ones that fall asleep. The circles of a blocked island start
+		// counting again, so the islands near moving circles are not tried every step.
+		order.clear();
+		for (int i = 0; i < NumAwake; i++)
+		{
+			if (candidateOf[i] >= 0 && rootBlocked[find(candidateOf[i])])
+				circles.calmSteps[i] = 0;
+			if (candidateOf[i] < 0 || rootBlocked[find(candidateOf[i])])
+				order.push_back(i);
+		}
+		NumSlept = NumAwake - (int)order.size();
+		if (NumSlept == 0)
+			return;
+		int sleepEnd = NumAwake + NumAsleep;
+		for (int i = NumAwake; i < sleepEnd; i++)
+		{
+			order.push_back(i);
+			std::vector<std::pair<unsigned int, unsigned int>>::iterator found = std::lower_bound(merged.begin(), merged.end(),
+				std::make_pair(circles.island[i], 0u));
+			if (found != merged.end() && found->first == circles.island[i])
+				circles.island[i] = found->second;
+		}
+		for (int c = 0; c < numCandidates; c++)
+		{
+			int root = find(c);
+			if (rootBlocked[root])
+				continue;
+			int i = candidates[c];
+			circles.vx[i] = 0;
+			circles.vy[i] = 0;
+			circles.previousX[i] = circles.x[i];
+			circles.previousY[i] = circles.y[i];
+			circles.island[i] = rootLabel[root];
+			order.push_back(i);
+		}
+		for (int i = sleepEnd; i < circles.Size(); i++)
+			order.push_back(i);
+		circles.Reorder(order);
+		NumAwake -= NumSlept;
+		NumAsleep += NumSlept;
+		buildGrid(circles);
+	}
+
+private:
+	unsigned int nextIsland;    // label of the next new island
+	bool isGridDirty;           // the sleepers moved in the store since SleeperGrid was built
+	UniformGrid awakeGrid;
+
+	// Scratch
+	std::vector<int> order;
+	std::vector<unsigned int> islands;
+	std::vector<int> candidates;
+	std::vector<int> candidateOf;
+	std::vector<int> parent;
+	std::vector<unsigned char> isBlocked;
+	std::vector<std::pair<int, unsigned int>> sleeperLinks;    // candidate and the label of a sleeping island near it
+	std::vector<unsigned int> nearIslands;      // label of each island node, sorted
+	std::vector<unsigned int> rootLabel;
+	std::vector<unsigned char> rootBlocked;
+	std::vector<std::pair<unsigned int, unsigned int>> merged;  // old and new label of the merged islands
+
+	static bool isIn(const std::vector<unsigned int>& sorted, unsigned int value)
+	{
+		return std::binary_search(sorted.begin(), sorted.end(), value);
+	}
+
+	static bool isNear(const CircleStore& circles, int i, int j)
+	{
+		float dx = circles.x[j] - circles.x[i], dy = circles.y[j] - circles.y[i];
+		float reach = (circles.radius[i] + circles.radius[j]) * ISLAND_REACH;
+		return dx * dx + dy * dy < reach * reach;
+	}
+
+	void buildGrid(const CircleStore& circles)
+	{
+		int first = NumAwake;
+		SleeperGrid.Build(NumAsleep, [&](int k, float& cx, float& cy, float& cr) {
+			cx = circles.x[first + k];
+			cy = circles.y[first + k];
+			cr = circles.radius[first + k] * ISLAND_REACH;
+		});
+		isGridDirty = false;
+	}
+
+	int find(int node)
+	{
+		while (parent[node] != node)
+		{
+			parent[node] = parent[parent[node]];
+			node = parent[node];
+		}
+		return node;
+	}
+
+	void join(int a, int b)
+	{
+		a = find(a);
+		b = find(b);
+		if (a != b)
+			parent[std::max(a, b)] = std::min(a, b);
+	}
+};
+#endif
@@ -0,0 +1,187 @@
+#pragma once
+/* Swept (continuous) collision tests for circles that move far in one step.
+
+The discrete tests only look at where the circles are at the start of a step, so a circle
+that moves further than a brick is wide, or two circles that move further than their
+radii, can pass through each other between two steps. The swept tests follow the straight
+path of a step instead and return the time of impact: the share of the step, 0 to 1, at
+which the objects first touch, or -1 when they do not touch during the step.
+
+    SweptCircleTime         two circles given their relative position and relative
+                            movement in the step: the first root of
+                            |position + movement * t| = sum of the radii
+    SweptBoxTime            a point moving along a segment against an axis-aligned box
+                            (slab test); the bricks count a hit when the center of a
+                            circle enters their box, so the point is the circle's center
+
+ForEachSweptPairOfColor finds the pairs through the grid like ForEachTouchingPairOfColor,
+with the grid built from radii padded by the distance a circle can move in the step
+(CircleStore::SortByCell), so any two circles whose paths meet are in the same or
+neighbouring cells. The pairs are screened with the same SSE2 or AVX2 width as the
+discrete test.
+*/
+
+#ifndef SWEPT_COLLISION_H
+#define SWEPT_COLLISION_H
+
+#include "broadphase.h"
+#include "circle_store.h"
+
+#include <cmath>
+#include <algorithm>
+
+// share of the step at which two circles at relative position (px, py) moving by (dx, dy) relative to each other come within
+// reach of each other; 0 when they already touch and -1 when they do not touch during the step
+inline float SweptCircleTime(float px, float py, float dx, float dy, float reach)
+{
+	float c = px * px + py * py - reach * reach;
+	if (c < 0)
+		return 0;
+
+	// |p + d t|^2 = reach^2: a t^2 + 2 b t + c = 0, with the circles coming closer (b < 0)
+	float a = dx * dx + dy * dy;
+	float b = px * dx + py * dy;
+	if (b >= 0 || a == 0)
+		return -1;
+	float discriminant = b * b - a * c;
+	if (discriminant < 0)
+		return -1;
+	float t = (-b - std::sqrt(discriminant)) / a;
+	return t <= 1 ? t : -1;
+}
+
+// share of the step at which a point at (x, y) moving by (dx, dy) enters the box [minX, maxX] x [minY, maxY]; 0 when it starts
+// inside and -1 when it misses the box during the step
+inline float SweptBoxTime(float x, float y, float dx, float dy, float minX, float minY, float maxX, float maxY)
+{
+	float enter = 0, leave = 1;
+	const float position[2] = { x, y }, movement[2] = { dx, dy };
+	const float low[2] = { minX, minY }, high[2] = { maxX, maxY };
+	for (int axis = 0; axis < 2; axis++)
+	{
+		if (movement[axis] == 0)
+		{
+			if (position[axis] < low[axis] || position[axis] > high[axis])
+				return -1;
+			continue;
+		}
+		float t0 = (low[axis] - position[axis]) / movement[axis];
+		float t1 = (high[axis] - position[axis]) / movement[axis];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		enter = std::max(enter, t0);
+		leave = std::min(leave, t1);
+		if (enter > leave)
+			return -1;
+	}
+	return enter;
+}
+
+// longest distance one of the first count circles moves in a step of the given seconds
+inline float MaxStepDistance(const CircleStore& circles, float seconds, int count)
+{
+	float maxSpeedSquared = 0;
+	for (int i = 0; i < count; i++)
+		maxSpeedSquared = std::max(maxSpeedSquared, circles.vx[i] * circles.vx[i] + circles.vy[i] * circles.vy[i]);
+	return std::sqrt(maxSpeedSquared) * seconds;
+}
+
+// SweptCircleTime of circles a and b in a step of the given seconds
+inline float SweptPairTime(const CircleStore& circles, int a, int b, float seconds)
+{
+	return SweptCircleTime(circles.x[b] - circles.x[a], circles.y[b] - circles.y[a],
+		(circles.vx[b] - circles.vx[a]) * seconds, (circles.vy[b] - circles.vy[a]) * seconds,
+		circles.radius[a] + circles.radius[b]);
+}
+
+#if defined(CIRCLE_SIMD_AVX2)
+// SweptCircleTime >= 0 for eight pairs as a mask: touching now, or coming closer with the first root within the step
+inline __m256 sweptTouches8(__m256 px, __m256 py, __m256 dx, __m256 dy, __m256 reach)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py)), _mm256_mul_ps(reach, reach));
+	__m256 a = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+	__m256 b = _mm256_add_ps(_mm256_mul_ps(px, dx), _mm256_mul_ps(py, dy));
+	__m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+	// t <= 1 is -b - sqrt(discriminant) <= a
+	__m256 root = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+	__m256 isSoon = _mm256_cmp_ps(_mm256_sub_ps(_mm256_sub_ps(zero, b), root), a, _CMP_LE_OQ);
+	__m256 isApproaching = _mm256_and_ps(_mm256_cmp_ps(b, zero, _CMP_LT_OQ), _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ));
+	return _mm256_or_ps(_mm256_cmp_ps(c, zero, _CMP_LT_OQ), _mm256_and_ps(isApproaching, isSoon));
+}
+#elif defined(CIRCLE_SIMD_SSE2)
+// SweptCircleTime >= 0 for four pairs as a mask: touching now, or coming closer with the first root within the step
+inline __m128 sweptTouches4(__m128 px, __m128 py, __m128 dx, __m128 dy, __m128 reach)
+{
+	const __m128 zero = _mm_setzero_ps();
+	__m128 c = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(reach, reach));
+	__m128 a = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+	__m128 b = _mm_add_ps(_mm_mul_ps(px, dx), _mm_mul_ps(py, dy));
+	__m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+	// t <= 1 is -b - sqrt(discriminant) <= a
+	__m128 root = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+	__m128 isSoon = _mm_cmple_ps(_mm_sub_ps(_mm_sub_ps(zero, b), root), a);
+	__m128 isApproaching = _mm_and_ps(_mm_cmplt_ps(b, zero), _mm_cmpge_ps(discriminant, zero));
+	return _mm_or_ps(_mm_cmplt_ps(c, zero), _mm_and_ps(isApproaching, isSoon));
+}
+#endif
+
+// bit i set when circle first + i of [first, end) and circle a touch during a step of the given seconds, for up to
+// CIRCLE_SIMD_WIDTH circles
+inline unsigned int sweptMask(const CircleStore& circles, int a, int first, int end, float seconds)
+{
+#if defined(CIRCLE_SIMD_AVX2)
+	if (first + 8 <= end)
+	{
+		__m256 step = _mm256_set1_ps(seconds);
+		__m256 px = _mm256_sub_ps(_mm256_loadu_ps(&circles.x[first]), _mm256_set1_ps(circles.x[a]));
+		__m256 py = _mm256_sub_ps(_mm256_loadu_ps(&circles.y[first]), _mm256_set1_ps(circles.y[a]));
+		__m256 dx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&circles.vx[first]), _mm256_set1_ps(circles.vx[a])), step);
+		__m256 dy = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&circles.vy[first]), _mm256_set1_ps(circles.vy[a])), step);
+		__m256 reach = _mm256_add_ps(_mm256_loadu_ps(&circles.radius[first]), _mm256_set1_ps(circles.radius[a]));
+		return (unsigned int)_mm256_movemask_ps(sweptTouches8(px, py, dx, dy, reach));
+	}
+#elif defined(CIRCLE_SIMD_SSE2)
+	if (first + 4 <= end)
+	{
+		__m128 step = _mm_set1_ps(seconds);
+		__m128 px = _mm_sub_ps(_mm_loadu_ps(&circles.x[first]), _mm_set1_ps(circles.x[a]));
+		__m128 py = _mm_sub_ps(_mm_loadu_ps(&circles.y[first]), _mm_set1_ps(circles.y[a]));
+		__m128 dx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&circles.vx[first]), _mm_set1_ps(circles.vx[a])), step);
+		__m128 dy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&circles.vy[first]), _mm_set1_ps(circles.vy[a])), step);
+		__m128 reach = _mm_add_ps(_mm_loadu_ps(&circles.radius[first]), _mm_set1_ps(circles.radius[a]));
+		return (unsigned int)_mm_movemask_ps(sweptTouches4(px, py, dx, dy, reach));
+	}
+#endif
+	unsigned int mask = 0;
+	for (int b = first; b < end && b < first + CIRCLE_SIMD_WIDTH; b++)
+		if (SweptPairTime(circles, a, b, seconds) >= 0)
+			mask |= 1u << (b - first);
+	return mask;
+}
+
+// calls touching(a, b, t) for the pairs of the cells first to last - 1 of a grid color that touch at share t of a step of the
+// given seconds. The store must be sorted by cell with the radii padded by MaxStepDistance. The pairs are screened
+// CIRCLE_SIMD_WIDTH at a time and the time of each one found is computed again just before touching is called for it, after
+// the collisions before it have moved the circles.
+template <typename Touching>
+inline void ForEachSweptPairOfColor(CircleStore& circles, const UniformGrid& grid, int color, int first, int last, float seconds, const Touching& touching)
+{
+	grid.ForEachCellPairOfColor(color, first, last, [&](int begin, int end, int otherBegin, int otherEnd) {
+		bool isSameCell = begin == otherBegin;
+		for (int a = begin; a < end; a++)
+			for (int b = isSameCell ? a + 1 : otherBegin; b < otherEnd; b += CIRCLE_SIMD_WIDTH)
+			{
+				unsigned int mask = sweptMask(circles, a, b, otherEnd, seconds);
+				for (int bit = 0; mask != 0; bit++, mask >>= 1)
+				{
+					if (!(mask & 1))
+						continue;
+					float t = SweptPairTime(circles, a, b + bit, seconds);
+					if (t >= 0)
+						touching(a, b + bit, t);
+				}
+			}
+	});
+}
+#endif
@@ -0,0 +1,132 @@
+#pragma once
+/* Fixed pool of threads for the physics step.
+
+ParallelFor splits a range into one contiguous chunk per thread and returns when every
+chunk is done; the calling thread works on the first chunk. The split only depends on
+the range and the number of threads, and the chunk sizes are rounded up to a multiple
+given by the caller (the SIMD width), so every element goes through the same code path
+whatever the number of threads.
+
+The workers wait on a condition variable between calls, so an idle pool uses no CPU time.
+*/
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <algorithm>
+
+class WorkerPool
+{
+public:
+	WorkerPool() : numThreads(1), generation(0), numBusy(0), isRunning(false) {}
+
+	~WorkerPool()
+	{
+		Destroy();
+	}
+
+	// starts numThreads - 1 workers; numThreads < 1 uses one thread per hardware thread
+	void Create(int threads)
+	{
+		Destroy();
+		if (threads < 1)
+			threads = std::max(1, (int)std::thread::hardware_concurrency());
+		numThreads = threads;
+		generation = 0;
+		isRunning = true;
+		for (int t = 1; t < numThreads; t++)
+			workers.push_back(std::thread(&WorkerPool::workerMain, this, t));
+	}
+
+	void Destroy()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			isRunning = false;
+		}
+		start.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+		workers.clear();
+		numThreads = 1;
+	}
+
+	int NumThreads() const
+	{
+		return numThreads;
+	}
+
+	// calls chunk(begin, end) on one part of [0, count) per thread, each a multiple of alignment long except the last
+	template <typename Chunk>
+	void ParallelFor(int count, int alignment, const Chunk& chunk)
+	{
+		if (count <= 0)
+			return;
+
+		int chunkSize = (count + numThreads - 1) / numThreads;
+		chunkSize = (chunkSize + alignment - 1) / alignment * alignment;
+		if (numThreads == 1 || chunkSize >= count)
+		{
+			chunk(0, count);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			task = [&](int thread) {
+				int begin = std::min(count, thread * chunkSize);
+				int end = std::min(count, begin + chunkSize);
+				if (begin < end)
+					chunk(begin, end);
+			};
+			numBusy = numThreads - 1;
+			generation++;
+		}
+		start.notify_all();
+
+		task(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return numBusy == 0; });
+	}
+
+private:
+	int numThreads;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable start;  // a new task or Destroy
+	std::condition_variable done;   // the last worker finished its chunk
+	std::function<void(int)> task;
+	unsigned int generation;        // counts the tasks so a worker runs each one once
+	int numBusy;                    // workers still running the current task
+	bool isRunning;
+
+	void workerMain(int thread)
+	{
+		unsigned int lastGeneration = 0;
+		for (;;)
+		{
+			std::function<void(int)>* current;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				start.wait(lock, [&] { return !isRunning || generation != lastGeneration; });
+				if (!isRunning)
+					return;
+				lastGeneration = generation;
+				current = &task;
+			}
+
+			(*current)(thread);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--numBusy == 0)
+				done.notify_one();
+		}
+	}
+};
+#endif
@@ -0,0 +1,421 @@
+#pragma once
+/* Snapshots of the collision world, and a recording of its steps to rewind and replay them.
+
+A snapshot is everything a step depends on, written to a flat byte array by the Serialize
+methods of CollisionWorld, CircleStore, BrickField and SleepIslands: the circle columns
+(without the previous positions, which the next step overwrites), the handle slots, the
+bricks, the awake and sleeping ranges, the seed, the random counters of the circles and of
+the spawner, and the step counter. The same Serialize method writes (SnapshotWriter) and
+reads (SnapshotReader) a class, so the two cannot disagree on the layout.
+
+The physics is deterministic, so WorldRecorder does not copy the world every step. It keeps
+a keyframe (a snapshot) every KeyframeInterval steps and, for every step, a frame with only
+what changed from outside the physics since the step before: the circles the game added
+(the ones after the sleeping range, see sleep_islands.h), the spawner's random counter, and
+the length and collision test of the step. Restore loads the last keyframe at or before a
+step and replays the frames up to it, which gives exactly the circles of the recorded run
+on any number of threads. Other changes made between steps (CircleStore::Remove, editing
+the arrays) are not recorded.
+
+The keyframes and frames are kept in a ring: past MaxKeyframes keyframes the oldest one is
+dropped with its frames, and its bytes are reused for the new one. Save and Load write and
+read the whole recording to a file, for instance to restore a step of a long game in the
+headless benchmark.
+
+A frame costs a few bytes per step and a keyframe one copy of the arrays (about 5 MB at 100k
+circles), so at 240 steps between keyframes recording takes well under 1% of the step time.
+*/
+
+#ifndef WORLD_RECORDER_H
+#define WORLD_RECORDER_H
+
+#include "collision_world.h"
+
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <cstring>
+
+// first bytes of a recording file, with the version of the layout
+const char RECORDING_MAGIC[8] = "CCREC01";
+
+// Archive of Serialize that appends the values to a byte array
+class SnapshotWriter
+{
+public:
+	static const bool IsReading = false;
+	bool IsValid;
+
+	SnapshotWriter(std::vector<unsigned char>& out) : IsValid(true), bytes(out) {}
+
+	template <typename T>
+	void Value(T& value)
+	{
+		write(&value, sizeof(T));
+	}
+
+	// count of the items that follow
+	void Length(int& count, size_t)
+	{
+		Value(count);
+	}
+
+	template <typename T>
+	void Column(std::vector<T>& column)
+	{
+		int count = (int)column.size();
+		Value(count);
+		write(column.data(), count * sizeof(T));
+	}
+
+private:
+	std::vector<unsigned char>& bytes;
+
+	void write(const void* data, size_t size)
+	{
+		if (size == 0)
+			return;
+		size_t at = bytes.size();
+		bytes.resize(at + size);
+		memcpy(&bytes[at], data, size);
+	}
+};
+
+// Archive of Serialize that reads the values back. Reading past the end or a count the bytes cannot hold clears IsValid.
+class SnapshotReader
+{
+public:
+	static const bool IsReading = true;
+	bool IsValid;
+
+	SnapshotReader(const unsigned char* data, size_t size) : IsValid(true), position(data), end(data + size) {}
+
+	template <typename T>
+	void Value(T& value)
+	{
+		read(&value, sizeof(T));
+	}
+
+	// count of the items of itemSize bytes that follow; 0 when the rest of the bytes cannot hold them
+	void Length(int& count, size_t itemSize)
+	{
+		Value(count);
+		if (count < 0 || (size_t)count * itemSize > (size_t)(end - position))
+		{
+			IsValid = false;
+			count = 0;
+		}
+	}
+
+	template <typename T>
+	void Column(std::vector<T>& column)
+	{
+		int count;
+		Length(count, sizeof(T));
+		column.resize(count);
+		read(column.data(), count * sizeof(T));
+	}
+
+	bool IsAtEnd() const
+	{
+		return position == end;
+	}
+
+private:
+	const unsigned char* position;
+	const unsigned char* end;
+
+	void read(void* data, size_t size)
+	{
+		if (size == 0)
+			return;
+		if (size > (size_t)(end - position))
+		{
+			IsValid = false;
+			memset(data, 0, size);
+			return;
+		}
+		memcpy(data, position, size);
+		position += size;
+	}
+};
+
+// a circle the game added between two steps
+struct AddedCircle
+{
+	float x, y, vx, vy, radius, red, green, blue;
+};
+
+// what changed from outside the physics just before a step, and how the step was taken
+struct StepFrame
+{
+	unsigned long long Step;
+	float Seconds;
+	bool IsSwept;
+	unsigned int SpawnDraws;
+	std::vector<AddedCircle> Added;
+};
+
+// the world just before a step
+struct Keyframe
+{
+	unsigned long long Step;
+	std::vector<unsigned char> Bytes;
+};
+
+class WorldRecorder
+{
+public:
+	int KeyframeInterval;   // steps between two keyframes
+	int MaxKeyframes;       // keyframes kept; with the frames between them, the steps that can be restored
+
+	WorldRecorder() : KeyframeInterval(240), MaxKeyframes(16) {}
+
+	void Clear()
+	{
+		keyframes.clear();
+		frames.clear();
+	}
+
+	bool IsEmpty() const
+	{
+		return frames.empty();
+	}
+
+	// first and last steps that can be restored; the recording must not be empty
+	unsigned long long FirstStep() const
+	{
+		return frames.front().Step;
+	}
+
+	unsigned long long LastStep() const
+	{
+		return frames.back().Step;
+	}
+
+	int NumKeyframes() const
+	{
+		return (int)keyframes.size();
+	}
+
+	// memory taken by the keyframes and frames
+	size_t NumBytes() const
+	{
+		size_t total = 0;
+		for (const Keyframe& keyframe : keyframes)
+			total += sizeof(Keyframe) + keyframe.Bytes.size();
+		for (const StepFrame& frame : frames)
+			total += sizeof(StepFrame) + frame.Added.size() * sizeof(AddedCircle);
+		return total;
+	}
+
+	// step that was recorded about the given seconds of simulated time before the last one, and not before the first
+	unsigned long long StepBefore(double seconds) const
+	{
+		for (std::deque<StepFrame>::const_reverse_iterator frame = frames.rbegin(); frame != frames.rend(); ++frame)
+		{
+			seconds -= frame->Seconds;
+			if (seconds <= 0)
+				return frame->Step;
+		}
+		return FirstStep();
+	}
+
+	// records the world just before its next step, of the given seconds and collision test; call it right before StepWorld.
+	// Recording a step again after a restore drops the steps recorded after it.
+	void Record(CollisionWorld& world, float seconds, bool isSwept)
+	{
+		unsigned long long step = world.Circles.Steps;
+		if (!frames.empty() && step <= LastStep())
+			discardFrom(step);
+		if (!frames.empty() && step != LastStep() + 1)
+			Clear();
+
+		frames.push_back(StepFrame());
+		StepFrame& frame = frames.back();
+		frame.Step = step;
+		frame.Seconds = seconds;
+		frame.IsSwept = isSwept;
+		frame.SpawnDraws = world.SpawnDraws;
+		if (keyframes.empty() || step % KeyframeInterval == 0)
+		{
+			takeKeyframe(world, step);
+			return;
+		}
+
+		// the circles added since the last step are after the sleeping ones
+		const CircleStore& circles = world.Circles;
+		for (int i = world.Islands.NumAwake + world.Islands.NumAsleep; i < circles.Size(); i++)
+		{
+			AddedCircle added = { circles.x[i], circles.y[i], circles.vx[i], circles.vy[i], circles.radius[i],
+				circles.red[i], circles.green[i], circles.blue[i] };
+			frame.Added.push_back(added);
+		}
+	}
+
+	// puts the world back in the state it had just before a recorded step, replaying the steps from the keyframe before it on
+	// the pool's threads. Returns false when the step is not in the recording or its keyframe cannot be read.
+	bool Restore(CollisionWorld& world, WorkerPool& pool, unsigned long long step)
+	{
+		if (frames.empty() || step < FirstStep() || step > LastStep())
+			return false;
+		int k = (int)keyframes.size() - 1;
+		while (keyframes[k].Step > step)
+			k--;
+
+		SnapshotReader reader(keyframes[k].Bytes.data(), keyframes[k].Bytes.size());
+		world.Serialize(reader);
+		if (!reader.IsValid || !reader.IsAtEnd())
+		{
+			fprintf(stderr, "The keyframe of step %llu cannot be read\n", keyframes[k].Step);
+			return false;
+		}
+		for (size_t f = (size_t)(keyframes[k].Step - FirstStep()); frames[f].Step < step; f++)
+		{
+			StepWorld(world, pool, frames[f].Seconds, frames[f].IsSwept);
+			const StepFrame& next = frames[f + 1];
+			for (const AddedCircle& added : next.Added)
+				world.Circles.Add(added.x, added.y, added.vx, added.vy, added.radius, added.red, added.green, added.blue);
+			world.SpawnDraws = next.SpawnDraws;
+		}
+		return true;
+	}
+
+	// writes the recording to a file. Returns false (after printing the problem) when it cannot be written.
+	bool Save(const char* path)
+	{
+		std::vector<unsigned char> bytes;
+		SnapshotWriter writer(bytes);
+		serialize(writer);
+
+		FILE* file = fopen(path, "wb");
+		if (!file)
+		{
+			fprintf(stderr, "Failed to open the recording %s\n", path);
+			return false;
+		}
+		bool isWritten = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+		isWritten = fclose(file) == 0 && isWritten;
+		if (!isWritten)
+			fprintf(stderr, "Failed to write the recording %s\n", path);
+		return isWritten;
+	}
+
+	// reads a recording written by Save. Returns false (after printing the problem) when the file is missing or malformed.
+	bool Load(const char* path)
+	{
+		FILE* file = fopen(path, "rb");
+		if (!file)
+		{
+			fprintf(stderr, "Failed to open the recording %s\n", path);
+			return false;
+		}
+		std::vector<unsigned char> bytes;
+		unsigned char block[65536];
+		size_t count;
+		while ((count = fread(block, 1, sizeof(block), file)) > 0)
+			bytes.insert(bytes.end(), block, block + count);
+		fclose(file);
+
+		SnapshotReader reader(bytes.data(), bytes.size());
+		serialize(reader);
+		if (!reader.IsValid || !reader.IsAtEnd() || !isConsistent())
+		{
+			fprintf(stderr, "%s: not a recording of this version\n", path);
+			Clear();
+			return false;
+		}
+		return true;
+	}
+
+private:
+	std::deque<Keyframe> keyframes;
+	std::deque<StepFrame> frames;   // one per step, from the first keyframe's step on
+
+	void takeKeyframe(CollisionWorld& world, unsigned long long step)
+	{
+		// past MaxKeyframes the oldest keyframe goes with its frames, and lends its bytes to the new one
+		std::vector<unsigned char> bytes;
+		if ((int)keyframes.size() >= MaxKeyframes)
+		{
+			bytes.swap(keyframes.front().Bytes);
+			keyframes.pop_front();
+			unsigned long long first = keyframes.empty() ? step : keyframes.front().Step;
+			while (frames.front().Step < first)
+				frames.pop_front();
+		}
+
+		keyframes.push_back(Keyframe());
+		Keyframe& keyframe = keyframes.back();
+		keyframe.Step = step;
+		keyframe.Bytes.swap(bytes);
+		keyframe.Bytes.clear();
+		SnapshotWriter writer(keyframe.Bytes);
+		world.Serialize(writer);
+	}
+
+	// drops the frames and keyframes of the steps from the given one on
+	void discardFrom(unsigned long long step)
+	{
+		while (!frames.empty() && frames.back().Step >= step)
+			frames.pop_back();
+		while (!keyframes.empty() && keyframes.back().Step >= step)
+			keyframes.pop_back();
+		if (keyframes.empty())
+			frames.clear();
+	}
+
+	// frames one per step from the first keyframe, keyframes in order among them
+	bool isConsistent() const
+	{
+		if (frames.empty())
+			return keyframes.empty();
+		if (keyframes.empty() || keyframes.front().Step != FirstStep())
+			return false;
+		for (size_t f = 1; f < frames.size(); f++)
+			if (frames[f].Step != frames[f - 1].Step + 1)
+				return false;
+		for (size_t k = 0; k < keyframes.size(); k++)
+			if (keyframes[k].Step > LastStep() || (k > 0 && keyframes[k].Step <= keyframes[k - 1].Step))
+				return false;
+		return true;
+	}
+
+	// the layout of a recording file
+	template <typename Archive>
+	void serialize(Archive& archive)
+	{
+		char magic[sizeof(RECORDING_MAGIC)];
+		memcpy(magic, RECORDING_MAGIC, sizeof(magic));
+		archive.Value(magic);
+		if (memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0)
+		{
+			archive.IsValid = false;
+			return;
+		}
+		archive.Value(KeyframeInterval);
+		archive.Value(MaxKeyframes);
+
+		int numKeyframes = (int)keyframes.size();
+		archive.Length(numKeyframes, sizeof(unsigned long long));
+		keyframes.resize(numKeyframes);
+		for (Keyframe& keyframe : keyframes)
+		{
+			archive.Value(keyframe.Step);
+			archive.Column(keyframe.Bytes);
+		}
+
+		int numFrames = (int)frames.size();
+		archive.Length(numFrames, sizeof(unsigned long long));
+		frames.resize(numFrames);
+		for (StepFrame& frame : frames)
+		{
+			archive.Value(frame.Step);
+			archive.Value(frame.Seconds);
+			archive.Value(frame.IsSwept);
+			archive.Value(frame.SpawnDraws);
+			archive.Column(frame.Added);
+		}
+	}
+};
+#endif